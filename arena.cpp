@@ -0,0 +1,27 @@
+#include "arena.h"
+
+#include <algorithm>
+
+namespace mango {
+
+void* Arena::allocate_slow(size_t size, size_t align) {
+    // blocks double in size so big programs need few of them
+    auto block_size = blocks.empty() ? min_block_size : std::min(blocks.back().size * 2, max_block_size);
+    block_size = std::max(block_size, size + align);
+
+    blocks.push_back(Block{std::unique_ptr<char[]>(new char[block_size]), block_size});
+    next = blocks.back().data.get();
+    end = next + block_size;
+
+    return allocate(size, align);
+}
+
+size_t Arena::bytes_reserved() const {
+    size_t total = 0;
+    for (auto &b : blocks) {
+        total += b.size;
+    }
+    return total;
+}
+
+}
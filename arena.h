@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace mango {
+
+// A fixed size array allocated in an Arena.
+template<typename T>
+struct ArenaArray {
+    T* items = nullptr;
+    size_t count = 0;
+
+    T* begin() const { return items; }
+    T* end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T &operator[](size_t i) const { return items[i]; }
+};
+
+// Arena is a bump pointer allocator. Everything allocated from it is
+// freed at once when the arena is destroyed, destructors are never run,
+// so only trivially destructible data (or data that owns nothing outside
+// the arena) should be allocated in it.
+class Arena {
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    static constexpr size_t min_block_size = 64 * 1024;
+    static constexpr size_t max_block_size = 4 * 1024 * 1024;
+
+    std::vector<Block> blocks;
+    char* next = nullptr;
+    char* end = nullptr;
+    size_t used = 0;
+
+    void* allocate_slow(size_t size, size_t align);
+
+public:
+    Arena() = default;
+    Arena(Arena &&) = default;
+    Arena &operator=(Arena &&) = default;
+
+    void* allocate(size_t size, size_t align) {
+        auto p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(next) + align - 1) & ~(align - 1));
+        if (next == nullptr || p + size > end) {
+            return allocate_slow(size, align);
+        }
+        next = p + size;
+        used += size;
+        return p;
+    }
+
+    template<typename T, typename... Args>
+    T* make(Args &&... args) {
+        return new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // value initialized
+    template<typename T>
+    ArenaArray<T> make_array(size_t count) {
+        ArenaArray<T> array;
+        array.count = count;
+        if (count > 0) {
+            array.items = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+            std::uninitialized_value_construct_n(array.items, count);
+        }
+        return array;
+    }
+
+    template<typename T, typename It>
+    ArenaArray<T> copy_array(It first, It last) {
+        ArenaArray<T> array;
+        array.count = last - first;
+        if (array.count > 0) {
+            array.items = static_cast<T*>(allocate(sizeof(T) * array.count, alignof(T)));
+            std::uninitialized_copy(first, last, array.items);
+        }
+        return array;
+    }
+
+    std::string_view copy_string(std::string_view s) {
+        if (s.empty()) {
+            return {};
+        }
+        auto p = static_cast<char*>(allocate(s.size(), 1));
+        memcpy(p, s.data(), s.size());
+        return {p, s.size()};
+    }
+
+    // bytes handed out, and bytes reserved from the system
+    size_t bytes_used() const { return used; }
+    size_t bytes_reserved() const;
+};
+
+}
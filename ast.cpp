@@ -1,7 +1,10 @@
 #include "ast.h"
 
+#include <algorithm>
 #include <unordered_map>
 
+#include "visitor.h"
+
 namespace mango {
 
 auto operator_string_lookup = std::unordered_map<Operator, std::string>{
@@ -29,309 +32,275 @@ std::string operator_to_string(Operator op) {
     assert(false);
 }
 
-std::ostream &operator<<(std::ostream &os, const Operator &op) {
-    os << operator_to_string(op);
-    return os;
-}
-
-void BinaryExpression::print(string_builder::StringBuilder* sb) {
-    sb->append_line_no_indent("BinaryExpression {");
-    sb->increase_indent();
-    sb->append("operator: ");
-    sb->append_line_no_indent(operator_to_string(op));
-    sb->append("left: ");
-    left->print(sb);
-    sb->append_line("");
-    sb->append("right: ");
-    right->print(sb);
-    sb->append_line("");
-    sb->decrease_indent();
-    sb->append("}");
-}
-
-void BinaryExpression::generate(string_builder::StringBuilder* sb) {
-    left->generate(sb);
-    sb->append_no_indent(" ");
-    sb->append_no_indent(operator_to_string(op));
-    sb->append_no_indent(" ");
-    right->generate(sb);
-}
-
-void UnaryExpression::print(string_builder::StringBuilder* sb) {
-    sb->append_line_no_indent("UnaryExpression {");
-    sb->increase_indent();
-    sb->append("operator: ");
-    sb->append_line_no_indent(operator_to_string(op));
-    sb->append("argument: ");
-    argument->print(sb);
-    sb->append_line("");
-    sb->decrease_indent();
-    sb->append("}");
-}
-
-void UndefinedExpression::print(string_builder::StringBuilder* sb) {
-    sb->append_line_no_indent("UndefinedExpression {}");
-}
-
-void IdentifierExpression::print(string_builder::StringBuilder* sb) {
-    sb->append_no_indent("IdentifierExpression { value: ");
-    sb->append_no_indent(value);
-    sb->append_no_indent(" }");
-}
-
-void IdentifierExpression::generate(string_builder::StringBuilder* sb) {
-    sb->append_no_indent(value);
-}
-
-void IntegerLiteralExpression::print(string_builder::StringBuilder* sb) {
-    sb->append_no_indent("IntegerLiteralExpression { value: ");
-    sb->append_no_indent(std::to_string(value));
-    sb->append_no_indent(" }");
-}
-
-void IntegerLiteralExpression::generate(string_builder::StringBuilder* sb) {
-    sb->append_no_indent(std::to_string(value));
-}
-
-void StringLiteralExpression::print(string_builder::StringBuilder* sb) {
-    sb->append_no_indent("StringLiteralExpression { value: ");
-    sb->append_no_indent(value);
-    sb->append_no_indent(" }");
-}
+int operator_precedence(Operator op) {
+    switch (op) {
+        case Operator::Or:
+            return 1;
+        case Operator::And:
+            return 2;
+        case Operator::EqualTo:
+        case Operator::NotEqualTo:
+            return 3;
+        case Operator::LessThan:
+        case Operator::LessThanOrEqualTo:
+        case Operator::GreaterThan:
+        case Operator::GreaterThanOrEqualTo:
+            return 4;
+        case Operator::Plus:
+        case Operator::Minus:
+            return 5;
+        case Operator::Multiply:
+        case Operator::Divide:
+            return 6;
+        case Operator::Not:
+            break;
+    }
 
-void StringLiteralExpression::generate(string_builder::StringBuilder* sb) {
-    std::cerr << "TODO: strings\n";
+    std::cerr << "not a binary operator\n";
     assert(false);
+    return 0;
 }
 
-void BooleanLiteralExpression::print(string_builder::StringBuilder* sb) {
-    sb->append_no_indent("BooleanLiteralExpression { value: ");
-    sb->append_no_indent(value ? "true" : "false");
-    sb->append_no_indent(" }");
+std::ostream &operator<<(std::ostream &os, const Operator &op) {
+    os << operator_to_string(op);
+    return os;
 }
 
-void BooleanLiteralExpression::generate(string_builder::StringBuilder* sb) {
-    sb->append_no_indent(value ? "1" : "0");
-}
+// prints the tree in a readable form, for debugging the parser
+class Printer : public Visitor<Printer> {
+    string_builder::StringBuilder &sb;
+
+public:
+    using Visitor::visit;
+
+    explicit Printer(string_builder::StringBuilder &sb) : sb(sb) {}
+
+    void visit(BinaryExpression* e) {
+        sb.append_line_no_indent("BinaryExpression {");
+        sb.increase_indent();
+        sb.append("operator: ");
+        sb.append_line_no_indent(operator_to_string(e->op));
+        sb.append("left: ");
+        visit(e->left);
+        sb.append_line("");
+        sb.append("right: ");
+        visit(e->right);
+        sb.append_line("");
+        sb.decrease_indent();
+        sb.append("}");
+    }
 
-void FunctionExpression::print(string_builder::StringBuilder* sb) {
-    sb->append_line_no_indent("FunctionExpression {");
-    // params
-    sb->increase_indent();
-    sb->append_line("parameters: [");
-    sb->increase_indent();
-    for (auto p : parameters) {
-        sb->append_line(p);
+    void visit(UnaryExpression* e) {
+        sb.append_line_no_indent("UnaryExpression {");
+        sb.increase_indent();
+        sb.append("operator: ");
+        sb.append_line_no_indent(operator_to_string(e->op));
+        sb.append("argument: ");
+        visit(e->argument);
+        sb.append_line("");
+        sb.decrease_indent();
+        sb.append("}");
     }
-    sb->decrease_indent();
-    sb->append_line("]");
-    // body
-    sb->append("value: ");
-    body->print(sb);
-    sb->decrease_indent();
-    sb->append_line("}");
-}
 
-void ExpressionStatement::print(string_builder::StringBuilder* sb) {
-    sb->append_line("ExpressionStatement {");
-    sb->increase_indent();
-    sb->append("value: ");
-    value->print(sb);
-    sb->append_line("");
-    sb->decrease_indent();
-    sb->append_line("}");
-}
+    void visit(UndefinedExpression* e) {
+        sb.append_line_no_indent("UndefinedExpression {}");
+    }
 
-void ExpressionStatement::generate(string_builder::StringBuilder* sb) {
-    sb->append("");
-    value->generate(sb);
-    sb->append_no_indent(";");
-    sb->append_line("");
-}
+    void visit(IdentifierExpression* e) {
+        sb.append_no_indent("IdentifierExpression { value: ");
+        sb.append_no_indent(e->value);
+        sb.append_no_indent(" }");
+    }
 
-void WhileStatement::print(string_builder::StringBuilder* sb) {
-    sb->append_line("WhileStatement {");
-    sb->increase_indent();
-    sb->append("condition: ");
-    condition->print(sb);
-    sb->append_line("");
-    sb->append("body: ");
-    body->print(sb);
-    sb->append_line("");
-    sb->decrease_indent();
-    sb->append_line("}");
-}
+    void visit(IntegerLiteralExpression* e) {
+        sb.append_no_indent("IntegerLiteralExpression { value: ");
+        sb.append_no_indent(std::to_string(e->value));
+        sb.append_no_indent(" }");
+    }
 
-void IfStatement::print(string_builder::StringBuilder* sb) {
-    sb->append_line("IfStatement {");
-    sb->increase_indent();
-    sb->append("condition: ");
-    condition->print(sb);
-    sb->append_line("");
-    sb->append("if_block: ");
-    if_block->print(sb);
-    sb->append_line("");
-    sb->append("else_block: ");
-    if (else_block) {
-        else_block->print(sb);
-    } else {
-        sb->append_no_indent("<null>");
+    void visit(StringLiteralExpression* e) {
+        sb.append_no_indent("StringLiteralExpression { value: ");
+        sb.append_no_indent(e->value);
+        sb.append_no_indent(" }");
     }
-    sb->append_line("");
-    sb->decrease_indent();
-    sb->append_line("}");
-}
 
-void IfStatement::generate(string_builder::StringBuilder* sb) {
-    sb->append("if (");
-    condition->generate(sb);
-    sb->append_line_no_indent(")");
-    if_block->generate(sb);
-    if (else_block) {
-        sb->append_line("else");
-        else_block->generate(sb);
+    void visit(BooleanLiteralExpression* e) {
+        sb.append_no_indent("BooleanLiteralExpression { value: ");
+        sb.append_no_indent(e->value ? "true" : "false");
+        sb.append_no_indent(" }");
     }
-}
 
-void ReturnStatement::print(string_builder::StringBuilder* sb) {
-    sb->append_line("ReturnStatement {");
-    sb->increase_indent();
-    sb->append("value: ");
-    value->print(sb);
-    sb->append_line("");
-    sb->decrease_indent();
-    sb->append_line("}");
-}
+    void visit(FunctionExpression* e) {
+        sb.append_line_no_indent("FunctionExpression {");
+        // params
+        sb.increase_indent();
+        sb.append_line("parameters: [");
+        sb.increase_indent();
+        for (auto p : e->parameters) {
+            sb.append_line(p);
+        }
+        sb.decrease_indent();
+        sb.append_line("]");
+        // body
+        sb.append("value: ");
+        visit(e->body);
+        sb.decrease_indent();
+        sb.append_line("}");
+    }
 
-void DeclarationStatement::print(string_builder::StringBuilder* sb) {
-    sb->append_line("DeclarationStatement {");
-    sb->increase_indent();
-    sb->append("type: ");
-    sb->append_line_no_indent(data_type_to_string(data_type));
-    sb->append("identifier: ");
-    sb->append_line_no_indent(identifier);
-    sb->append("value: ");
-    value->print(sb);
-    sb->append_line_no_indent("");
-    sb->decrease_indent();
-    sb->append_line("}");
-}
+    void visit(ExpressionStatement* s) {
+        sb.append_line("ExpressionStatement {");
+        sb.increase_indent();
+        sb.append("value: ");
+        visit(s->value);
+        sb.append_line("");
+        sb.decrease_indent();
+        sb.append_line("}");
+    }
 
-void DeclarationStatement::generate(string_builder::StringBuilder* sb) {
-    assert(data_type == DataType::Integer);
-    sb->append("int ");
-    sb->append_no_indent(identifier);
-    sb->append_no_indent(" = ");
-    value->generate(sb);
-    sb->append_no_indent(";");
-    sb->append_line("");
-}
+    void visit(WhileStatement* s) {
+        sb.append_line("WhileStatement {");
+        sb.increase_indent();
+        sb.append("condition: ");
+        visit(s->condition);
+        sb.append_line("");
+        sb.append("body: ");
+        visit(s->body);
+        sb.append_line("");
+        sb.decrease_indent();
+        sb.append_line("}");
+    }
 
-void BlockStatement::print(string_builder::StringBuilder* sb) {
-    sb->append_line_no_indent("BlockStatement {");
-    sb->increase_indent();
-    sb->append_line("value: [");
-    sb->increase_indent();
-    if (statements.size() > 0) {
-        for (auto st : statements) {
-            st->print(sb);
+    void visit(IfStatement* s) {
+        sb.append_line("IfStatement {");
+        sb.increase_indent();
+        sb.append("condition: ");
+        visit(s->condition);
+        sb.append_line("");
+        sb.append("if_block: ");
+        visit(s->if_block);
+        sb.append_line("");
+        sb.append("else_block: ");
+        if (s->else_block) {
+            visit(s->else_block);
+        } else {
+            sb.append_no_indent("<null>");
         }
-    } else {
-        sb->append_line("<empty>");
+        sb.append_line("");
+        sb.decrease_indent();
+        sb.append_line("}");
     }
-    sb->decrease_indent();
-    sb->append_line("]");
-    sb->decrease_indent();
-    sb->append_line("}");
-}
-
-void BlockStatement::generate(string_builder::StringBuilder* sb) {
-    sb->append_line("{");
-    sb->increase_indent();
 
-    for (auto s: statements) {
-        s->generate(sb);
+    void visit(ReturnStatement* s) {
+        sb.append_line("ReturnStatement {");
+        sb.increase_indent();
+        sb.append("value: ");
+        visit(s->value);
+        sb.append_line("");
+        sb.decrease_indent();
+        sb.append_line("}");
     }
 
-    sb->decrease_indent();
-    sb->append_line("}");
-}
-
-void AssignmentExpression::print(string_builder::StringBuilder* sb) {
-    sb->append_line_no_indent("AssignmentExpression {");
-    sb->increase_indent();
-    sb->append("left: ");
-    left->print(sb);
-    sb->append_line("");
-    sb->append("right: ");
-    right->print(sb);
-    sb->append_line("");
-    sb->decrease_indent();
-    sb->append("}");
-}
+    void visit(DeclarationStatement* s) {
+        sb.append_line("DeclarationStatement {");
+        sb.increase_indent();
+        sb.append("type: ");
+        sb.append_line_no_indent(data_type_to_string(s->data_type));
+        sb.append("identifier: ");
+        sb.append_line_no_indent(s->identifier);
+        sb.append("value: ");
+        visit(s->value);
+        sb.append_line_no_indent("");
+        sb.decrease_indent();
+        sb.append_line("}");
+    }
 
-void AssignmentExpression::generate(string_builder::StringBuilder* sb) {
-    auto id = dynamic_cast<IdentifierExpression*>(left);
-    assert(id != nullptr);
+    void visit(BlockStatement* s) {
+        sb.append_line_no_indent("BlockStatement {");
+        sb.increase_indent();
+        sb.append_line("value: [");
+        sb.increase_indent();
+        if (s->statements.size() > 0) {
+            for (auto st : s->statements) {
+                visit(st);
+            }
+        } else {
+            sb.append_line("<empty>");
+        }
+        sb.decrease_indent();
+        sb.append_line("]");
+        sb.decrease_indent();
+        sb.append_line("}");
+    }
 
-    sb->append_no_indent(id->value);
-    sb->append_no_indent(" = ");
-    right->generate(sb);
-}
+    void visit(AssignmentExpression* e) {
+        sb.append_line_no_indent("AssignmentExpression {");
+        sb.increase_indent();
+        sb.append("left: ");
+        visit(e->left);
+        sb.append_line("");
+        sb.append("right: ");
+        visit(e->right);
+        sb.append_line("");
+        sb.decrease_indent();
+        sb.append("}");
+    }
 
-void FunctionCallExpression::print(string_builder::StringBuilder* sb) {
-    sb->append_line_no_indent("FunctionCallExpression {");
-    sb->increase_indent();
-    sb->append("value: ");
-    sb->append_line_no_indent(value);
-    sb->append_line("arguments: [");
-    sb->increase_indent();
-    for (auto e : arguments) {
-        sb->append("");
-        e->print(sb);
-        sb->append_line("");
+    void visit(FunctionCallExpression* e) {
+        sb.append_line_no_indent("FunctionCallExpression {");
+        sb.increase_indent();
+        sb.append("value: ");
+        sb.append_line_no_indent(e->value);
+        sb.append_line("arguments: [");
+        sb.increase_indent();
+        for (auto arg : e->arguments) {
+            sb.append("");
+            visit(arg);
+            sb.append_line("");
+        }
+        sb.decrease_indent();
+        sb.append_line("");
+        sb.append_line("]");
+        sb.decrease_indent();
+        sb.append_line("}");
     }
-    sb->decrease_indent();
-    sb->append_line("");
-    sb->append_line("]");
-    sb->decrease_indent();
-    sb->append_line("}");
-}
 
-void MemberExpression::print(string_builder::StringBuilder* sb) {
-    sb->append_line_no_indent("MemberExpression {");
-    sb->increase_indent();
-    sb->append("object: ");
-    sb->append_line_no_indent(identifier);
-    sb->append("property: ");
-    property->print(sb);
-    sb->decrease_indent();
-    sb->append_no_indent(" }");
-}
+    void visit(MemberExpression* e) {
+        sb.append_line_no_indent("MemberExpression {");
+        sb.increase_indent();
+        sb.append("object: ");
+        sb.append_line_no_indent(e->identifier);
+        sb.append("property: ");
+        visit(e->property);
+        sb.decrease_indent();
+        sb.append_no_indent(" }");
+    }
 
-void ArrayExpression::print(string_builder::StringBuilder* sb) {
-    sb->append_line_no_indent("ArrayExpression {");
-    sb->append_line("elements: [");
-    sb->increase_indent();
-    for (auto e : elements) {
-        sb->append("");
-        e->print(sb);
-        sb->append_line("");
+    void visit(ArrayExpression* e) {
+        sb.append_line_no_indent("ArrayExpression {");
+        sb.append_line("elements: [");
+        sb.increase_indent();
+        for (auto element : e->elements) {
+            sb.append("");
+            visit(element);
+            sb.append_line("");
+        }
+        sb.decrease_indent();
+        sb.append_line("");
+        sb.append_line("]");
+        sb.decrease_indent();
+        sb.append_line("}");
     }
-    sb->decrease_indent();
-    sb->append_line("");
-    sb->append_line("]");
-    sb->decrease_indent();
-    sb->append_line("}");
-}
 
-void ObjectExpression::print(string_builder::StringBuilder* sb) {
-    sb->append_line_no_indent("ObjectExpression {");
-    sb->append_line("}");
-}
+    void visit(ObjectExpression* e) {
+        sb.append_line_no_indent("ObjectExpression {");
+        sb.append_line("}");
+    }
+};
 
 std::string Program::print() {
     string_builder::StringBuilder sb;
+    Printer printer(sb);
 
     sb.append_line("Program {");
     sb.increase_indent();
@@ -340,7 +309,7 @@ std::string Program::print() {
     sb.increase_indent();
 
     for (auto s : statements) {
-        s->print(&sb);
+        printer.visit(s);
     }
 
     sb.decrease_indent();
@@ -352,22 +321,107 @@ std::string Program::print() {
     return sb.get_string();
 }
 
-std::string Program::generate() {
-    string_builder::StringBuilder sb;
-
-    sb.append_line("int main() {");
-    sb.increase_indent();
-
-    for (auto s : statements) {
-        s->generate(&sb);
+size_t nesting_depth(const Program &program) {
+    struct Node {
+        const void* node;
+        bool statement;
+        size_t depth;
+    };
+    std::vector<Node> stack;
+    for (auto s : program.statements) {
+        stack.push_back({s, true, 1});
     }
 
-    sb.append_line("return 0;");
-
-    sb.decrease_indent();
-    sb.append_line("}");
+    size_t deepest = 0;
+    while (!stack.empty()) {
+        auto [node, statement, depth] = stack.back();
+        stack.pop_back();
+        if (node == nullptr) {
+            continue;
+        }
+        deepest = std::max(deepest, depth);
+        auto expression = [&](const Expression* e, size_t at) { stack.push_back({e, false, at}); };
+        auto child = [&](const Statement* s) { stack.push_back({s, true, depth + 1}); };
+
+        if (statement) {
+            auto s = static_cast<const Statement*>(node);
+            switch (s->kind) {
+                case NodeKind::BlockStatement:
+                    for (auto st : static_cast<const BlockStatement*>(s)->statements) {
+                        child(st);
+                    }
+                    break;
+                case NodeKind::DeclarationStatement:
+                    expression(static_cast<const DeclarationStatement*>(s)->value, depth + 1);
+                    break;
+                case NodeKind::ReturnStatement:
+                    expression(static_cast<const ReturnStatement*>(s)->value, depth + 1);
+                    break;
+                case NodeKind::IfStatement: {
+                    auto is = static_cast<const IfStatement*>(s);
+                    expression(is->condition, depth + 1);
+                    child(is->if_block);
+                    child(is->else_block);
+                    break;
+                }
+                case NodeKind::WhileStatement: {
+                    auto ws = static_cast<const WhileStatement*>(s);
+                    expression(ws->condition, depth + 1);
+                    child(ws->body);
+                    break;
+                }
+                case NodeKind::ExpressionStatement:
+                    expression(static_cast<const ExpressionStatement*>(s)->value, depth + 1);
+                    break;
+                default:
+                    break;
+            }
+            continue;
+        }
 
-    return sb.get_string();
+        auto e = static_cast<const Expression*>(node);
+        switch (e->kind) {
+            case NodeKind::FunctionExpression:
+                child(static_cast<const FunctionExpression*>(e)->body);
+                break;
+            case NodeKind::ObjectExpression:
+                for (auto &p : static_cast<const ObjectExpression*>(e)->properties) {
+                    expression(p.value, depth + 1);
+                }
+                break;
+            case NodeKind::ArrayExpression:
+                for (auto element : static_cast<const ArrayExpression*>(e)->elements) {
+                    expression(element, depth + 1);
+                }
+                break;
+            case NodeKind::MemberExpression:
+                expression(static_cast<const MemberExpression*>(e)->property, depth + 1);
+                break;
+            case NodeKind::FunctionCallExpression:
+                for (auto argument : static_cast<const FunctionCallExpression*>(e)->arguments) {
+                    expression(argument, depth + 1);
+                }
+                break;
+            case NodeKind::BinaryExpression: {
+                auto be = static_cast<const BinaryExpression*>(e);
+                expression(be->left, depth + 1);
+                expression(be->right, depth + 1);
+                break;
+            }
+            case NodeKind::UnaryExpression:
+                expression(static_cast<const UnaryExpression*>(e)->argument, depth + 1);
+                break;
+            case NodeKind::AssignmentExpression: {
+                auto ae = static_cast<const AssignmentExpression*>(e);
+                expression(ae->left, depth + 1);
+                expression(ae->right, depth + 1);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    return deepest;
 }
 
-}
\ No newline at end of file
+}
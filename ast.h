@@ -1,10 +1,13 @@
 #pragma once
 
+#include <cassert>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <iostream>
 #include <unordered_map>
 
+#include "arena.h"
 #include "data_type.h"
 #include "string_builder.h"
 
@@ -30,144 +33,253 @@ std::ostream &operator<<(std::ostream &os, const Operator &op);
 
 std::string operator_to_string(Operator op);
 
+// how tightly a binary operator binds, higher binds tighter
+int operator_precedence(Operator op);
+constexpr int lowest_precedence = 1;
+
+// every node is tagged with its kind, passes switch on it to find the
+// node's type, see visitor.h
+enum class NodeKind : uint8_t {
+    UndefinedExpression,
+    IdentifierExpression,
+    IntegerLiteralExpression,
+    StringLiteralExpression,
+    BooleanLiteralExpression,
+    FunctionExpression,
+    ObjectExpression,
+    ArrayExpression,
+    MemberExpression,
+    FunctionCallExpression,
+    BinaryExpression,
+    UnaryExpression,
+    AssignmentExpression,
+    BlockStatement,
+    DeclarationStatement,
+    ReturnStatement,
+    IfStatement,
+    WhileStatement,
+    ExpressionStatement,
+};
+
 struct Statement {
-    virtual ~Statement() = default;
-    virtual void print(string_builder::StringBuilder* sb) = 0;
-    virtual void generate(string_builder::StringBuilder* sb) {
-        assert(false);
-    };
+    const NodeKind kind;
+    // where the statement is in its source file, set by the parser. only
+    // top level statements have absolute positions, the statements nested
+    // in them are relative to them so edits only move top level statements.
+    int line = 0;
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    explicit Statement(NodeKind kind) : kind(kind) {}
 };
 
 struct Expression {
-    virtual ~Expression() = default;
-    virtual void print(string_builder::StringBuilder* sb) = 0;
-    virtual void generate(string_builder::StringBuilder* sb) {
-        assert(false);
-    };
+    const NodeKind kind;
+    // set by infer_types, see types.h
+    DataType type = DataType::Undefined;
+    explicit Expression(NodeKind kind) : kind(kind) {}
 };
 
+struct DeclarationStatement;
+
 struct UndefinedExpression : public Expression {
-    void print(string_builder::StringBuilder* sb) override;
+    UndefinedExpression() : Expression(NodeKind::UndefinedExpression) {}
 };
 
 struct IdentifierExpression : public Expression {
-    std::string value;
-    void print(string_builder::StringBuilder* sb) override;
-    void generate(string_builder::StringBuilder* sb) override;
+    IdentifierExpression() : Expression(NodeKind::IdentifierExpression) {}
+    std::string_view value;
+    // what the name refers to, set by infer_types, null for parameters and
+    // undeclared names
+    const DeclarationStatement* declaration = nullptr;
 };
 
 struct IntegerLiteralExpression : public Expression {
+    IntegerLiteralExpression() : Expression(NodeKind::IntegerLiteralExpression) {}
     int value;
-    void print(string_builder::StringBuilder* sb) override;
-    void generate(string_builder::StringBuilder* sb) override;
 };
 
 struct StringLiteralExpression : public Expression {
-    std::string value;
-    void print(string_builder::StringBuilder* sb) override;
-    void generate(string_builder::StringBuilder* sb) override;
+    StringLiteralExpression() : Expression(NodeKind::StringLiteralExpression) {}
+    std::string_view value;
 };
 
 struct BooleanLiteralExpression : public Expression {
+    BooleanLiteralExpression() : Expression(NodeKind::BooleanLiteralExpression) {}
     bool value;
-    void print(string_builder::StringBuilder* sb) override;
-    void generate(string_builder::StringBuilder* sb) override;
 };
 
 struct FunctionExpression : public Expression {
-    DataType return_type;
-    std::vector<std::string> parameters;
+    FunctionExpression() : Expression(NodeKind::FunctionExpression) {}
+    DataType return_type = DataType::Undefined;
+    ArenaArray<std::string_view> parameters;
     Statement* body;
-    void print(string_builder::StringBuilder* sb) override;
+    // a declaration per parameter so they can be referred to like other
+    // variables, made by infer_types. a parameter's type is the type of
+    // the first argument given for it.
+    ArenaArray<DeclarationStatement*> parameter_declarations;
+    // the variable the function is declared as, if any, and the variables
+    // from around it the function uses, set by resolve_closures
+    const DeclarationStatement* declaration = nullptr;
+    ArenaArray<const DeclarationStatement*> captures;
+};
+
+struct ObjectProperty {
+    std::string_view key;
+    Expression* value;
+};
+
+struct Shape;
+
+struct ObjectField {
+    std::string_view name;
+    DataType type;
+    // for Object fields, null when the field's shape isn't known
+    const Shape* shape;
+    // for Array fields
+    DataType element_type;
+};
+
+// The fields of an object literal and their types, in source order. Every
+// literal with the same fields has the same shape, the C generator lays
+// each shape out as a struct so fields are at fixed offsets.
+struct Shape {
+    uint32_t id;
+    ArenaArray<ObjectField> fields;
+
+    // the index of the field called name, or -1
+    int field(std::string_view name) const {
+        for (size_t i = 0; i < fields.size(); i++) {
+            if (fields[i].name == name) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
 };
 
 struct ObjectExpression : public Expression {
-    std::unordered_map<std::string, Expression*> properties;
-    void print(string_builder::StringBuilder* sb) override;
+    ObjectExpression() : Expression(NodeKind::ObjectExpression) {}
+    // in source order
+    ArenaArray<ObjectProperty> properties;
+    // set by infer_types
+    const Shape* shape = nullptr;
 };
 
 struct ArrayExpression : public Expression {
-    std::vector<Expression*> elements;
-    void print(string_builder::StringBuilder* sb) override;
+    ArrayExpression() : Expression(NodeKind::ArrayExpression) {}
+    ArenaArray<Expression*> elements;
+    // every element has this type, set by infer_types
+    DataType element_type = DataType::Undefined;
 };
 
 struct MemberExpression : public Expression {
-    std::string identifier;
+    MemberExpression() : Expression(NodeKind::MemberExpression) {}
+    std::string_view identifier;
     Expression* property;
-    void print(string_builder::StringBuilder* sb) override;
+    // "a[i]" rather than "a.i"
+    bool computed = false;
+    // the object's declaration, like IdentifierExpression::declaration
+    const DeclarationStatement* declaration = nullptr;
+    // whether indexing an array checks the index is in bounds, cleared
+    // by eliminate_bounds_checks when it can prove it always is
+    bool checked = true;
 };
 
 struct FunctionCallExpression : public Expression {
-    std::string value;
-    std::vector<Expression*> arguments;
-    void print(string_builder::StringBuilder* sb) override;
+    FunctionCallExpression() : Expression(NodeKind::FunctionCallExpression) {}
+    std::string_view value;
+    ArenaArray<Expression*> arguments;
+    // what value names, set by infer_types, null for builtins
+    const DeclarationStatement* declaration = nullptr;
+    // the function called when it's known before the program runs, set by
+    // resolve_closures
+    const FunctionExpression* function = nullptr;
 };
 
 struct BinaryExpression : public Expression {
+    BinaryExpression() : Expression(NodeKind::BinaryExpression) {}
     Operator op;
     Expression* left;
     Expression* right;
-    void print(string_builder::StringBuilder* sb) override;
-    void generate(string_builder::StringBuilder* sb) override;
 };
 
 struct UnaryExpression : public Expression {
+    UnaryExpression() : Expression(NodeKind::UnaryExpression) {}
     Operator op;
     Expression* argument;
-    void print(string_builder::StringBuilder* sb) override;
 };
 
 struct AssignmentExpression : public Expression {
+    AssignmentExpression() : Expression(NodeKind::AssignmentExpression) {}
     Expression* left;
     Expression* right;
-    void print(string_builder::StringBuilder* sb) override;
-    void generate(string_builder::StringBuilder* sb) override;
 };
 
 struct BlockStatement : public Statement {
-    std::vector<Statement*> statements;
-    void print(string_builder::StringBuilder* sb) override;
-    void generate(string_builder::StringBuilder* sb) override;
+    BlockStatement() : Statement(NodeKind::BlockStatement) {}
+    ArenaArray<Statement*> statements;
 };
 
 struct DeclarationStatement : public Statement {
-    DataType data_type;
-    std::string identifier;
+    DeclarationStatement() : Statement(NodeKind::DeclarationStatement) {}
+    DataType data_type = DataType::Undefined;
+    std::string_view identifier;
     Expression* value;
-    void print(string_builder::StringBuilder* sb) override;
-    void generate(string_builder::StringBuilder* sb) override;
+    // for Object variables, the shape of the first object they hold. a
+    // variable that's later assigned an object of another shape is dynamic,
+    // its fields are looked up by name when the program runs.
+    const Shape* shape = nullptr;
+    bool dynamic_shape = false;
+    // for Array variables, the type of the elements
+    DataType element_type = DataType::Undefined;
 };
 
 struct ReturnStatement : public Statement {
+    ReturnStatement() : Statement(NodeKind::ReturnStatement) {}
     Expression* value;
-    void print(string_builder::StringBuilder* sb) override;
 };
 
 struct IfStatement : public Statement {
+    IfStatement() : Statement(NodeKind::IfStatement) {}
     Expression* condition;
     Statement* if_block;
-    Statement* else_block;
-    void print(string_builder::StringBuilder* sb) override;
-    void generate(string_builder::StringBuilder* sb) override;
+    Statement* else_block = nullptr;
 };
 
 struct WhileStatement : public Statement {
+    WhileStatement() : Statement(NodeKind::WhileStatement) {}
     Expression* condition;
     Statement* body;
-    void print(string_builder::StringBuilder* sb) override;
 };
 
 struct ExpressionStatement : public Statement {
+    ExpressionStatement() : Statement(NodeKind::ExpressionStatement) {}
     Expression* value;
-    void print(string_builder::StringBuilder* sb) override;
-    void generate(string_builder::StringBuilder* sb) override;
 };
 
+class FlatAst;
+
+// Program owns the arena every node in the tree, and the strings and
+// arrays they point to, are allocated from, dropping the program frees
+// the whole tree at once.
 class Program {
 public:
+    Arena arena;
     std::vector<Statement*> statements;
+    // the object shapes in the program, indexed by id, set by infer_types
+    std::vector<const Shape*> shapes;
     std::string print();
+    // C for the program, after infer_types and resolve_closures. empty if
+    // the program uses something there's no C for yet, after printing why
     std::string generate();
+    // a compact, index linked copy of the tree, see flat_ast.h
+    FlatAst flatten() const;
 };
 
+// How deeply the program's nodes nest, measured without recursing. The
+// passes and printers recurse at most once per level, so this bounds the
+// stack they need. Left leaning binary chains count a level per operator,
+// most passes walk them in a loop but printing the tree recurses.
+size_t nesting_depth(const Program &program);
+
 }
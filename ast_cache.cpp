@@ -0,0 +1,188 @@
+#include "ast_cache.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mango {
+
+uint64_t content_hash(std::string_view text) {
+    // mixes 8 bytes at a time, the tail is zero padded and the length is
+    // part of the seed so padding doesn't collide
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ text.size();
+    auto mix = [&h](uint64_t word) {
+        h = (h ^ word) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    };
+
+    size_t i = 0;
+    for (; i + 8 <= text.size(); i += 8) {
+        uint64_t word;
+        memcpy(&word, text.data() + i, 8);
+        mix(word);
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, text.data() + i, text.size() - i);
+    mix(tail);
+
+    h = (h ^ (h >> 29)) * 0xbf58476d1ce4e5b9ull;
+    return h ^ (h >> 32);
+}
+
+// every array is a multiple of 4 bytes long, and they're ordered so each
+// one starts 4 byte aligned
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_hash;
+    uint64_t source_size;
+    uint32_t node_count;
+    uint32_t extra_count;
+    uint32_t offset_count;
+    uint32_t location_count;
+    uint32_t string_bytes;
+    uint32_t first_statement;
+    uint32_t statement_count;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(CacheHeader) == 56, "cache header layout changed");
+
+constexpr char cache_magic[4] = {'M', 'A', 'S', 'T'};
+
+// in size_t so counts from a damaged file can't wrap around
+size_t cache_file_size(const CacheHeader &h) {
+    return sizeof(CacheHeader) + size_t(h.node_count) * sizeof(FlatNode) +
+           size_t(h.location_count) * sizeof(FlatLocation) +
+           (size_t(h.extra_count) + size_t(h.offset_count)) * sizeof(uint32_t) + size_t(h.string_bytes);
+}
+
+std::string AstCache::path(uint64_t hash) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.mast", static_cast<unsigned long long>(hash));
+    return directory + "/" + name;
+}
+
+std::unique_ptr<FlatAst> AstCache::load(const SourceFile &src) const {
+    auto text = src.text();
+    auto hash = content_hash(text);
+
+    int fd = ::open(path(hash).c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(CacheHeader)) {
+        close(fd);
+        return nullptr;
+    }
+
+    size_t size = st.st_size;
+    auto p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return nullptr;
+    }
+
+    // the ast holds on to the mapping, so any early return unmaps it
+    auto mapping = std::shared_ptr<const void>(p, [size](const void* p) {
+        munmap(const_cast<void*>(p), size);
+    });
+
+    auto data = static_cast<const char*>(p);
+    auto &header = *reinterpret_cast<const CacheHeader*>(data);
+    if (memcmp(header.magic, cache_magic, 4) != 0 || header.version != ast_cache_version ||
+        header.source_hash != hash || header.source_size != text.size() || cache_file_size(header) != size ||
+        header.offset_count == 0) {
+        return nullptr;
+    }
+
+    auto ast = std::make_unique<FlatAst>();
+    auto next = data + sizeof(CacheHeader);
+    auto view = [&next](auto &array, uint32_t count) {
+        using T = std::remove_reference_t<decltype(array[0])>;
+        array = {reinterpret_cast<T*>(next), count};
+        next += count * sizeof(T);
+    };
+
+    view(ast->nodes, header.node_count);
+    view(ast->locations, header.location_count);
+    view(ast->extra, header.extra_count);
+    view(ast->string_offsets, header.offset_count);
+    ast->string_data = {next, header.string_bytes};
+    ast->first_statement = header.first_statement;
+    ast->statement_count = header.statement_count;
+    ast->set_backing(std::move(mapping));
+
+    // the file matched the source but may still be damaged, unflatten and
+    // print trust every index in it
+    if (!ast->valid()) {
+        return nullptr;
+    }
+
+    return ast;
+}
+
+bool AstCache::store(const SourceFile &src, const FlatAst &ast) const {
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "can't create cache directory " << directory << ": " << strerror(errno) << "\n";
+        return false;
+    }
+
+    auto text = src.text();
+    auto hash = content_hash(text);
+
+    CacheHeader header{};
+    memcpy(header.magic, cache_magic, 4);
+    header.version = ast_cache_version;
+    header.source_hash = hash;
+    header.source_size = text.size();
+    header.node_count = ast.nodes.size();
+    header.extra_count = ast.extra.size();
+    header.offset_count = ast.string_offsets.size();
+    header.location_count = ast.locations.size();
+    header.string_bytes = ast.string_data.size();
+    header.first_statement = ast.first_statement;
+    header.statement_count = ast.statement_count;
+
+    // written next to the final file and renamed over it, so readers only
+    // ever see complete files
+    auto final_path = path(hash);
+    auto temp_path = final_path + "." + std::to_string(getpid()) + ".tmp";
+
+    auto f = fopen(temp_path.c_str(), "wb");
+    if (f == nullptr) {
+        std::cerr << "can't write " << temp_path << ": " << strerror(errno) << "\n";
+        return false;
+    }
+
+    auto write = [f](const void* data, size_t size) {
+        return size == 0 || fwrite(data, 1, size, f) == size;
+    };
+
+    bool ok = write(&header, sizeof(header)) &&
+              write(ast.nodes.begin(), ast.nodes.size() * sizeof(FlatNode)) &&
+              write(ast.locations.begin(), ast.locations.size() * sizeof(FlatLocation)) &&
+              write(ast.extra.begin(), ast.extra.size() * sizeof(uint32_t)) &&
+              write(ast.string_offsets.begin(), ast.string_offsets.size() * sizeof(uint32_t)) &&
+              write(ast.string_data.data(), ast.string_data.size());
+    ok = fclose(f) == 0 && ok;
+
+    if (!ok || rename(temp_path.c_str(), final_path.c_str()) != 0) {
+        std::cerr << "can't write " << final_path << ": " << strerror(errno) << "\n";
+        unlink(temp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "flat_ast.h"
+#include "source_file.h"
+
+namespace mango {
+
+// bump when the cache file layout, FlatNode, NodeKind or what the
+// cached tree holds change
+constexpr uint32_t ast_cache_version = 4;
+
+// a fast non-cryptographic hash of a source's text, used as cache key
+uint64_t content_hash(std::string_view text);
+
+// AstCache keeps flattened ASTs in a directory, one file per source text
+// named by its content hash. A file is a fixed header followed by the
+// FlatAst arrays exactly as they're laid out in memory, so loading one
+// is a single mmap plus a few size checks, the views of the returned
+// FlatAst point straight into the mapping.
+class AstCache {
+    std::string directory;
+
+public:
+    explicit AstCache(std::string directory) : directory(std::move(directory)) {}
+
+    std::string path(uint64_t hash) const;
+
+    // returns nullptr when the source isn't cached or the cached file is
+    // from another version or damaged
+    std::unique_ptr<FlatAst> load(const SourceFile &src) const;
+    // writes ast as the cached AST of src, creating the directory if
+    // needed. prints the reason and returns false if it can't.
+    bool store(const SourceFile &src, const FlatAst &ast) const;
+};
+
+}
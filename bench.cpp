@@ -0,0 +1,1247 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <tuple>
+
+#include <unistd.h>
+
+#include "ast_cache.h"
+#include "bounds.h"
+#include "closures.h"
+#include "evaluate.h"
+#include "flat_ast.h"
+#include "fold.h"
+#include "lexer.h"
+#include "parser.h"
+#include "scan.h"
+#include "token_stream.h"
+#include "types.h"
+#include "vm.h"
+
+// Micro-benchmarks for the compiler. Run `mango_bench` to run all of
+// them or `mango_bench <name>` to run a single one.
+
+// count every heap allocation so benchmarks can report allocations per
+// unit of work
+std::atomic<size_t> allocation_count{0};
+
+void* operator new(size_t size) {
+    allocation_count++;
+    if (auto p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+std::string read_file(const std::string &path) {
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+// a generated program in the style our code generators emit
+std::string generate_source(int statements, bool strings = true) {
+    std::string src;
+    for (int i = 0; i < statements; i++) {
+        auto n = std::to_string(i);
+        src += "var value_" + n + " = " + n + " + 123 * (x - 7);\n";
+        src += "if (value_" + n + " > 50 && flag) {\n";
+        src += "    value_" + n + " = value_" + n + " + 34;\n";
+        if (strings) {
+            src += "    name = \"item " + n + "\";\n";
+        } else {
+            src += "    total = total + value_" + n + ";\n";
+        }
+        src += "}\n";
+    }
+    return src;
+}
+
+void bench_lexer() {
+    mango::SourceFile file("<bench>", generate_source(20000));
+    auto src = file.text();
+
+    // warm up
+    mango::Lexer{}.get_tokens(file);
+
+    size_t token_count = 0;
+    int iterations = 0;
+    auto start = Clock::now();
+    while (seconds_since(start) < 1.0) {
+        mango::Lexer lexer;
+        token_count += lexer.get_tokens(file).size();
+        iterations++;
+    }
+    auto elapsed = seconds_since(start);
+
+    std::cout << "lexer: " << src.size() / 1024 << " KiB source, "
+              << token_count / iterations << " tokens, "
+              << static_cast<long>(token_count / elapsed) << " tokens/sec, "
+              << (src.size() * iterations) / elapsed / (1024 * 1024) << " MiB/sec\n";
+
+    mango::Lexer lexer;
+    auto allocations_before = allocation_count.load();
+    auto tokens = lexer.get_tokens(file);
+    auto allocations = allocation_count.load() - allocations_before;
+
+    std::cout << "lexer: sizeof(Token) = " << sizeof(mango::Token) << " bytes, "
+              << allocations << " allocations for " << tokens.size() << " tokens\n";
+}
+
+void bench_parser() {
+    mango::SourceFile file("<bench>", generate_source(5000));
+    auto tokens = mango::Lexer{}.get_tokens(file);
+    auto token_count = tokens.size();
+
+    int iterations = 0;
+    auto start = Clock::now();
+    while (seconds_since(start) < 1.0) {
+        mango::TokenStream stream(file);
+        mango::Parser parser;
+        parser.parse(stream);
+        iterations++;
+    }
+    auto elapsed = seconds_since(start);
+
+    std::cout << "parser: " << token_count << " tokens, "
+              << static_cast<long>(token_count * iterations / elapsed) << " tokens/sec (lexing included), "
+              << "tokens buffered: " << sizeof(mango::TokenStream) << " bytes\n";
+
+    // walking the cursor over the tokens on its own shouldn't allocate
+    auto allocations_before = allocation_count.load();
+    for (auto *stream : {new mango::TokenStream(file), new mango::TokenStream(tokens)}) {
+        for (int i = 0; stream->at(i).type != mango::TokenType::EndOfFile; i++) {}
+        delete stream;
+    }
+    auto cursor_allocations = allocation_count.load() - allocations_before - 2;
+
+    allocations_before = allocation_count.load();
+    mango::Parser parser;
+    parser.parse(tokens);
+    auto parse_allocations = allocation_count.load() - allocations_before;
+
+    std::cout << "parser: " << static_cast<double>(cursor_allocations) / token_count
+              << " token cursor allocations per token, "
+              << static_cast<double>(parse_allocations) / token_count
+              << " allocations per token building the AST\n";
+}
+
+// source with long runs for the vector scanners to chew through
+std::string generate_wide_source(int statements) {
+    std::string src;
+    for (int i = 0; i < statements; i++) {
+        auto n = std::to_string(i);
+        src += "var a_rather_long_generated_identifier_name_" + n + " = 1234567890;\n";
+        src += "\n        \n    \t    ";
+        src += "description = \"a string literal that is long enough to\n span a line " + n + "\";\n";
+    }
+    return src;
+}
+
+bool same_tokens(const std::vector<mango::Token> &a, const std::vector<mango::Token> &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].type != b[i].type || a[i].offset != b[i].offset || a[i].length != b[i].length ||
+            a[i].line != b[i].line || a[i].column != b[i].column || a[i].number != b[i].number) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void bench_scan() {
+    auto initial = mango::scan_implementation();
+
+    for (auto wide : {false, true}) {
+        mango::SourceFile file("<bench>", wide ? generate_wide_source(20000) : generate_source(20000));
+        mango::use_scan_implementation(mango::ScanImplementation::Scalar);
+        auto expected = mango::Lexer{}.get_tokens(file);
+
+        for (auto impl : {mango::ScanImplementation::Scalar, mango::ScanImplementation::SSE2,
+                          mango::ScanImplementation::AVX2}) {
+            if (!mango::use_scan_implementation(impl)) {
+                std::cout << "scan: " << mango::scan_implementation_name(impl) << " not supported\n";
+                continue;
+            }
+
+            mango::Lexer lexer;
+            auto tokens = lexer.get_tokens(file);
+            auto matches = same_tokens(expected, tokens);
+
+            // pull tokens without storing them so only scanning is measured
+            int iterations = 0;
+            auto start = Clock::now();
+            while (seconds_since(start) < 0.5) {
+                lexer.reset(file);
+                while (lexer.next_token().type != mango::TokenType::EndOfFile) {}
+                iterations++;
+            }
+            auto elapsed = seconds_since(start);
+
+            std::cout << "scan: " << (wide ? "wide" : "typical") << " source, "
+                      << mango::scan_implementation_name(impl) << ": "
+                      << (file.text().size() * iterations) / elapsed / (1024 * 1024) << " MiB/sec, "
+                      << static_cast<long>(tokens.size() * iterations / elapsed) << " tokens/sec"
+                      << (matches ? "" : " (TOKENS DIFFER FROM SCALAR)") << "\n";
+        }
+    }
+
+    mango::use_scan_implementation(initial);
+}
+
+void bench_relex() {
+    mango::SourceFile file("<bench>", generate_source(20000));
+    mango::Lexer lexer;
+    auto tokens = lexer.get_tokens(file);
+
+    // alternately type a character somewhere and delete it again, every
+    // fourth one a lone quote, which leaves a string open to the end of
+    // the source until it's deleted
+    uint32_t seed = 12345;
+    int edits = 2000;
+    int quotes = 0;
+    double relex_seconds = 0;
+    double quote_seconds = 0;
+    double edit_seconds = 0;
+    double worst = 0;
+    size_t relexed_tokens = 0;
+    bool matches = true;
+
+    for (int i = 0; i < edits; i++) {
+        seed = seed * 1103515245 + 12345;
+        auto offset = static_cast<uint32_t>((seed >> 8) % file.text().size());
+        auto quote = i % 4 == 3;
+
+        mango::TextEdit insert{offset, 0, quote ? "\"" : "a"};
+        mango::TextEdit remove{offset, 1, ""};
+
+        for (auto &edit : {insert, remove}) {
+            auto start = Clock::now();
+            file.apply_edit(edit);
+            edit_seconds += seconds_since(start);
+
+            start = Clock::now();
+            auto result = lexer.relex(file, tokens, edit);
+            auto elapsed = seconds_since(start);
+            if (quote) {
+                quote_seconds += elapsed;
+                continue;
+            }
+            relex_seconds += elapsed;
+            worst = std::max(worst, elapsed);
+            relexed_tokens += result.inserted;
+        }
+        quotes += quote;
+
+        // spot check against lexing from scratch
+        if (i % 200 == 0 || i % 200 == 3) {
+            file.apply_edit(insert);
+            lexer.relex(file, tokens, insert);
+            matches = matches && same_tokens(tokens, mango::Lexer{}.get_tokens(file));
+            file.apply_edit(remove);
+            lexer.relex(file, tokens, remove);
+            matches = matches && same_tokens(tokens, mango::Lexer{}.get_tokens(file));
+        }
+    }
+
+    auto start = Clock::now();
+    mango::Lexer{}.get_tokens(file);
+    auto full = seconds_since(start);
+
+    auto chars = edits - quotes;
+    std::cout << "relex: " << file.text().size() / 1024 << " KiB, " << tokens.size() << " tokens, "
+              << "full lex " << full * 1000 << " ms, "
+              << "single char relex avg " << relex_seconds / (2 * chars) * 1000 << " ms, "
+              << "worst " << worst * 1000 << " ms, "
+              << relexed_tokens / (2.0 * chars) << " tokens relexed per edit, "
+              << "lone quote relex avg " << quote_seconds / (2 * quotes) * 1000 << " ms, "
+              << "buffer edit avg " << edit_seconds / (2 * edits) * 1000 << " ms"
+              << (matches ? "" : " (TOKENS DIFFER FROM FULL LEX)") << "\n";
+}
+
+void bench_parallel_lexer() {
+    // strings spanning lines make sure chunks never split a string
+    auto src = generate_source(100000) + generate_wide_source(50000);
+    mango::SourceFile file("<bench>", src);
+    auto expected = mango::Lexer{}.get_tokens(file);
+
+    std::cout << "parallel lexer: " << src.size() / (1024 * 1024) << " MiB, " << expected.size() << " tokens, "
+              << std::thread::hardware_concurrency() << " hardware threads\n";
+
+    double serial = 0;
+    for (int threads : {1, 2, 4, 8, 16}) {
+        mango::Lexer lexer;
+        auto tokens = lexer.get_tokens_parallel(file, threads);
+        auto matches = same_tokens(expected, tokens);
+
+        int iterations = 0;
+        auto start = Clock::now();
+        while (seconds_since(start) < 1.0) {
+            lexer.get_tokens_parallel(file, threads);
+            iterations++;
+        }
+        auto elapsed = seconds_since(start) / iterations;
+        if (threads == 1) {
+            serial = elapsed;
+        }
+
+        std::cout << "parallel lexer: " << threads << " threads, " << elapsed * 1000 << " ms, "
+                  << serial / elapsed << "x" << (matches ? "" : " (TOKENS DIFFER FROM SERIAL)") << "\n";
+    }
+}
+
+void bench_ast() {
+    // only integers, the c generator can't do strings yet
+    mango::SourceFile file("<bench>", generate_source(5000, false));
+    mango::Parser parser;
+    auto program = parser.parse(mango::Lexer{}.get_tokens(file));
+
+    std::cout << "ast: arena " << program.arena.bytes_used() / 1024 << " KiB used, "
+              << program.arena.bytes_reserved() / 1024 << " KiB reserved\n";
+
+    for (auto pass : {"print", "generate"}) {
+        int iterations = 0;
+        size_t output_size = 0;
+        auto start = Clock::now();
+        while (seconds_since(start) < 1.0) {
+            output_size += pass == std::string("print") ? program.print().size() : program.generate().size();
+            iterations++;
+        }
+        auto elapsed = seconds_since(start) / iterations;
+
+        std::cout << "ast: " << pass << " " << elapsed * 1000 << " ms, "
+                  << output_size / iterations / 1024 << " KiB output\n";
+    }
+}
+
+// what the traversal benchmarks compute, enough to touch every node
+struct TreeTotals {
+    size_t nodes = 0;
+    size_t identifiers = 0;
+    long long integers = 0;
+};
+
+void walk(mango::Statement* s, TreeTotals &totals);
+
+void walk(mango::Expression* e, TreeTotals &totals) {
+    using mango::NodeKind;
+    totals.nodes++;
+
+    switch (e->kind) {
+        case NodeKind::IdentifierExpression:
+            totals.identifiers++;
+            break;
+        case NodeKind::IntegerLiteralExpression:
+            totals.integers += static_cast<mango::IntegerLiteralExpression*>(e)->value;
+            break;
+        case NodeKind::FunctionExpression:
+            walk(static_cast<mango::FunctionExpression*>(e)->body, totals);
+            break;
+        case NodeKind::ObjectExpression:
+            for (auto &p : static_cast<mango::ObjectExpression*>(e)->properties) {
+                walk(p.value, totals);
+            }
+            break;
+        case NodeKind::ArrayExpression:
+            for (auto element : static_cast<mango::ArrayExpression*>(e)->elements) {
+                walk(element, totals);
+            }
+            break;
+        case NodeKind::MemberExpression:
+            walk(static_cast<mango::MemberExpression*>(e)->property, totals);
+            break;
+        case NodeKind::FunctionCallExpression:
+            for (auto arg : static_cast<mango::FunctionCallExpression*>(e)->arguments) {
+                walk(arg, totals);
+            }
+            break;
+        case NodeKind::BinaryExpression:
+            walk(static_cast<mango::BinaryExpression*>(e)->left, totals);
+            walk(static_cast<mango::BinaryExpression*>(e)->right, totals);
+            break;
+        case NodeKind::UnaryExpression:
+            walk(static_cast<mango::UnaryExpression*>(e)->argument, totals);
+            break;
+        case NodeKind::AssignmentExpression:
+            walk(static_cast<mango::AssignmentExpression*>(e)->left, totals);
+            walk(static_cast<mango::AssignmentExpression*>(e)->right, totals);
+            break;
+        default:
+            break;
+    }
+}
+
+void walk(mango::Statement* s, TreeTotals &totals) {
+    using mango::NodeKind;
+    totals.nodes++;
+
+    switch (s->kind) {
+        case NodeKind::BlockStatement:
+            for (auto st : static_cast<mango::BlockStatement*>(s)->statements) {
+                walk(st, totals);
+            }
+            break;
+        case NodeKind::DeclarationStatement:
+            walk(static_cast<mango::DeclarationStatement*>(s)->value, totals);
+            break;
+        case NodeKind::ReturnStatement:
+            walk(static_cast<mango::ReturnStatement*>(s)->value, totals);
+            break;
+        case NodeKind::IfStatement: {
+            auto is = static_cast<mango::IfStatement*>(s);
+            walk(is->condition, totals);
+            walk(is->if_block, totals);
+            if (is->else_block) {
+                walk(is->else_block, totals);
+            }
+            break;
+        }
+        case NodeKind::WhileStatement:
+            walk(static_cast<mango::WhileStatement*>(s)->condition, totals);
+            walk(static_cast<mango::WhileStatement*>(s)->body, totals);
+            break;
+        case NodeKind::ExpressionStatement:
+            walk(static_cast<mango::ExpressionStatement*>(s)->value, totals);
+            break;
+        default:
+            break;
+    }
+}
+
+TreeTotals walk(const mango::Program &program) {
+    TreeTotals totals;
+    for (auto s : program.statements) {
+        walk(s, totals);
+    }
+    return totals;
+}
+
+TreeTotals walk(const mango::FlatAst &ast) {
+    TreeTotals totals;
+    totals.nodes = ast.nodes.size();
+    for (auto &n : ast.nodes) {
+        if (n.kind == mango::NodeKind::IdentifierExpression) {
+            totals.identifiers++;
+        } else if (n.kind == mango::NodeKind::IntegerLiteralExpression) {
+            totals.integers += static_cast<int>(n.a);
+        }
+    }
+    return totals;
+}
+
+void bench_flat_ast() {
+    mango::SourceFile file("<bench>", generate_source(5000));
+    mango::Parser parser;
+    auto program = parser.parse(mango::Lexer{}.get_tokens(file));
+
+    auto start = Clock::now();
+    auto flat = program.flatten();
+    auto flatten_time = seconds_since(start);
+
+    if (flat.print() != program.print()) {
+        std::cerr << "flat_ast: printed flat ast doesn't match the tree\n";
+        exit(1);
+    }
+
+    auto tree_totals = walk(program);
+    auto flat_totals = walk(flat);
+    if (tree_totals.nodes != flat_totals.nodes || tree_totals.identifiers != flat_totals.identifiers ||
+        tree_totals.integers != flat_totals.integers) {
+        std::cerr << "flat_ast: traversals disagree\n";
+        exit(1);
+    }
+
+    auto nodes = static_cast<double>(flat.nodes.size());
+    std::cout << "flat_ast: " << flat.nodes.size() << " nodes, flattened in " << flatten_time * 1000 << " ms\n";
+    std::cout << "flat_ast: tree " << program.arena.bytes_used() / nodes << " bytes/node, flat "
+              << flat.bytes() / nodes << " bytes/node\n";
+
+    for (auto layout : {"tree", "flat"}) {
+        bool tree = layout == std::string("tree");
+        int iterations = 0;
+        size_t checksum = 0;
+        start = Clock::now();
+        while (seconds_since(start) < 1.0) {
+            auto totals = tree ? walk(program) : walk(flat);
+            checksum += totals.identifiers;
+            iterations++;
+        }
+        auto elapsed = seconds_since(start) / iterations;
+
+        std::cout << "flat_ast: " << layout << " traversal " << elapsed * 1e6 << " us, "
+                  << nodes / elapsed / 1e6 << " M nodes/sec"
+                  << (checksum == 0 ? " (no identifiers?)" : "") << "\n";
+    }
+}
+
+// how many levels of if/while/block statements are nested in s, walked
+// without recursion since the trees this is used on are very deep
+size_t statement_depth(mango::Statement* s) {
+    using mango::NodeKind;
+    std::vector<std::pair<mango::Statement*, size_t>> stack{{s, 1}};
+    size_t deepest = 0;
+
+    while (!stack.empty()) {
+        auto [st, depth] = stack.back();
+        stack.pop_back();
+        deepest = std::max(deepest, depth);
+
+        switch (st->kind) {
+            case NodeKind::BlockStatement:
+                for (auto child : static_cast<mango::BlockStatement*>(st)->statements) {
+                    stack.push_back({child, depth + 1});
+                }
+                break;
+            case NodeKind::IfStatement: {
+                auto is = static_cast<mango::IfStatement*>(st);
+                stack.push_back({is->if_block, depth + 1});
+                if (is->else_block) {
+                    stack.push_back({is->else_block, depth + 1});
+                }
+                break;
+            }
+            case NodeKind::WhileStatement:
+                stack.push_back({static_cast<mango::WhileStatement*>(st)->body, depth + 1});
+                break;
+            default:
+                break;
+        }
+    }
+
+    return deepest;
+}
+
+void bench_deep_nesting() {
+    const int levels = 1000000;
+
+    std::string blocks;
+    for (int i = 0; i < levels; i++) {
+        blocks += i % 2 == 0 ? "if (x) {\n" : "while (x) {\n";
+    }
+    blocks += "x = 0;\n";
+    for (int i = 0; i < levels; i++) {
+        blocks += "}\n";
+    }
+
+    std::string else_chain;
+    for (int i = 0; i < levels; i++) {
+        else_chain += "if (x == " + std::to_string(i) + ") x = 1; else ";
+    }
+    else_chain += "x = 0;\n";
+
+    for (auto [name, text, expected] : {std::tuple{"blocks", &blocks, size_t(levels) * 2 + 1},
+                                        std::tuple{"else_chain", &else_chain, size_t(levels) + 1}}) {
+        mango::SourceFile file(name, *text);
+        mango::TokenStream tokens(file);
+        mango::Parser parser;
+
+        auto start = Clock::now();
+        auto program = parser.parse(tokens);
+        auto elapsed = seconds_since(start);
+
+        auto depth = program.statements.size() == 1 ? statement_depth(program.statements[0]) : 0;
+        if (depth != expected) {
+            std::cerr << "deep_nesting: " << name << " parsed " << depth << " levels deep, expected " << expected
+                      << "\n";
+            exit(1);
+        }
+
+        std::cout << "deep_nesting: " << name << " " << depth << " levels in " << elapsed * 1000 << " ms, arena "
+                  << program.arena.bytes_used() / (1024 * 1024) << " MiB\n";
+    }
+}
+
+// the whole mango command on deeply nested input, every pass after the
+// parser recurses on it, and past the limit it has to fail cleanly
+void bench_deep_cli() {
+    char exe[4096];
+    auto length = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (length <= 0) {
+        std::cerr << "deep_cli: can't find the mango executable\n";
+        exit(1);
+    }
+    std::string mango(exe, length);
+    mango = mango.substr(0, mango.rfind('/') + 1) + "mango";
+
+    auto base = "/tmp/mango_bench_deep_" + std::to_string(getpid());
+    for (int levels : {30000, 1000000, 1100000}) {
+        {
+            std::ofstream source(base + ".mango");
+            source << "var x = 0;\n";
+            for (int i = 0; i < levels; i++) {
+                source << "if (x < 1) {\n";
+            }
+            source << "print(1);\n";
+            for (int i = 0; i < levels; i++) {
+                source << "}\n";
+            }
+        }
+        // nesting_depth counts the if and its block, just over a million
+        // levels is past the limit
+        bool too_deep = levels > 1000000;
+        for (auto command : {"run", "run --eval", "--emit=c"}) {
+            auto start = Clock::now();
+            auto run = mango + " " + command + " " + base + ".mango > " + base + ".out 2> " + base + ".err";
+            auto status = system(run.c_str());
+            auto elapsed = seconds_since(start);
+
+            auto out = read_file(base + ".out");
+            bool ok = too_deep ? status != 0 && read_file(base + ".err").find("levels deep") != std::string::npos
+                               : status == 0 && (command[0] == '-' ? !out.empty() : out == "1\n");
+            if (!ok) {
+                std::cerr << "deep_cli: mango " << command << " on " << levels << " levels exited with " << status
+                          << "\n";
+                exit(1);
+            }
+            std::cout << "deep_cli: " << command << " " << levels << " levels in " << elapsed * 1000 << " ms"
+                      << (too_deep ? ", rejected" : "") << "\n";
+        }
+    }
+
+    for (auto suffix : {".mango", ".out", ".err"}) {
+        std::remove((base + suffix).c_str());
+    }
+}
+
+void bench_ast_cache() {
+    char directory[] = "/tmp/mango_bench_XXXXXX";
+    if (mkdtemp(directory) == nullptr) {
+        std::cerr << "ast_cache: can't create a temporary directory\n";
+        exit(1);
+    }
+
+    mango::SourceFile file("<bench>", generate_source(5000));
+    mango::AstCache cache(directory);
+
+    if (cache.load(file) != nullptr) {
+        std::cerr << "ast_cache: loaded from an empty cache\n";
+        exit(1);
+    }
+
+    mango::Parser parser;
+    auto program = parser.parse(mango::Lexer{}.get_tokens(file));
+    cache.store(file, program.flatten());
+
+    // round trip, both the loaded ast and the tree rebuilt from it have
+    // to print the same as the parsed tree and keep statement locations
+    auto loaded = cache.load(file);
+    if (loaded == nullptr) {
+        std::cerr << "ast_cache: stored ast didn't load\n";
+        exit(1);
+    }
+
+    auto expected = program.print();
+    auto rebuilt = loaded->unflatten();
+    if (loaded->print() != expected || rebuilt.print() != expected) {
+        std::cerr << "ast_cache: loaded ast doesn't print the same as the parsed one\n";
+        exit(1);
+    }
+
+    for (size_t i = 0; i < program.statements.size(); i++) {
+        auto s = program.statements[i];
+        auto l = loaded->location(loaded->extra[loaded->first_statement + i]);
+        auto r = rebuilt.statements[i];
+        if (l == nullptr || l->offset != s->offset || l->length != s->length || l->line != s->line ||
+            r->offset != s->offset || r->length != s->length || r->line != s->line) {
+            std::cerr << "ast_cache: statement " << i << " lost its location\n";
+            exit(1);
+        }
+    }
+
+    std::cout << "ast_cache: " << loaded->nodes.size() << " nodes, " << loaded->bytes() / 1024
+              << " KiB cached for " << file.text().size() / 1024 << " KiB of source\n";
+
+    for (auto pass : {"cold parse", "warm load", "warm load + unflatten"}) {
+        int iterations = 0;
+        size_t nodes = 0;
+        auto start = Clock::now();
+        while (seconds_since(start) < 1.0) {
+            if (pass == std::string("cold parse")) {
+                mango::TokenStream tokens(file);
+                nodes += parser.parse(tokens).statements.size();
+            } else if (pass == std::string("warm load")) {
+                nodes += cache.load(file)->statement_count;
+            } else {
+                nodes += cache.load(file)->unflatten().statements.size();
+            }
+            iterations++;
+        }
+        auto elapsed = seconds_since(start) / iterations;
+
+        std::cout << "ast_cache: " << pass << " " << elapsed * 1000 << " ms"
+                  << (nodes == 0 ? " (empty?)" : "") << "\n";
+    }
+
+    // a damaged file that still matches the source is rejected, here the
+    // last node's first child points past itself. nodes follow the 56 byte
+    // header
+    auto cached_path = cache.path(mango::content_hash(file.text()));
+    {
+        std::fstream damaged(cached_path, std::ios::in | std::ios::out | std::ios::binary);
+        uint32_t node = program.flatten().nodes.size();
+        damaged.seekp(56 + (node - 1) * sizeof(mango::FlatNode) + offsetof(mango::FlatNode, a));
+        damaged.write(reinterpret_cast<const char*>(&node), sizeof(node));
+    }
+    if (cache.load(file) != nullptr) {
+        std::cerr << "ast_cache: loaded a damaged file\n";
+        exit(1);
+    }
+
+    unlink(cached_path.c_str());
+    rmdir(directory);
+}
+
+bool same_locations(const mango::FlatAst &a, const mango::FlatAst &b) {
+    if (a.locations.size() != b.locations.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.locations.size(); i++) {
+        auto &x = a.locations[i];
+        auto &y = b.locations[i];
+        if (x.node != y.node || x.line != y.line || x.offset != y.offset || x.length != y.length) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void bench_reparse() {
+    const int blocks = 5000;
+    mango::SourceFile file("<bench>", generate_source(blocks));
+    mango::Parser parser;
+    auto program = parser.parse(mango::Lexer{}.get_tokens(file));
+
+    // one line edits that keep the source valid: change a number inside
+    // an if block, and add a statement between two top level statements
+    uint32_t seed = 12345;
+    int edits = 1000;
+    double reparse_seconds = 0;
+    double worst = 0;
+    size_t reparsed = 0;
+    bool matches = true;
+
+    for (int i = 0; i < edits; i++) {
+        seed = seed * 1103515245 + 12345;
+        auto n = std::to_string((seed >> 8) % blocks);
+        auto text = file.text();
+
+        auto number = static_cast<uint32_t>(text.find("value_" + n + " + 34;") + n.size() + 11);
+        auto line = static_cast<uint32_t>(text.find("if (value_" + n + " "));
+
+        mango::TextEdit edits[] = {
+                {number, 0, "5"},
+                {number, 1, ""},
+                {line, 0, "total = total + 1;\n"},
+                {line, 19, ""},
+        };
+
+        for (auto &edit : edits) {
+            file.apply_edit(edit);
+
+            auto start = Clock::now();
+            auto result = parser.reparse(program, file, edit);
+            auto elapsed = seconds_since(start);
+            reparse_seconds += elapsed;
+            worst = std::max(worst, elapsed);
+            reparsed += result.inserted;
+
+            // spot check against parsing from scratch
+            if (i % 100 == 0) {
+                auto full = parser.parse(mango::Lexer{}.get_tokens(file));
+                matches = matches && program.print() == full.print() &&
+                          same_locations(program.flatten(), full.flatten());
+            }
+        }
+
+        // open a string at the start of a top level statement and delete
+        // the quote again, in between the string runs to the end of the
+        // source so only check the program comes back the same
+        if (i % 100 == 0) {
+            mango::TextEdit quote[] = {
+                    {line, 0, "\""},
+                    {line, 1, ""},
+            };
+            auto errors = std::cerr.rdbuf(nullptr);
+            for (auto &edit : quote) {
+                file.apply_edit(edit);
+                parser.reparse(program, file, edit);
+            }
+            std::cerr.rdbuf(errors);
+
+            auto full = parser.parse(mango::Lexer{}.get_tokens(file));
+            matches = matches && program.print() == full.print() && same_locations(program.flatten(), full.flatten());
+        }
+    }
+
+    auto start = Clock::now();
+    mango::TokenStream tokens(file);
+    parser.parse(tokens);
+    auto full = seconds_since(start);
+
+    std::cout << "reparse: " << program.statements.size() << " top level statements, "
+              << "full parse " << full * 1000 << " ms, "
+              << "one line edit reparse avg " << reparse_seconds / (4 * edits) * 1000 << " ms, "
+              << "worst " << worst * 1000 << " ms, "
+              << reparsed / (4.0 * edits) << " statements parsed per edit, "
+              << "arena " << program.arena.bytes_used() / 1024 << " KiB"
+              << (matches ? "" : " (AST DIFFERS FROM FULL PARSE)") << "\n";
+}
+
+void bench_fold() {
+    mango::SourceFile file("<bench>", generate_source(5000, false));
+    mango::Parser parser;
+
+    // folding rewrites the tree, so every run needs a fresh one
+    int iterations = 0;
+    double fold_seconds = 0;
+    mango::FoldStats stats{};
+    auto start = Clock::now();
+    while (seconds_since(start) < 1.0) {
+        auto program = parser.parse(mango::Lexer{}.get_tokens(file));
+        auto fold_start = Clock::now();
+        stats = mango::fold_constants(program);
+        fold_seconds += seconds_since(fold_start);
+        iterations++;
+    }
+
+    std::cout << "fold: " << stats.nodes_before << " nodes, " << stats.eliminated() << " eliminated, "
+              << fold_seconds / iterations * 1000 << " ms including counting nodes twice\n";
+}
+
+void bench_types() {
+    mango::SourceFile file("<bench>", generate_source(5000));
+    mango::Parser parser;
+    auto program = parser.parse(mango::Lexer{}.get_tokens(file));
+
+    // inference only ever sets the same types again, so rerunning it on
+    // one tree is fine
+    int iterations = 0;
+    auto start = Clock::now();
+    while (seconds_since(start) < 1.0) {
+        mango::infer_types(program);
+        iterations++;
+    }
+    auto elapsed = seconds_since(start) / iterations;
+
+    size_t integers = 0;
+    for (auto s : program.statements) {
+        if (s->kind == mango::NodeKind::DeclarationStatement &&
+            static_cast<mango::DeclarationStatement*>(s)->data_type == DataType::Integer) {
+            integers++;
+        }
+    }
+
+    std::cout << "types: " << elapsed * 1000 << " ms, " << integers << " integer declarations\n";
+}
+
+void bench_objects() {
+    // points with one shape, accessed and updated, and one variable that
+    // holds two shapes so its accesses need the dynamic fallback
+    std::string source = "var any = {x: 0};\nany = {y: 1, x: 2};\n";
+    int points = 5000;
+    for (int i = 0; i < points; i++) {
+        auto name = "p" + std::to_string(i);
+        source += "var " + name + " = {x: " + std::to_string(i) + ", y: 1};\n";
+        source += name + ".y = " + name + ".x + any.x;\n";
+    }
+
+    mango::SourceFile file("<bench>", std::move(source));
+    mango::Parser parser;
+    auto program = parser.parse(mango::Lexer{}.get_tokens(file));
+
+    int iterations = 0;
+    size_t bytes = 0;
+    auto start = Clock::now();
+    while (seconds_since(start) < 1.0) {
+        mango::infer_types(program);
+        bytes = program.generate().size();
+        iterations++;
+    }
+    auto elapsed = seconds_since(start) / iterations;
+
+    auto c = program.generate();
+    size_t dynamic = 0;
+    for (size_t at = c.find("mango_field(("); at != std::string::npos; at = c.find("mango_field((", at + 1)) {
+        dynamic++;
+    }
+
+    std::cout << "objects: " << elapsed * 1000 << " ms to infer and generate " << bytes << " bytes of C, "
+              << program.shapes.size() << " shapes, " << dynamic << " of " << points * 3 << " accesses dynamic\n";
+}
+
+void bench_bounds() {
+    // loops over arrays where every other access is provably in bounds
+    std::string source;
+    int loops = 2000;
+    for (int i = 0; i < loops; i++) {
+        auto a = "a" + std::to_string(i);
+        auto n = "i" + std::to_string(i);
+        source += "var " + a + " = [1, 2, 3, 4];\n";
+        source += "var " + n + " = 0;\n";
+        source += "while (" + n + " < " + a + ".length) {\n";
+        source += "    " + a + "[" + n + "] = " + a + "[" + n + "] + 1;\n";
+        source += "    " + n + " = " + n + " + 1;\n";
+        source += "    " + a + "[" + n + " - 1] = 0;\n";
+        source += "}\n";
+    }
+
+    mango::SourceFile file("<bench>", std::move(source));
+    mango::Parser parser;
+    auto program = parser.parse(mango::Lexer{}.get_tokens(file));
+    mango::infer_types(program);
+
+    // elimination only ever clears the same checks again
+    int iterations = 0;
+    mango::BoundsStats stats{};
+    auto start = Clock::now();
+    while (seconds_since(start) < 1.0) {
+        stats = mango::eliminate_bounds_checks(program);
+        iterations++;
+    }
+    auto elapsed = seconds_since(start) / iterations;
+
+    size_t unchecked = 0;
+    auto c = program.generate();
+    for (size_t at = c.find("->items["); at != std::string::npos; at = c.find("->items[", at + 1)) {
+        unchecked += c.compare(at + 8, 11, "mango_check") != 0;
+    }
+
+    std::cout << "bounds: " << elapsed * 1000 << " ms, " << stats.accesses << " accesses, " << unchecked
+              << " generated without a check\n";
+}
+
+void bench_strings() {
+    // many uses of a few literals, each should be emitted once
+    std::string source = "var s = \"\";\n";
+    int statements = 5000;
+    for (int i = 0; i < statements; i++) {
+        source += "s = s + \"item\" + " + std::to_string(i) + " + \"," + std::to_string(i % 10) + "\";\n";
+    }
+
+    mango::SourceFile file("<bench>", std::move(source));
+    mango::Parser parser;
+    auto program = parser.parse(mango::Lexer{}.get_tokens(file));
+    mango::infer_types(program);
+
+    int iterations = 0;
+    std::string c;
+    auto start = Clock::now();
+    while (seconds_since(start) < 1.0) {
+        c = program.generate();
+        iterations++;
+    }
+    auto elapsed = seconds_since(start) / iterations;
+
+    size_t literals = 0;
+    for (size_t at = c.find("static const mango_string"); at != std::string::npos;
+         at = c.find("static const mango_string", at + 1)) {
+        literals++;
+    }
+
+    std::cout << "strings: " << elapsed * 1000 << " ms to generate " << statements * 2 << " literal uses as "
+              << literals << " literals\n";
+}
+
+void bench_functions() {
+    // plain functions calling each other, and closures over a counter
+    std::string source = "var count = 0;\n";
+    int functions = 2000;
+    for (int i = 0; i < functions; i++) {
+        auto n = std::to_string(i);
+        if (i % 2 == 0) {
+            source += "var f" + n + " = func(a, b) {\n    return a * b + " + n + ";\n};\n";
+        } else {
+            source += "var f" + n + " = func(a, b) {\n    count = count + f" + std::to_string(i - 1) +
+                      "(a, b);\n    return count;\n};\n";
+        }
+        source += "print(f" + n + "(1, 2));\n";
+    }
+
+    mango::SourceFile file("<bench>", std::move(source));
+    mango::Parser parser;
+    auto program = parser.parse(mango::Lexer{}.get_tokens(file));
+    mango::infer_types(program);
+
+    int iterations = 0;
+    double resolve_seconds = 0;
+    auto start = Clock::now();
+    while (seconds_since(start) < 1.0) {
+        auto resolve_start = Clock::now();
+        mango::resolve_closures(program);
+        resolve_seconds += seconds_since(resolve_start);
+        program.generate();
+        iterations++;
+    }
+    auto elapsed = seconds_since(start) / iterations;
+
+    auto c = program.generate();
+    size_t environments = 0;
+    for (size_t at = c.find("\nstruct mango_env_"); at != std::string::npos; at = c.find("\nstruct mango_env_", at + 1)) {
+        environments++;
+    }
+
+    std::cout << "functions: resolve " << resolve_seconds / iterations * 1000 << " ms, resolve and generate "
+              << elapsed * 1000 << " ms, " << functions << " functions, " << environments
+              << " need an environment\n";
+}
+
+// parses source and runs the passes every backend runs after
+mango::Program prepare(const std::string &source) {
+    mango::SourceFile file("<bench>", source);
+    mango::Parser parser;
+    auto program = parser.parse(mango::Lexer{}.get_tokens(file));
+    mango::infer_types(program);
+    mango::fold_constants(program);
+    mango::resolve_closures(program);
+    mango::eliminate_bounds_checks(program);
+    return program;
+}
+
+// Loop heavy programs the backend benchmarks run, each bench sizes them
+// for how fast what it compares is, a size of 0 leaves a program out.
+// The size goes where the program has a #.
+struct LoopProgram {
+    const char* name;
+    const char* source;
+    int vm_size;
+    int evaluate_size;
+    int jit_size;
+};
+
+const LoopProgram loop_programs[] = {
+        {"arithmetic",
+         "var sum = 0;\nvar i = 0;\nwhile (i < #) {\n    sum = sum + i * 3 - i / 7;\n    i = i + 1;\n}\nprint(sum);\n",
+         20000000, 5000000, 20000000},
+        {"nested loops",
+         "var count = 0;\nvar i = 0;\nwhile (i < #) {\n    var j = 0;\n    while (j < #) {\n"
+         "        if (i * j - i < j * 2) {\n            count = count + 1;\n        }\n        j = j + 1;\n"
+         "    }\n    i = i + 1;\n}\nprint(count);\n",
+         0, 0, 5000},
+        {"untyped arithmetic",
+         "var ident = func(x) {\n    return x;\n};\nvar id = func(x) {\n    var g = ident;\n    return g(x);\n};\n"
+         "var n = id(0);\nvar i = 0;\nwhile (i < #) {\n    n = n + i * 2 - n / 3;\n    i = i + 1;\n}\nprint(n);\n",
+         0, 0, 10000000},
+        {"calls",
+         "var fib = func(n) {\n    if (n < 2) {\n        return n;\n    }\n    return fib(n - 1) + fib(n - 2);\n};\n"
+         "print(fib(#));\n",
+         27, 25, 30},
+        {"arrays",
+         "var a = [1, 2, 3, 4, 5, 6, 7, 8];\nvar total = 0;\nvar round = 0;\nwhile (round < #) {\n    var i = 0;\n"
+         "    while (i < a.length) {\n        total = total + a[i] * round;\n        i = i + 1;\n    }\n"
+         "    round = round + 1;\n}\nprint(total);\n",
+         1000000, 0, 1000000},
+};
+
+std::string loop_source(const LoopProgram &p, int size) {
+    std::string source;
+    for (auto c = p.source; *c; c++) {
+        source += *c == '#' ? std::to_string(size) : std::string(1, *c);
+    }
+    return source;
+}
+
+void bench_vm() {
+    // run in the VM and compiled through C
+    auto base = "/tmp/mango_bench_vm_" + std::to_string(getpid());
+    for (auto &p : loop_programs) {
+        if (p.vm_size == 0) {
+            continue;
+        }
+        auto name = p.name;
+        auto program = prepare(loop_source(p, p.vm_size));
+
+        auto start = Clock::now();
+        auto bytecode = mango::compile_bytecode(program);
+        auto vm_out = fopen((base + ".vm").c_str(), "w");
+        mango::VM(bytecode, vm_out).run();
+        fclose(vm_out);
+        auto vm_seconds = seconds_since(start);
+
+        start = Clock::now();
+        std::ofstream(base + ".c") << program.generate();
+        auto generate_seconds = seconds_since(start);
+        start = Clock::now();
+        auto compile = "cc -O2 -w -o " + base + " " + base + ".c";
+        if (system(compile.c_str()) != 0) {
+            std::cout << "vm: " << name << " " << vm_seconds * 1000 << " ms, no C compiler to compare with\n";
+            continue;
+        }
+        auto cc_seconds = seconds_since(start);
+        start = Clock::now();
+        auto run = base + " > " + base + ".out";
+        system(run.c_str());
+        auto run_seconds = seconds_since(start);
+
+        auto same = read_file(base + ".vm") == read_file(base + ".out");
+        std::cout << "vm: " << name << " " << vm_seconds * 1000 << " ms in the VM, C backend "
+                  << (generate_seconds + cc_seconds + run_seconds) * 1000 << " ms (generate "
+                  << generate_seconds * 1000 << " ms, cc " << cc_seconds * 1000 << " ms, run " << run_seconds * 1000
+                  << " ms), " << (same ? "same output" : "OUTPUT DIFFERS") << "\n";
+    }
+
+    for (auto suffix : {".vm", ".c", ".out", ""}) {
+        std::remove((base + suffix).c_str());
+    }
+}
+
+void bench_evaluate() {
+    // a short script from source to its output, where the time to get going
+    // is most of it, and then loops where the running is
+    auto script = std::string("var greet = func(name) {\n    return \"hello \" + name;\n};\n"
+                              "var p = {x: 1, y: 2};\nvar a = [1, 2, 3];\nprint(greet(\"world\"), p.x + p.y, a.length);\n");
+
+    auto null = fopen("/dev/null", "w");
+    int runs = 2000;
+    auto start = Clock::now();
+    for (int i = 0; i < runs; i++) {
+        auto program = prepare(script);
+        mango::evaluate(program, null);
+    }
+    auto evaluate_seconds = seconds_since(start);
+    start = Clock::now();
+    for (int i = 0; i < runs; i++) {
+        auto program = prepare(script);
+        auto bytecode = mango::compile_bytecode(program);
+        mango::VM(bytecode, null).run();
+    }
+    auto vm_seconds = seconds_since(start);
+    start = Clock::now();
+    for (int i = 0; i < runs; i++) {
+        auto program = prepare(script);
+        auto c = program.generate();
+        fwrite(c.data(), 1, std::min<size_t>(c.size(), 1), null);
+    }
+    auto generate_seconds = seconds_since(start);
+    std::cout << "evaluate: startup " << evaluate_seconds * 1e6 / runs << " us per script evaluated, "
+              << vm_seconds * 1e6 / runs << " us through the VM, " << generate_seconds * 1e6 / runs
+              << " us just to generate C\n";
+    fclose(null);
+
+    auto base = "/tmp/mango_bench_evaluate_" + std::to_string(getpid());
+    for (auto &p : loop_programs) {
+        if (p.evaluate_size == 0) {
+            continue;
+        }
+        auto name = p.name;
+        auto program = prepare(loop_source(p, p.evaluate_size));
+        start = Clock::now();
+        auto out = fopen((base + ".evaluate").c_str(), "w");
+        mango::evaluate(program, out);
+        fclose(out);
+        evaluate_seconds = seconds_since(start);
+
+        start = Clock::now();
+        auto bytecode = mango::compile_bytecode(program);
+        out = fopen((base + ".vm").c_str(), "w");
+        mango::VM(bytecode, out).run();
+        fclose(out);
+        vm_seconds = seconds_since(start);
+
+        auto same = read_file(base + ".evaluate") == read_file(base + ".vm");
+        std::cout << "evaluate: " << name << " " << evaluate_seconds * 1000 << " ms evaluated, " << vm_seconds * 1000
+                  << " ms in the VM, " << (same ? "same output" : "OUTPUT DIFFERS") << "\n";
+    }
+    for (auto suffix : {".evaluate", ".vm"}) {
+        std::remove((base + suffix).c_str());
+    }
+}
+
+void bench_jit() {
+    // hot loops and functions in the VM with and without compiling them to
+    // machine code
+    auto base = "/tmp/mango_bench_jit_" + std::to_string(getpid());
+    for (auto &p : loop_programs) {
+        if (p.jit_size == 0) {
+            continue;
+        }
+        auto name = p.name;
+        auto program = prepare(loop_source(p, p.jit_size));
+        auto bytecode = mango::compile_bytecode(program);
+
+        double seconds[2];
+        for (int compile = 0; compile < 2; compile++) {
+            auto start = Clock::now();
+            auto out = fopen((base + (compile ? ".jit" : ".vm")).c_str(), "w");
+            mango::VM(bytecode, out, compile).run();
+            fclose(out);
+            seconds[compile] = seconds_since(start);
+        }
+
+        auto same = read_file(base + ".vm") == read_file(base + ".jit");
+        std::cout << "jit: " << name << " " << seconds[0] * 1000 << " ms interpreted, " << seconds[1] * 1000
+                  << " ms compiled, " << seconds[0] / seconds[1] << "x, " << (same ? "same output" : "OUTPUT DIFFERS")
+                  << "\n";
+    }
+    for (auto suffix : {".vm", ".jit"}) {
+        std::remove((base + suffix).c_str());
+    }
+}
+
+struct Benchmark {
+    const char* name;
+    void (*run)();
+};
+
+Benchmark benchmarks[] = {
+        {"lexer", bench_lexer},
+        {"scan", bench_scan},
+        {"relex", bench_relex},
+        {"parallel_lexer", bench_parallel_lexer},
+        {"parser", bench_parser},
+        {"reparse", bench_reparse},
+        {"ast", bench_ast},
+        {"fold", bench_fold},
+        {"types", bench_types},
+        {"objects", bench_objects},
+        {"bounds", bench_bounds},
+        {"strings", bench_strings},
+        {"functions", bench_functions},
+        {"vm", bench_vm},
+        {"evaluate", bench_evaluate},
+        {"jit", bench_jit},
+        {"flat_ast", bench_flat_ast},
+        {"deep_nesting", bench_deep_nesting},
+        {"deep_cli", bench_deep_cli},
+        {"ast_cache", bench_ast_cache},
+};
+
+}
+
+int main(int argc, char** argv) {
+    for (auto &b : benchmarks) {
+        if (argc > 1 && strcmp(argv[1], b.name) != 0) {
+            continue;
+        }
+        b.run();
+    }
+    return 0;
+}
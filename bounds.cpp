@@ -0,0 +1,171 @@
+#include "bounds.h"
+
+#include <unordered_map>
+#include <vector>
+
+#include "types.h"
+#include "uses.h"
+
+namespace mango {
+
+// what's known about a variable from every place it's given a value
+struct Variable {
+    bool non_negative = false;
+    bool reassigned = false;
+    // of the array literal it's declared with, or -1
+    long length = -1;
+};
+
+static const DeclarationStatement* declaration_of(const Expression* e) {
+    return e->kind == NodeKind::IdentifierExpression ? static_cast<const IdentifierExpression*>(e)->declaration
+                                                     : nullptr;
+}
+
+static bool is_non_negative_literal(const Expression* e) {
+    return e->kind == NodeKind::IntegerLiteralExpression && static_cast<const IntegerLiteralExpression*>(e)->value >= 0;
+}
+
+// "x = x + 1"
+static bool is_increment(const AssignmentExpression* e, const DeclarationStatement* d) {
+    if (e->right->kind != NodeKind::BinaryExpression) {
+        return false;
+    }
+    auto b = static_cast<const BinaryExpression*>(e->right);
+    return b->op == Operator::Plus && declaration_of(b->left) == d && b->right->kind == NodeKind::IntegerLiteralExpression &&
+           static_cast<const IntegerLiteralExpression*>(b->right)->value == 1;
+}
+
+class BoundsEliminator {
+    std::unordered_map<const DeclarationStatement*, Variable> variables;
+    size_t eliminated = 0;
+
+    // the arrays a loop's condition bounds its index by, and the index
+    struct Bound {
+        const DeclarationStatement* index = nullptr;
+        // "i < a.length"
+        const DeclarationStatement* array = nullptr;
+        // "i < n", any array at least this long that's never reassigned
+        long limit = -1;
+    };
+
+    Bound bound(const WhileStatement* loop) {
+        Bound bound;
+        if (loop->condition->kind != NodeKind::BinaryExpression) {
+            return bound;
+        }
+        auto condition = static_cast<const BinaryExpression*>(loop->condition);
+        auto index = declaration_of(condition->left);
+        if (condition->op != Operator::LessThan || !index || !variables[index].non_negative) {
+            return bound;
+        }
+
+        auto right = condition->right;
+        if (right->kind == NodeKind::IntegerLiteralExpression) {
+            bound.index = index;
+            bound.limit = static_cast<const IntegerLiteralExpression*>(right)->value;
+        } else if (right->kind == NodeKind::MemberExpression) {
+            auto m = static_cast<const MemberExpression*>(right);
+            if (m->declaration && m->declaration->data_type == DataType::Array &&
+                !m->computed &&
+                static_cast<const IdentifierExpression*>(m->property)->value == "length") {
+                bound.index = index;
+                bound.array = m->declaration;
+            }
+        }
+        return bound;
+    }
+
+    bool in_bounds(const Bound &bound, const MemberExpression* e) {
+        if (declaration_of(e->property) != bound.index || !e->declaration) {
+            return false;
+        }
+        if (e->declaration == bound.array) {
+            return true;
+        }
+        auto &array = variables[e->declaration];
+        return bound.limit >= 0 && !array.reassigned && array.length >= bound.limit;
+    }
+
+public:
+    explicit BoundsEliminator(const Uses &program) {
+        for (auto d : program.declarations) {
+            auto &v = variables[d];
+            v.non_negative = is_non_negative_literal(d->value);
+            if (d->value->kind == NodeKind::ArrayExpression) {
+                v.length = static_cast<long>(static_cast<const ArrayExpression*>(d->value)->elements.size());
+            }
+        }
+
+        for (auto e : program.assignments) {
+            auto d = declaration_of(e->left);
+            if (!d) {
+                continue;
+            }
+            auto &v = variables[d];
+            v.reassigned = true;
+            if (!is_increment(e, d) && !is_non_negative_literal(e->right)) {
+                v.non_negative = false;
+            }
+        }
+    }
+
+    void eliminate(WhileStatement* loop) {
+        auto b = bound(loop);
+        if (!b.index) {
+            return;
+        }
+
+        ArenaArray<Statement*> body{&loop->body, 1};
+        if (loop->body->kind == NodeKind::BlockStatement) {
+            body = static_cast<BlockStatement*>(loop->body)->statements;
+        }
+
+        // statements up to the first one that might change i or a's length
+        for (auto s : body) {
+            Uses uses;
+            uses.visit(s);
+            for (auto e : uses.calls) {
+                if (!is_print(e)) {
+                    return;
+                }
+            }
+            for (auto e : uses.assignments) {
+                auto d = declaration_of(e->left);
+                if (d && (d == b.index || d == b.array)) {
+                    return;
+                }
+            }
+
+            for (auto e : uses.indexes) {
+                if (e->checked && in_bounds(b, e)) {
+                    e->checked = false;
+                    eliminated++;
+                }
+            }
+        }
+    }
+
+    size_t eliminated_count() const { return eliminated; }
+};
+
+BoundsStats eliminate_bounds_checks(Program &program) {
+    Uses uses;
+    for (auto s : program.statements) {
+        uses.visit(s);
+    }
+
+    BoundsEliminator eliminator(uses);
+    for (auto loop : uses.loops) {
+        eliminator.eliminate(loop);
+    }
+
+    size_t accesses = 0;
+    for (auto e : uses.indexes) {
+        if (e->declaration && e->declaration->data_type == DataType::Array) {
+            accesses++;
+        }
+    }
+    return {accesses, eliminator.eliminated_count()};
+}
+
+}
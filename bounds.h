@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+
+#include "ast.h"
+
+namespace mango {
+
+struct BoundsStats {
+    // array indexing in the program, and how much of it needs no check
+    size_t accesses;
+    size_t eliminated;
+};
+
+// Clears MemberExpression::checked on array indexing that can't go out
+// of bounds, so the C generator can index directly and the C compiler is
+// free to vectorize the loop. Proven are accesses a[i] in the body of a
+// loop "while (i < a.length)", or "while (i < n)" with n a literal no
+// larger than a's length when a is never reassigned, where i is a
+// variable that's never negative (it starts at a non-negative literal
+// and is only ever counted up by one or set to another). The access must
+// come before anything in the body that could assign i or a, function
+// calls other than print included. Runs after infer_types.
+BoundsStats eliminate_bounds_checks(Program &program);
+
+}
@@ -0,0 +1,733 @@
+#include "bytecode.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "types.h"
+#include "visitor.h"
+
+namespace mango {
+
+const char* op_name(Op op) {
+    static const char* names[] = {
+#define MANGO_OP(name) #name,
+            MANGO_OPS(MANGO_OP)
+#undef MANGO_OP
+    };
+    return names[static_cast<uint8_t>(op)];
+}
+
+// Finds the variables that have to live in cells, the ones some function
+// captures, and the integer literals each function uses as operands,
+// which get a register loaded once when the function starts instead of
+// an instruction every time they're used.
+class Prepass : public Visitor<Prepass> {
+    const FunctionExpression* function = nullptr;
+    std::unordered_map<const FunctionExpression*, std::unordered_set<int>> seen;
+
+    void operand(Expression* e) {
+        if (e->kind == NodeKind::IntegerLiteralExpression) {
+            auto value = static_cast<IntegerLiteralExpression*>(e)->value;
+            if (seen[function].insert(value).second) {
+                constants[function].push_back(value);
+            }
+        }
+        visit(e);
+    }
+
+public:
+    std::unordered_set<const DeclarationStatement*> boxed;
+    // by function, null for the top level
+    std::unordered_map<const FunctionExpression*, std::vector<int>> constants;
+
+    using Visitor::visit;
+
+    void visit(UndefinedExpression* e) {}
+    void visit(IdentifierExpression* e) {}
+    void visit(IntegerLiteralExpression* e) {}
+    void visit(StringLiteralExpression* e) {}
+    void visit(BooleanLiteralExpression* e) {}
+
+    void visit(FunctionExpression* e) {
+        boxed.insert(e->captures.begin(), e->captures.end());
+        auto outer = function;
+        function = e;
+        visit(e->body);
+        function = outer;
+    }
+
+    void visit(ObjectExpression* e) {
+        for (auto &p : e->properties) {
+            visit(p.value);
+        }
+    }
+
+    void visit(ArrayExpression* e) {
+        for (auto element : e->elements) {
+            visit(element);
+        }
+    }
+
+    void visit(MemberExpression* e) {
+        if (e->computed) {
+            visit(e->property);
+        }
+    }
+
+    void visit(FunctionCallExpression* e) {
+        for (auto arg : e->arguments) {
+            visit(arg);
+        }
+    }
+
+    void visit(BinaryExpression* e) {
+        walk_left_chain(e, [this](Expression* left) { operand(left); },
+                        [this](BinaryExpression* b) { operand(b->right); });
+    }
+
+    void visit(UnaryExpression* e) { visit(e->argument); }
+
+    void visit(AssignmentExpression* e) {
+        visit(e->left);
+        visit(e->right);
+    }
+
+    void visit(BlockStatement* s) {
+        for (auto st : s->statements) {
+            visit(st);
+        }
+    }
+
+    void visit(DeclarationStatement* s) { visit(s->value); }
+    void visit(ReturnStatement* s) { visit(s->value); }
+    void visit(ExpressionStatement* s) { visit(s->value); }
+
+    void visit(IfStatement* s) {
+        operand(s->condition);
+        visit(s->if_block);
+        if (s->else_block) {
+            visit(s->else_block);
+        }
+    }
+
+    void visit(WhileStatement* s) {
+        operand(s->condition);
+        visit(s->body);
+    }
+};
+
+// Compiles expressions into the register target, statements into code
+// that leaves registers above the function's variables free.
+class BytecodeCompiler : public Visitor<BytecodeCompiler> {
+    // where a variable is from the function being compiled
+    enum class Place {
+        Register,
+        Cell,
+        Capture,
+        Self,
+        Function,
+        // undeclared, a compile error
+        None,
+    };
+
+    struct Location {
+        Place place;
+        uint32_t index;
+    };
+
+    struct FunctionState {
+        uint32_t index;
+        // null for the top level
+        const FunctionExpression* expression;
+        std::unordered_map<const DeclarationStatement*, uint32_t> locals;
+        std::unordered_map<int, uint32_t> constants;
+        // registers from top on are free
+        uint32_t top = 0;
+    };
+
+    Bytecode &bytecode;
+    const Prepass &prepass;
+    // the functions being compiled, innermost last
+    std::vector<FunctionState> states;
+    std::unordered_map<const FunctionExpression*, uint32_t> function_ids;
+    std::unordered_map<std::string_view, uint32_t> string_ids;
+    // the names reported as undeclared
+    std::unordered_set<std::string_view> unresolved;
+    // where the expression being visited goes
+    uint32_t target = 0;
+
+    FunctionState &state() { return states.back(); }
+    BytecodeFunction &function() { return bytecode.functions[state().index]; }
+    uint32_t here() { return static_cast<uint32_t>(function().code.size()); }
+
+    uint32_t emit(Op op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+        function().code.push_back({op, a, b, c});
+        return here() - 1;
+    }
+
+    // points the jump at i to the next instruction
+    void patch(uint32_t i) { function().code[i].b = here(); }
+
+    uint32_t allocate() {
+        auto r = state().top++;
+        function().registers = std::max(function().registers, state().top);
+        return r;
+    }
+
+    uint32_t string_id(std::string_view s) {
+        auto it = string_ids.find(s);
+        if (it != string_ids.end()) {
+            return it->second;
+        }
+        auto id = static_cast<uint32_t>(bytecode.strings.size());
+        bytecode.strings.push_back(s);
+        string_ids.emplace(s, id);
+        return id;
+    }
+
+    uint32_t cache(std::string_view name) {
+        bytecode.caches.push_back({name});
+        return static_cast<uint32_t>(bytecode.caches.size() - 1);
+    }
+
+    Location locate(const DeclarationStatement* d, std::string_view name) {
+        auto &s = state();
+        auto local = s.locals.find(d);
+        if (d && local != s.locals.end()) {
+            return {prepass.boxed.count(d) ? Place::Cell : Place::Register, local->second};
+        }
+        if (d && s.expression) {
+            auto &captures = s.expression->captures;
+            auto it = std::find(captures.begin(), captures.end(), d);
+            if (it != captures.end()) {
+                return {Place::Capture, static_cast<uint32_t>(it - captures.begin())};
+            }
+            if (d == s.expression->declaration && !s.expression->captures.empty()) {
+                return {Place::Self, 0};
+            }
+        }
+        // functions that capture nothing aren't captured, they're the same
+        // wherever they're used from
+        if (d && d->value->kind == NodeKind::FunctionExpression) {
+            auto it = function_ids.find(static_cast<FunctionExpression*>(d->value));
+            if (it != function_ids.end()) {
+                return {Place::Function, it->second};
+            }
+        }
+
+        // a name is located more than once as it's compiled, say so once
+        if (unresolved.insert(name).second) {
+            std::cerr << "can't find " << name << "\n";
+        }
+        failed = true;
+        assert(false);
+        return {Place::None, 0};
+    }
+
+    void read(const DeclarationStatement* d, std::string_view name, uint32_t to) {
+        auto l = locate(d, name);
+        switch (l.place) {
+            case Place::Register:
+                if (l.index != to) {
+                    emit(Op::Move, to, l.index);
+                }
+                break;
+            case Place::Cell:
+                emit(Op::LoadCell, to, l.index);
+                break;
+            case Place::Capture:
+                emit(Op::LoadCapture, to, l.index);
+                break;
+            case Place::Self:
+                emit(Op::LoadSelf, to);
+                break;
+            case Place::Function:
+                emit(Op::Closure, to, l.index);
+                break;
+            case Place::None:
+                // reported by locate, the bytecode is thrown away
+                break;
+        }
+    }
+
+    void write(const DeclarationStatement* d, std::string_view name, uint32_t from) {
+        auto l = locate(d, name);
+        switch (l.place) {
+            case Place::Register:
+                if (l.index != from) {
+                    emit(Op::Move, l.index, from);
+                }
+                break;
+            case Place::Cell:
+                emit(Op::StoreCell, l.index, from);
+                break;
+            case Place::Capture:
+                emit(Op::StoreCapture, l.index, from);
+                break;
+            case Place::None:
+                break;
+            default:
+                std::cerr << "can't assign to " << name << "\n";
+                failed = true;
+                assert(false);
+        }
+    }
+
+    // a register holding a variable's value, without copying it when it's
+    // in one already
+    uint32_t variable(const DeclarationStatement* d, std::string_view name) {
+        auto l = locate(d, name);
+        if (l.place == Place::Register) {
+            return l.index;
+        }
+        auto r = allocate();
+        read(d, name, r);
+        return r;
+    }
+
+    // a register holding e's value
+    uint32_t operand(Expression* e) {
+        if (e->kind == NodeKind::IdentifierExpression) {
+            auto i = static_cast<IdentifierExpression*>(e);
+            return variable(i->declaration, i->value);
+        }
+        if (e->kind == NodeKind::IntegerLiteralExpression) {
+            auto &constants = state().constants;
+            auto it = constants.find(static_cast<IntegerLiteralExpression*>(e)->value);
+            if (it != constants.end()) {
+                return it->second;
+            }
+        }
+        auto r = allocate();
+        compile(e, r);
+        return r;
+    }
+
+    void compile(Expression* e, uint32_t to) {
+        auto outer = target;
+        target = to;
+        visit(e);
+        target = outer;
+    }
+
+    // whether compiling e into a variable's register reads everything it
+    // needs before it writes the register
+    static bool reads_before_writing(const Expression* e) {
+        switch (e->kind) {
+            case NodeKind::BinaryExpression: {
+                auto b = static_cast<const BinaryExpression*>(e);
+                return b->op != Operator::And && b->op != Operator::Or &&
+                       b->left->kind != NodeKind::BinaryExpression;
+            }
+            case NodeKind::UnaryExpression:
+                return reads_before_writing(static_cast<const UnaryExpression*>(e)->argument);
+            case NodeKind::AssignmentExpression:
+                return false;
+            default:
+                return true;
+        }
+    }
+
+    static Op binary_op(Operator op, bool integers) {
+        switch (op) {
+            case Operator::Plus:
+                return integers ? Op::AddInt : Op::Add;
+            case Operator::Minus:
+                return integers ? Op::SubtractInt : Op::Subtract;
+            case Operator::Multiply:
+                return integers ? Op::MultiplyInt : Op::Multiply;
+            case Operator::Divide:
+                return Op::Divide;
+            case Operator::LessThan:
+                return integers ? Op::LessInt : Op::Less;
+            case Operator::LessThanOrEqualTo:
+                return integers ? Op::LessEqualInt : Op::LessEqual;
+            case Operator::GreaterThan:
+                return integers ? Op::GreaterInt : Op::Greater;
+            case Operator::GreaterThanOrEqualTo:
+                return integers ? Op::GreaterEqualInt : Op::GreaterEqual;
+            case Operator::EqualTo:
+                return integers ? Op::EqualInt : Op::Equal;
+            case Operator::NotEqualTo:
+                return integers ? Op::NotEqualInt : Op::NotEqual;
+            default:
+                std::cerr << "not a binary operator " << op << "\n";
+                assert(false);
+                return Op::Add;
+        }
+    }
+
+    // whether e's field is at the same place in every object the variable
+    // holds, and where
+    bool static_field(MemberExpression* e, int &field) {
+        auto d = e->declaration;
+        if (!d || !d->shape || d->dynamic_shape) {
+            return false;
+        }
+        field = d->shape->field(static_cast<IdentifierExpression*>(e->property)->value);
+        return field >= 0;
+    }
+
+    bool is_array(const MemberExpression* e) {
+        return e->declaration && e->declaration->data_type == DataType::Array;
+    }
+
+    // stores the value of e->right where e->left says, returns the register
+    // the value is in
+    uint32_t assign(AssignmentExpression* e) {
+        auto saved = state().top;
+        uint32_t value;
+
+        if (e->left->kind == NodeKind::IdentifierExpression) {
+            auto left = static_cast<IdentifierExpression*>(e->left);
+            auto l = locate(left->declaration, left->value);
+            if (l.place == Place::Register && reads_before_writing(e->right)) {
+                compile(e->right, l.index);
+                state().top = saved;
+                return l.index;
+            }
+            value = operand(e->right);
+            write(left->declaration, left->value, value);
+        } else if (e->left->kind == NodeKind::MemberExpression) {
+            auto left = static_cast<MemberExpression*>(e->left);
+            auto object = variable(left->declaration, left->identifier);
+            value = operand(e->right);
+            int field;
+            if (left->computed) {
+                emit(Op::SetIndex, object, operand(left->property), value);
+            } else if (static_field(left, field)) {
+                emit(Op::SetField, object, static_cast<uint32_t>(field), value);
+            } else {
+                auto name = static_cast<IdentifierExpression*>(left->property)->value;
+                emit(Op::SetNamed, object, cache(name), value);
+            }
+        } else {
+            std::cerr << "can't assign to that\n";
+            failed = true;
+            assert(false);
+            return 0;
+        }
+
+        // keeps the value's register when it's a temporary
+        state().top = std::max(saved, value + 1);
+        return value;
+    }
+
+public:
+    // set when a name can't be resolved or assigned, the reason is printed
+    // where it's found
+    bool failed = false;
+
+    BytecodeCompiler(Bytecode &bytecode, const Prepass &prepass) : bytecode(bytecode), prepass(prepass) {}
+
+    // compiles f if it hasn't been yet, in the function being compiled
+    uint32_t compile_function(FunctionExpression* f) {
+        auto it = function_ids.find(f);
+        if (it != function_ids.end()) {
+            return it->second;
+        }
+
+        auto index = static_cast<uint32_t>(bytecode.functions.size());
+        bytecode.functions.emplace_back();
+        function_ids.emplace(f, index);
+
+        auto &compiled = bytecode.functions.back();
+        compiled.name = f->declaration ? f->declaration->identifier : "<anonymous>";
+        compiled.parameters = static_cast<uint32_t>(f->parameters.size());
+        for (auto d : f->captures) {
+            auto l = locate(d, d->identifier);
+            switch (l.place) {
+                case Place::Cell:
+                    compiled.captures.push_back({CaptureSource::Register, l.index});
+                    break;
+                case Place::Capture:
+                    compiled.captures.push_back({CaptureSource::Capture, l.index});
+                    break;
+                case Place::Self:
+                    compiled.captures.push_back({CaptureSource::Self, 0});
+                    break;
+                default:
+                    std::cerr << "can't capture " << d->identifier << "\n";
+                    failed = true;
+                    assert(false);
+            }
+        }
+
+        // the arguments are in the first registers
+        begin(index, f);
+        for (uint32_t i = 0; i < f->parameter_declarations.size(); i++) {
+            auto d = f->parameter_declarations[i];
+            state().locals.emplace(d, i);
+            if (prepass.boxed.count(d)) {
+                emit(Op::Box, i);
+            }
+        }
+        visit(f->body);
+        emit(Op::ReturnUndefined);
+        states.pop_back();
+        return index;
+    }
+
+    // starts compiling function index, with its constants loaded first
+    void begin(uint32_t index, const FunctionExpression* f) {
+        states.push_back({index, f});
+        states.back().top = static_cast<uint32_t>(f ? f->parameters.size() : 0);
+        function().registers = state().top;
+
+        auto it = prepass.constants.find(f);
+        if (it == prepass.constants.end()) {
+            return;
+        }
+        for (auto value : it->second) {
+            auto r = allocate();
+            emit(Op::LoadInt, r, static_cast<uint32_t>(value));
+            state().constants.emplace(value, r);
+        }
+    }
+
+    void end() { states.pop_back(); }
+
+    using Visitor::visit;
+
+    void visit(UndefinedExpression* e) { emit(Op::LoadUndefined, target); }
+
+    void visit(IntegerLiteralExpression* e) {
+        emit(Op::LoadInt, target, static_cast<uint32_t>(e->value));
+    }
+
+    void visit(StringLiteralExpression* e) { emit(Op::LoadString, target, string_id(e->value)); }
+    void visit(BooleanLiteralExpression* e) { emit(Op::LoadBool, target, e->value); }
+    void visit(IdentifierExpression* e) { read(e->declaration, e->value, target); }
+
+    void visit(FunctionExpression* e) {
+        auto to = target;
+        emit(Op::Closure, to, compile_function(e));
+    }
+
+    void visit(ObjectExpression* e) {
+        auto saved = state().top;
+        auto first = state().top;
+        for (auto &p : e->properties) {
+            compile(p.value, allocate());
+        }
+        emit(Op::NewObject, target, e->shape->id, first);
+        state().top = saved;
+    }
+
+    void visit(ArrayExpression* e) {
+        auto saved = state().top;
+        auto first = state().top;
+        for (auto element : e->elements) {
+            compile(element, allocate());
+        }
+        emit(Op::NewArray, target, first, static_cast<uint32_t>(e->elements.size()));
+        state().top = saved;
+    }
+
+    void visit(MemberExpression* e) {
+        auto saved = state().top;
+        auto object = variable(e->declaration, e->identifier);
+        int field;
+        if (e->computed) {
+            auto index = operand(e->property);
+            emit(e->checked || !is_array(e) ? Op::GetIndex : Op::GetIndexUnchecked, target, object, index);
+        } else if (is_array(e) && static_cast<IdentifierExpression*>(e->property)->value == "length") {
+            emit(Op::Length, target, object);
+        } else if (static_field(e, field)) {
+            emit(Op::GetField, target, object, static_cast<uint32_t>(field));
+        } else {
+            emit(Op::GetNamed, target, object, cache(static_cast<IdentifierExpression*>(e->property)->value));
+        }
+        state().top = saved;
+    }
+
+    void visit(FunctionCallExpression* e) {
+        auto saved = state().top;
+        auto to = target;
+
+        if (is_print(e)) {
+            auto first = state().top;
+            for (auto arg : e->arguments) {
+                compile(arg, allocate());
+            }
+            emit(Op::Print, first, static_cast<uint32_t>(e->arguments.size()));
+        } else if (e->function && e->function->captures.empty()) {
+            // a direct call, the arguments start the callee's registers
+            auto first = state().top;
+            for (auto arg : e->arguments) {
+                compile(arg, allocate());
+            }
+            auto it = function_ids.find(e->function);
+            assert(it != function_ids.end());
+            emit(Op::CallDirect, to, first, it->second);
+        } else {
+            if (!e->declaration) {
+                std::cerr << "can't call " << e->value << ", it isn't declared\n";
+                failed = true;
+                assert(false);
+            }
+            auto callee = allocate();
+            read(e->declaration, e->value, callee);
+            for (auto arg : e->arguments) {
+                compile(arg, allocate());
+            }
+            emit(Op::Call, to, callee, static_cast<uint32_t>(e->arguments.size()));
+        }
+        state().top = saved;
+    }
+
+    void visit(BinaryExpression* e) {
+        auto to = target;
+        auto saved = state().top;
+
+        // the innermost left operand is compiled by the first operation
+        Expression* innermost = nullptr;
+        auto in_target = false;
+        walk_left_chain(e, [&](Expression* left) { innermost = left; }, [&](BinaryExpression* b) {
+            if (b->op == Operator::And || b->op == Operator::Or) {
+                if (!in_target) {
+                    compile(innermost, to);
+                }
+                auto skip = emit(b->op == Operator::And ? Op::JumpIfFalse : Op::JumpIfTrue, to);
+                compile(b->right, to);
+                patch(skip);
+                // the result is a Bool, like it is in C
+                if (b->left->type != DataType::Bool || b->right->type != DataType::Bool) {
+                    emit(Op::Not, to, to);
+                    emit(Op::Not, to, to);
+                }
+            } else {
+                auto integers = b->left->type == DataType::Integer && b->right->type == DataType::Integer;
+                auto left = in_target ? to : operand(innermost);
+                auto right = operand(b->right);
+                emit(binary_op(b->op, integers), to, left, right);
+            }
+            in_target = true;
+            state().top = saved;
+        });
+    }
+
+    void visit(UnaryExpression* e) {
+        auto saved = state().top;
+        auto to = target;
+        emit(Op::Not, to, operand(e->argument));
+        state().top = saved;
+    }
+
+    void visit(AssignmentExpression* e) {
+        auto saved = state().top;
+        auto to = target;
+        auto value = assign(e);
+        if (value != to) {
+            emit(Op::Move, to, value);
+        }
+        state().top = saved;
+    }
+
+    void visit(BlockStatement* s) {
+        auto saved = state().top;
+        for (auto st : s->statements) {
+            visit(st);
+        }
+        state().top = saved;
+    }
+
+    void visit(DeclarationStatement* s) {
+        auto r = allocate();
+        compile(s->value, r);
+        // declared after the value so "var x = x" reads the outer x
+        state().locals[s] = r;
+        if (prepass.boxed.count(s)) {
+            emit(Op::Box, r);
+        }
+    }
+
+    void visit(ReturnStatement* s) {
+        auto saved = state().top;
+        if (s->value->kind == NodeKind::UndefinedExpression) {
+            emit(Op::ReturnUndefined);
+        } else {
+            emit(Op::Return, operand(s->value));
+        }
+        state().top = saved;
+    }
+
+    void visit(IfStatement* s) {
+        auto saved = state().top;
+        auto skip = emit(Op::JumpIfFalse, operand(s->condition));
+        state().top = saved;
+        visit(s->if_block);
+        if (s->else_block) {
+            auto end = emit(Op::Jump);
+            patch(skip);
+            visit(s->else_block);
+            patch(end);
+        } else {
+            patch(skip);
+        }
+    }
+
+    void visit(WhileStatement* s) {
+        // the condition goes after the body, so each time around the loop
+        // runs one jump
+        auto check = emit(Op::Jump);
+        auto body = here();
+        visit(s->body);
+        patch(check);
+        auto saved = state().top;
+        emit(Op::Loop, operand(s->condition), body);
+        state().top = saved;
+    }
+
+    void visit(ExpressionStatement* s) {
+        auto saved = state().top;
+        if (s->value->kind == NodeKind::AssignmentExpression) {
+            assign(static_cast<AssignmentExpression*>(s->value));
+        } else {
+            compile(s->value, allocate());
+        }
+        state().top = saved;
+    }
+};
+
+Bytecode compile_bytecode(Program &program) {
+    Prepass prepass;
+    for (auto s : program.statements) {
+        prepass.visit(s);
+    }
+
+    Bytecode bytecode;
+    bytecode.shapes = program.shapes;
+    bytecode.functions.emplace_back();
+    bytecode.functions[0].name = "<program>";
+
+    BytecodeCompiler compiler(bytecode, prepass);
+    compiler.begin(0, nullptr);
+    for (auto s : program.statements) {
+        compiler.visit(s);
+    }
+    bytecode.functions[0].code.push_back({Op::ReturnUndefined});
+    compiler.end();
+    if (compiler.failed) {
+        return Bytecode{};
+    }
+    return bytecode;
+}
+
+std::string Bytecode::print() const {
+    std::string out;
+    for (size_t i = 0; i < functions.size(); i++) {
+        auto &f = functions[i];
+        out += "function " + std::to_string(i) + " " + std::string(f.name) + ", " + std::to_string(f.parameters) +
+               " parameters, " + std::to_string(f.registers) + " registers\n";
+        for (size_t j = 0; j < f.code.size(); j++) {
+            auto &in = f.code[j];
+            out += "    " + std::to_string(j) + ": " + op_name(in.op) + " " + std::to_string(in.a) + " " +
+                   std::to_string(in.b) + " " + std::to_string(in.c) + "\n";
+        }
+    }
+    return out;
+}
+
+}
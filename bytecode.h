@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.h"
+
+namespace mango {
+
+// The VM's instructions. Every function has its own registers, a, b and c
+// name registers unless said otherwise, and "a <- b + c" stores b + c in a.
+// Instructions ending in Int are for operands infer_types knows are
+// integers, the others look at what the values are when the program runs.
+#define MANGO_OPS(X)                                                        \
+    X(Move)             /* a <- b */                                        \
+    X(LoadInt)          /* a <- the integer b */                            \
+    X(LoadString)       /* a <- strings[b] */                               \
+    X(LoadBool)         /* a <- b != 0 */                                   \
+    X(LoadUndefined)    /* a <- undefined */                                \
+    X(Add)              /* a <- b + c, joins strings */                     \
+    X(Subtract)                                                             \
+    X(Multiply)                                                             \
+    X(Divide)                                                               \
+    X(Less)                                                                 \
+    X(LessEqual)                                                            \
+    X(Greater)                                                              \
+    X(GreaterEqual)                                                         \
+    X(Equal)                                                                \
+    X(NotEqual)                                                             \
+    X(AddInt)                                                               \
+    X(SubtractInt)                                                          \
+    X(MultiplyInt)                                                          \
+    X(LessInt)                                                              \
+    X(LessEqualInt)                                                         \
+    X(GreaterInt)                                                           \
+    X(GreaterEqualInt)                                                      \
+    X(EqualInt)                                                             \
+    X(NotEqualInt)                                                          \
+    X(Not)              /* a <- !b */                                       \
+    X(Jump)             /* continue at instruction b */                     \
+    X(JumpIfFalse)      /* continue at b if a is falsy */                   \
+    X(JumpIfTrue)       /* continue at b if a is truthy */                  \
+    X(Loop)             /* continue at b if a is truthy, a loop's end */    \
+    X(NewObject)        /* a <- an object of shape b, fields from c on */   \
+    X(GetField)         /* a <- field c of object b */                      \
+    X(SetField)         /* field b of object a <- c */                      \
+    X(GetNamed)         /* a <- b.name, with the name and cache c */        \
+    X(SetNamed)         /* a.name <- c, with the name and cache b */        \
+    X(NewArray)         /* a <- the c values from b on */                   \
+    X(GetIndex)         /* a <- b[c] */                                     \
+    X(GetIndexUnchecked) /* a <- b[c], c is known to be in bounds */        \
+    X(SetIndex)         /* a[b] <- c */                                     \
+    X(Length)           /* a <- the length of array b */                    \
+    X(Closure)          /* a <- function b, with its captures */            \
+    X(Box)              /* a <- a new cell holding a */                     \
+    X(LoadCell)         /* a <- what the cell in b holds */                 \
+    X(StoreCell)        /* the cell in a <- b */                            \
+    X(LoadCapture)      /* a <- the function's capture b */                 \
+    X(StoreCapture)     /* the function's capture a <- b */                 \
+    X(LoadSelf)         /* a <- the function being run */                   \
+    X(Call)             /* a <- call b, with the c arguments after b */     \
+    X(CallDirect)       /* a <- call function c, arguments from b on */     \
+    X(Return)           /* return a */                                      \
+    X(ReturnUndefined)                                                      \
+    X(Print)            /* print the b values from a on */
+
+enum class Op : uint8_t {
+#define MANGO_OP(name) name,
+    MANGO_OPS(MANGO_OP)
+#undef MANGO_OP
+};
+
+const char* op_name(Op op);
+
+struct Instruction {
+    Op op;
+    uint32_t a = 0;
+    uint32_t b = 0;
+    uint32_t c = 0;
+};
+
+// where a function being created gets a variable it captures from
+enum class CaptureSource : uint8_t {
+    // a register of the function creating it, holding the variable's cell
+    Register,
+    // one of the creating function's own captures
+    Capture,
+    // the creating function itself, the variable it's declared as
+    Self,
+};
+
+struct Capture {
+    CaptureSource source;
+    uint32_t index;
+};
+
+struct BytecodeFunction {
+    std::string_view name;
+    uint32_t parameters = 0;
+    // the size of the function's frame, parameters come first
+    uint32_t registers = 0;
+    std::vector<Instruction> code;
+    std::vector<Capture> captures;
+};
+
+// a field looked up by name, remembering where it was in the last shape
+// it was found in
+struct FieldCache {
+    std::string_view name;
+    const Shape* shape = nullptr;
+    int index = -1;
+};
+
+// A compiled program. Strings point into the program's source and arena,
+// so the program has to outlive its bytecode.
+struct Bytecode {
+    // functions[0] is the program's top level statements
+    std::vector<BytecodeFunction> functions;
+    std::vector<std::string_view> strings;
+    std::vector<const Shape*> shapes;
+    std::vector<FieldCache> caches;
+
+    // a listing of the instructions, for --emit=bytecode
+    std::string print() const;
+};
+
+// Compiles a program for the VM, see vm.h. Variables live in registers,
+// the ones a function captures live in cells the registers point to so
+// the function and the code around it share them. Like
+// Program::generate, runs after infer_types and resolve_closures. Has no
+// functions if a name can't be resolved, after saying which on stderr.
+Bytecode compile_bytecode(Program &program);
+
+}
@@ -0,0 +1,1025 @@
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.h"
+#include "types.h"
+#include "visitor.h"
+
+namespace mango {
+
+// what the runtimes below need
+static const char* runtime_headers = R"(#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+)";
+
+// What generated programs with objects need. Every object starts with a
+// pointer to its shape's field table, code that doesn't know an object's
+// shape looks fields up in it by name and checks the field's type, a
+// DataType where 0 means any.
+static const char* object_runtime = R"(typedef struct {
+    const char* name;
+    size_t offset;
+    int type;
+} mango_field_info;
+
+typedef struct {
+    int field_count;
+    const mango_field_info* fields;
+} mango_shape;
+
+typedef struct {
+    const mango_shape* _shape;
+} mango_object;
+
+static void* mango_field(mango_object* object, const char* name, int type) {
+    const mango_shape* shape = object->_shape;
+    for (int i = 0; i < shape->field_count; i++) {
+        if (strcmp(shape->fields[i].name, name) == 0) {
+            if (type != 0 && shape->fields[i].type != type) {
+                fprintf(stderr, "field %s isn't the type it was compiled for\n", name);
+                abort();
+            }
+            return (char*) object + shape->fields[i].offset;
+        }
+    }
+    abort();
+}
+
+static void* mango_copy(const void* object, size_t size) {
+    void* copy = malloc(size);
+    memcpy(copy, object, size);
+    return copy;
+}
+
+)";
+
+// What generated programs with strings need. A string is a value: its
+// length, a hash (0 when it isn't known) and its characters. Up to 15
+// characters are kept in the value itself, longer strings point at a
+// literal or into a buffer they can grow in. Each literal is emitted once
+// with its length and hash worked out, so two literals are equal exactly
+// when they point at the same characters.
+static const char* string_runtime = R"(#define MANGO_SMALL 1
+#define MANGO_INTERNED 2
+
+typedef struct {
+    int used;
+    int capacity;
+    char chars[];
+} mango_buffer;
+
+typedef struct {
+    int length;
+    unsigned flags;
+    unsigned hash;
+    union {
+        char small[16];
+        struct {
+            const char* chars;
+            mango_buffer* buffer;
+        } big;
+    } data;
+} mango_string;
+
+static const char* mango_chars(const mango_string* s) {
+    return s->flags & MANGO_SMALL ? s->data.small : s->data.big.chars;
+}
+
+static int mango_string_equal(mango_string a, mango_string b) {
+    if (a.flags & b.flags & MANGO_INTERNED) {
+        return a.data.big.chars == b.data.big.chars;
+    }
+    if (a.length != b.length || (a.hash && b.hash && a.hash != b.hash)) {
+        return 0;
+    }
+    return memcmp(mango_chars(&a), mango_chars(&b), a.length) == 0;
+}
+
+// When a ends where the used part of its buffer ends, b is written after
+// it in place, so appending to a string in a loop doesn't copy it every
+// time. Buffers double, and strings that share one only ever read the
+// part before their own length, so they don't see what's appended.
+static mango_string mango_concat(mango_string a, mango_string b) {
+    mango_string s = {a.length + b.length, 0, 0};
+    if (s.length < 16) {
+        s.flags = MANGO_SMALL;
+        memcpy(s.data.small, mango_chars(&a), a.length);
+        memcpy(s.data.small + a.length, mango_chars(&b), b.length);
+        return s;
+    }
+
+    mango_buffer* buffer = a.flags & MANGO_SMALL ? NULL : a.data.big.buffer;
+    if (buffer) {
+        int start = (int) (a.data.big.chars - buffer->chars);
+        if (start + a.length == buffer->used && start + s.length <= buffer->capacity) {
+            memcpy(buffer->chars + buffer->used, mango_chars(&b), b.length);
+            buffer->used += b.length;
+            s.data.big.chars = a.data.big.chars;
+            s.data.big.buffer = buffer;
+            return s;
+        }
+    }
+
+    buffer = malloc(sizeof(mango_buffer) + s.length * 2);
+    buffer->used = s.length;
+    buffer->capacity = s.length * 2;
+    memcpy(buffer->chars, mango_chars(&a), a.length);
+    memcpy(buffer->chars + a.length, mango_chars(&b), b.length);
+    s.data.big.chars = buffer->chars;
+    s.data.big.buffer = buffer;
+    return s;
+}
+
+static mango_string mango_from_int(int value) {
+    mango_string s = {0, MANGO_SMALL, 0};
+    s.length = snprintf(s.data.small, sizeof(s.data.small), "%d", value);
+    return s;
+}
+
+static mango_string mango_from_bool(int value) {
+    mango_string s = {value ? 4 : 5, MANGO_SMALL, 0};
+    memcpy(s.data.small, value ? "true" : "false", s.length);
+    return s;
+}
+
+static void mango_print_string(mango_string s, char end) {
+    printf("%.*s%c", s.length, mango_chars(&s), end);
+}
+
+)";
+
+// the print builtin, each argument is printed followed by end
+static const char* print_runtime = R"(static void mango_print_int(int value, char end) {
+    printf("%d%c", value, end);
+}
+
+static void mango_print_bool(int value, char end) {
+    printf("%s%c", value ? "true" : "false", end);
+}
+
+)";
+
+// Integer arithmetic wraps around like it does everywhere else in mango,
+// where in C signed overflow is undefined and INT_MIN / -1 traps. The
+// conversion back to int wraps in every compiler mango's C is built with.
+static const char* arithmetic_runtime = R"(static int mango_add(int a, int b) {
+    return (int) ((unsigned) a + (unsigned) b);
+}
+
+static int mango_sub(int a, int b) {
+    return (int) ((unsigned) a - (unsigned) b);
+}
+
+static int mango_mul(int a, int b) {
+    return (int) ((unsigned) a * (unsigned) b);
+}
+
+)";
+
+static const char* division_runtime = R"(static int mango_div(int a, int b) {
+    if (b == 0) {
+        fprintf(stderr, "division by zero\n");
+        exit(1);
+    }
+    return b == -1 ? (int) (0u - (unsigned) a) : a / b;
+}
+
+)";
+
+// What generated programs with arrays need. An array is a header and its
+// elements in one allocation, MANGO_ARRAY(T) defines the array of T. The
+// length is a size_t so stores to int elements can't alias it, which lets
+// the C compiler keep it in a register. Indexing goes through
+// mango_check unless the index was proven in bounds.
+static const char* array_runtime = R"(#define MANGO_ARRAY(T) \
+    typedef struct { \
+        size_t length; \
+        size_t capacity; \
+        T items[]; \
+    } mango_array_##T; \
+    \
+    static mango_array_##T* mango_array_##T##_new(int length, const T* items) { \
+        mango_array_##T* array = malloc(sizeof(mango_array_##T) + length * sizeof(T)); \
+        array->length = length; \
+        array->capacity = length; \
+        if (length > 0) { \
+            memcpy(array->items, items, length * sizeof(T)); \
+        } \
+        return array; \
+    }
+
+static int mango_check(int index, size_t length) {
+    if (index < 0 || (size_t) index >= length) {
+        fprintf(stderr, "index %d is out of bounds of an array of length %zu\n", index, length);
+        exit(1);
+    }
+    return index;
+}
+
+)";
+
+// generates a C program that does what the tree does
+class CGenerator : public Visitor<CGenerator> {
+    // where the code goes, functions are generated into their own builder
+    string_builder::StringBuilder* sb;
+
+    // generates an operand of a binary expression, adding parentheses when
+    // C would otherwise group it differently than the tree does
+    void generate_operand(Expression* e, int min_precedence) {
+        auto parenthesize = e->kind == NodeKind::AssignmentExpression;
+        if (e->kind == NodeKind::BinaryExpression) {
+            parenthesize = operator_precedence(static_cast<BinaryExpression*>(e)->op) < min_precedence;
+        }
+
+        if (parenthesize) {
+            sb->append_no_indent("(");
+        }
+        visit(e);
+        if (parenthesize) {
+            sb->append_no_indent(")");
+        }
+    }
+
+    static bool is_concatenation(const BinaryExpression* e) {
+        return e->op == Operator::Plus && e->type == DataType::String;
+    }
+
+    // concatenation, and comparing a string for equality
+    static bool is_string_operation(const BinaryExpression* e) {
+        if (e->op == Operator::EqualTo || e->op == Operator::NotEqualTo) {
+            return e->left->type == DataType::String || e->right->type == DataType::String;
+        }
+        return is_concatenation(e);
+    }
+
+    // generates e as a string, converting it if it's something else
+    void generate_string(Expression* e) {
+        uses_strings = true;
+        if (e->type == DataType::String) {
+            visit(e);
+            return;
+        }
+
+        sb->append_no_indent(e->type == DataType::Bool ? "mango_from_bool(" : "mango_from_int(");
+        visit(e);
+        sb->append_no_indent(")");
+    }
+
+    void generate_string_operation(BinaryExpression* e) {
+        // "s + a + b + ..." becomes nested calls, the chain is walked in a
+        // loop like other binary chains
+        std::vector<BinaryExpression*> chain{e};
+        while (chain.back()->left->kind == NodeKind::BinaryExpression &&
+               is_concatenation(static_cast<BinaryExpression*>(chain.back()->left))) {
+            chain.push_back(static_cast<BinaryExpression*>(chain.back()->left));
+        }
+
+        for (auto b : chain) {
+            if (b->op == Operator::Plus) {
+                sb->append_no_indent("mango_concat(");
+            } else {
+                sb->append_no_indent(b->op == Operator::EqualTo ? "mango_string_equal(" : "!mango_string_equal(");
+            }
+        }
+
+        generate_string(chain.back()->left);
+        for (auto it = chain.rbegin(); it != chain.rend(); it++) {
+            sb->append_no_indent(", ");
+            generate_string((*it)->right);
+            sb->append_no_indent(")");
+        }
+    }
+
+    // the narrowest C type that holds values of type t
+    const char* c_type(DataType t) {
+        switch (t) {
+            case DataType::Bool:
+                uses_bool = true;
+                return "bool";
+            case DataType::String:
+                uses_strings = true;
+                return "mango_string";
+            case DataType::Integer:
+            // values whose type can't be inferred are ints, like before
+            // there were types
+            case DataType::Undefined:
+                return "int";
+            default:
+                std::cerr << "can't generate " << t << " values yet\n";
+                failed = true;
+                return "int";
+        }
+    }
+
+    static std::string shape_name(const Shape* shape) {
+        return "shape_" + std::to_string(shape->id);
+    }
+
+    std::string array_type(DataType element) {
+        std::string type = c_type(element);
+        if (std::find(array_types.begin(), array_types.end(), type) == array_types.end()) {
+            array_types.push_back(type);
+        }
+        return "mango_array_" + type;
+    }
+
+    // objects are pointers to the struct of their shape, or to
+    // mango_object when the shape is only known at run time, arrays are
+    // pointers to the array of their element type
+    std::string value_type(DataType t, const Shape* shape, DataType element = DataType::Undefined) {
+        if (t == DataType::Array) {
+            return array_type(element) + "*";
+        }
+        if (t != DataType::Object) {
+            return c_type(t);
+        }
+        return shape ? "struct " + shape_name(shape) + "*" : "mango_object*";
+    }
+
+    static bool is_array(const DeclarationStatement* d) {
+        return d && d->data_type == DataType::Array;
+    }
+
+    static const Shape* static_shape(const DeclarationStatement* d) {
+        return d && !d->dynamic_shape ? d->shape : nullptr;
+    }
+
+    bool is_captured(const DeclarationStatement* d) const {
+        return current_function &&
+               std::find(current_function->captures.begin(), current_function->captures.end(), d) !=
+               current_function->captures.end();
+    }
+
+    // how the current function refers to the variable d declared as name,
+    // variables it captured are reached through its environment
+    std::string variable(const DeclarationStatement* d, std::string_view name) const {
+        if (is_captured(d)) {
+            return "(*env->" + std::string(name) + ")";
+        }
+        return std::string(name);
+    }
+
+    // the address of the variable d declared as name, for an environment.
+    // for a function that captures things, its variable is its
+    // environment.
+    std::string capture_address(const DeclarationStatement* d, std::string_view name) const {
+        if (current_function && current_function->declaration == d) {
+            return "env";
+        }
+        if (is_captured(d)) {
+            return "env->" + std::string(name);
+        }
+        return "&" + std::string(name);
+    }
+
+    std::string function_name(const FunctionExpression* f) {
+        auto it = function_ids.try_emplace(f, functions.size()).first;
+        if (it->second == functions.size()) {
+            functions.push_back(f);
+        }
+        return "mango_fn_" + std::to_string(it->second) + "_" + std::string(f->declaration->identifier);
+    }
+
+    std::string environment_name(const FunctionExpression* f) {
+        return "mango_env_" + std::to_string(function_ids.at(f));
+    }
+
+    // the C type of the captured d in an environment
+    std::string capture_type(const DeclarationStatement* d) {
+        if (d->value->kind == NodeKind::FunctionExpression && d->data_type == DataType::Function) {
+            return "struct " + environment_name(static_cast<const FunctionExpression*>(d->value)) + "*";
+        }
+        return value_type(d->data_type, static_shape(d), d->element_type) + "*";
+    }
+
+    // whether any return in s, outside of nested functions, has a value
+    static bool returns_value(const Statement* s) {
+        switch (s->kind) {
+            case NodeKind::ReturnStatement:
+                return static_cast<const ReturnStatement*>(s)->value->kind != NodeKind::UndefinedExpression;
+            case NodeKind::BlockStatement:
+                for (auto st : static_cast<const BlockStatement*>(s)->statements) {
+                    if (returns_value(st)) {
+                        return true;
+                    }
+                }
+                return false;
+            case NodeKind::IfStatement: {
+                auto i = static_cast<const IfStatement*>(s);
+                return returns_value(i->if_block) || (i->else_block && returns_value(i->else_block));
+            }
+            case NodeKind::WhileStatement:
+                return returns_value(static_cast<const WhileStatement*>(s)->body);
+            default:
+                return false;
+        }
+    }
+
+    void generate_print(FunctionCallExpression* e) {
+        uses_print = true;
+        if (e->arguments.empty()) {
+            sb->append_no_indent("putchar('\\n')");
+            return;
+        }
+
+        sb->append_no_indent("(");
+        for (size_t i = 0; i < e->arguments.size(); i++) {
+            auto arg = e->arguments[i];
+            if (i > 0) {
+                sb->append_no_indent(", ");
+            }
+            switch (arg->type) {
+                case DataType::String:
+                    sb->append_no_indent("mango_print_string(");
+                    break;
+                case DataType::Bool:
+                    sb->append_no_indent("mango_print_bool(");
+                    break;
+                case DataType::Integer:
+                case DataType::Undefined:
+                    sb->append_no_indent("mango_print_int(");
+                    break;
+                default:
+                    std::cerr << "can't print " << arg->type << " values yet\n";
+                    failed = true;
+            }
+            visit(arg);
+            sb->append_no_indent(i + 1 == e->arguments.size() ? ", '\\n')" : ", ' ')");
+        }
+        sb->append_no_indent(")");
+    }
+
+    // generates value to be stored somewhere that holds objects of shape
+    void generate_value(Expression* value, DataType type, const Shape* shape) {
+        if (type == DataType::Object && !shape && object_shape(value)) {
+            sb->append_no_indent("(mango_object*) ");
+        }
+        visit(value);
+    }
+
+public:
+    // whether the program needs stdbool.h
+    bool uses_bool = false;
+    bool uses_strings = false;
+    // the element types of the arrays in the program
+    std::vector<std::string> array_types;
+    // the string literals in the program by value, each is emitted once
+    std::unordered_map<std::string_view, size_t> literal_ids;
+    std::vector<std::string_view> literals;
+    bool uses_print = false;
+    bool uses_arithmetic = false;
+    bool uses_division = false;
+    // whether the statement being generated is directly in main, objects
+    // made there live as long as the program so they can be on the stack
+    bool top_level = false;
+    // the function being generated, null for main
+    const FunctionExpression* current_function = nullptr;
+    // set when the program uses something there's no C for yet, like a
+    // function value, the reason is printed where it's found
+    bool failed = false;
+    // every function called or declared, in the order they were found,
+    // they're generated after main
+    std::unordered_map<const FunctionExpression*, size_t> function_ids;
+    std::vector<const FunctionExpression*> functions;
+
+    using Visitor::visit;
+
+    explicit CGenerator(string_builder::StringBuilder* sb) : sb(sb) {}
+
+    void visit(BinaryExpression* e) {
+        if (is_string_operation(e)) {
+            generate_string_operation(e);
+            return;
+        }
+
+        // Long chains like "a - b - c - ..." are left leaning, walk down the
+        // left side of the chain instead of recursing so generating them
+        // doesn't use stack proportional to their length.
+        std::vector<BinaryExpression*> chain{e};
+        while (chain.back()->left->kind == NodeKind::BinaryExpression) {
+            auto b = static_cast<BinaryExpression*>(chain.back()->left);
+            if (operator_precedence(b->op) < operator_precedence(chain.back()->op) || is_string_operation(b)) {
+                break;
+            }
+            chain.push_back(b);
+        }
+
+        // arithmetic is a call to the runtime, open the calls outermost
+        // first so they close in the order the operators apply
+        for (auto b : chain) {
+            if (auto name = arithmetic_function(b->op)) {
+                sb->append_no_indent(name);
+                sb->append_no_indent("(");
+            }
+        }
+
+        auto innermost = chain.back();
+        auto call = arithmetic_function(innermost->op) != nullptr;
+        generate_operand(innermost->left, call ? lowest_precedence : operator_precedence(innermost->op));
+
+        for (auto it = chain.rbegin(); it != chain.rend(); it++) {
+            auto b = *it;
+            if (arithmetic_function(b->op)) {
+                sb->append_no_indent(", ");
+                generate_operand(b->right, lowest_precedence);
+                sb->append_no_indent(")");
+                continue;
+            }
+            sb->append_no_indent(" ");
+            sb->append_no_indent(operator_to_string(b->op));
+            sb->append_no_indent(" ");
+            // operators are left associative, so an equal precedence right
+            // operand needs parentheses
+            generate_operand(b->right, operator_precedence(b->op) + 1);
+        }
+    }
+
+    // the runtime function an integer operator is generated as, null for
+    // the operators C has no undefined behaviour for
+    const char* arithmetic_function(Operator op) {
+        switch (op) {
+            case Operator::Plus:
+                uses_arithmetic = true;
+                return "mango_add";
+            case Operator::Minus:
+                uses_arithmetic = true;
+                return "mango_sub";
+            case Operator::Multiply:
+                uses_arithmetic = true;
+                return "mango_mul";
+            case Operator::Divide:
+                uses_division = true;
+                return "mango_div";
+            default:
+                return nullptr;
+        }
+    }
+
+    void visit(IdentifierExpression* e) {
+        if (e->type == DataType::Function) {
+            std::cerr << "can't generate function values yet, only calls to " << e->value << "\n";
+            failed = true;
+        }
+        sb->append_no_indent(variable(e->declaration, e->value));
+    }
+
+    void visit(FunctionExpression* e) {
+        std::cerr << "can't generate function values yet, only functions declared with var\n";
+        failed = true;
+    }
+
+    void visit(FunctionCallExpression* e) {
+        if (is_print(e)) {
+            generate_print(e);
+            return;
+        }
+        if (!e->function) {
+            std::cerr << "can't call " << e->value << ", it isn't known which function it is\n";
+            failed = true;
+            return;
+        }
+
+        // a direct call, with the environment when the function has one
+        sb->append_no_indent(function_name(e->function));
+        sb->append_no_indent("(");
+        auto first = true;
+        if (!e->function->captures.empty()) {
+            sb->append_no_indent(capture_address(e->declaration, e->value));
+            first = false;
+        }
+        for (size_t i = 0; i < e->arguments.size(); i++) {
+            if (!first) {
+                sb->append_no_indent(", ");
+            }
+            first = false;
+            auto d = e->function->parameter_declarations[i];
+            generate_value(e->arguments[i], d->data_type, static_shape(d));
+        }
+        sb->append_no_indent(")");
+    }
+
+    void visit(UnaryExpression* e) {
+        sb->append_no_indent(operator_to_string(e->op));
+        auto parenthesize = e->argument->kind == NodeKind::BinaryExpression ||
+                            e->argument->kind == NodeKind::AssignmentExpression;
+        if (parenthesize) {
+            sb->append_no_indent("(");
+        }
+        visit(e->argument);
+        if (parenthesize) {
+            sb->append_no_indent(")");
+        }
+    }
+
+    void visit(IntegerLiteralExpression* e) {
+        sb->append_no_indent(std::to_string(e->value));
+    }
+
+    void visit(StringLiteralExpression* e) {
+        uses_strings = true;
+        auto it = literal_ids.try_emplace(e->value, literals.size()).first;
+        if (it->second == literals.size()) {
+            literals.push_back(e->value);
+        }
+        sb->append_no_indent("mango_literal_" + std::to_string(it->second));
+    }
+
+    void visit(BooleanLiteralExpression* e) {
+        uses_bool = true;
+        sb->append_no_indent(e->value ? "true" : "false");
+    }
+
+    void visit(ObjectExpression* e) {
+        auto name = "struct " + shape_name(e->shape);
+        if (!top_level) {
+            sb->append_no_indent("((" + name + "*) mango_copy(");
+        }
+
+        sb->append_no_indent("&(" + name + "){&" + shape_name(e->shape) + "_info");
+        for (size_t i = 0; i < e->properties.size(); i++) {
+            auto &field = e->shape->fields[i];
+            sb->append_no_indent(", ");
+            generate_value(e->properties[i].value, field.type, field.shape);
+        }
+        sb->append_no_indent("}");
+
+        if (!top_level) {
+            sb->append_no_indent(", sizeof(" + name + ")))");
+        }
+    }
+
+    void visit(ArrayExpression* e) {
+        auto type = array_type(e->element_type);
+        sb->append_no_indent(type + "_new(" + std::to_string(e->elements.size()) + ", ");
+        if (e->elements.empty()) {
+            sb->append_no_indent("NULL)");
+            return;
+        }
+
+        sb->append_no_indent("(");
+        sb->append_no_indent(c_type(e->element_type));
+        sb->append_no_indent("[]){");
+        for (size_t i = 0; i < e->elements.size(); i++) {
+            if (i > 0) {
+                sb->append_no_indent(", ");
+            }
+            visit(e->elements[i]);
+        }
+        sb->append_no_indent("})");
+    }
+
+    void visit(MemberExpression* e) {
+        auto object = variable(e->declaration, e->identifier);
+        if (e->computed) {
+            if (!is_array(e->declaration)) {
+                std::cerr << "can't generate indexing of " << e->identifier << ", it's not an array\n";
+                failed = true;
+            }
+
+            sb->append_no_indent(object);
+            sb->append_no_indent("->items[");
+            if (e->checked) {
+                sb->append_no_indent("mango_check(");
+                visit(e->property);
+                sb->append_no_indent(", ");
+                sb->append_no_indent(object);
+                sb->append_no_indent("->length)");
+            } else {
+                visit(e->property);
+            }
+            sb->append_no_indent("]");
+            return;
+        }
+        auto name = static_cast<IdentifierExpression*>(e->property)->value;
+
+        if (is_array(e->declaration) && name == "length") {
+            sb->append_no_indent("(int) ");
+            sb->append_no_indent(object);
+            sb->append_no_indent("->length");
+            return;
+        }
+
+        // a field of a known shape is at a fixed offset
+        if (static_shape(e->declaration)) {
+            sb->append_no_indent(object);
+            sb->append_no_indent("->");
+            sb->append_no_indent(name);
+            return;
+        }
+
+        sb->append_no_indent("(*(" + value_type(e->type, nullptr) + "*) mango_field((mango_object*) ");
+        sb->append_no_indent(object);
+        sb->append_no_indent(", \"");
+        sb->append_no_indent(name);
+        sb->append_no_indent("\", " + std::to_string(static_cast<int>(e->type)) + "))");
+    }
+
+    void visit(AssignmentExpression* e) {
+        if (e->left->kind == NodeKind::IdentifierExpression) {
+            auto id = static_cast<IdentifierExpression*>(e->left);
+            if (id->type == DataType::Function) {
+                std::cerr << "can't generate function values yet, " << id->value << " is assigned one\n";
+                failed = true;
+            }
+            sb->append_no_indent(variable(id->declaration, id->value));
+            sb->append_no_indent(" = ");
+            generate_value(e->right, id->type, static_shape(id->declaration));
+            return;
+        }
+
+        assert(e->left->kind == NodeKind::MemberExpression);
+        visit(e->left);
+        sb->append_no_indent(" = ");
+        generate_value(e->right, e->left->type, object_shape(e->left));
+    }
+
+    void visit(ExpressionStatement* s) {
+        sb->append("");
+        visit(s->value);
+        sb->append_no_indent(";");
+        sb->append_line("");
+    }
+
+    void visit(IfStatement* s) {
+        sb->append("if (");
+        visit(s->condition);
+        sb->append_line_no_indent(")");
+        visit(s->if_block);
+        if (s->else_block) {
+            sb->append_line("else");
+            visit(s->else_block);
+        }
+    }
+
+    void visit(WhileStatement* s) {
+        sb->append("while (");
+        visit(s->condition);
+        sb->append_line_no_indent(")");
+        visit(s->body);
+    }
+
+    void visit(ReturnStatement* s) {
+        sb->append("return");
+        if (s->value->kind != NodeKind::UndefinedExpression) {
+            sb->append_no_indent(" ");
+            auto type = current_function ? current_function->return_type : s->value->type;
+            generate_value(s->value, type, nullptr);
+        }
+        sb->append_line_no_indent(";");
+    }
+
+    void visit(DeclarationStatement* s) {
+        // functions are generated after main, what's left here is their
+        // environment if they have one
+        if (s->value->kind == NodeKind::FunctionExpression) {
+            auto f = static_cast<FunctionExpression*>(s->value);
+            function_name(f);
+            if (f->captures.empty()) {
+                return;
+            }
+
+            sb->append("struct " + environment_name(f) + " ");
+            sb->append_no_indent(s->identifier);
+            sb->append_no_indent(" = {");
+            for (size_t i = 0; i < f->captures.size(); i++) {
+                if (i > 0) {
+                    sb->append_no_indent(", ");
+                }
+                sb->append_no_indent(capture_address(f->captures[i], f->captures[i]->identifier));
+            }
+            sb->append_line_no_indent("};");
+            return;
+        }
+
+        sb->append(value_type(s->data_type, static_shape(s), s->element_type));
+        sb->append_no_indent(" ");
+        sb->append_no_indent(s->identifier);
+        if (s->value->kind != NodeKind::UndefinedExpression) {
+            sb->append_no_indent(" = ");
+            generate_value(s->value, s->data_type, static_shape(s));
+        }
+        sb->append_no_indent(";");
+        sb->append_line("");
+    }
+
+    void visit(BlockStatement* s) {
+        sb->append_line("{");
+        sb->increase_indent();
+
+        for (auto st : s->statements) {
+            visit(st);
+        }
+
+        sb->decrease_indent();
+        sb->append_line("}");
+    }
+
+    // The environment struct, prototype and definition of f, a top level C
+    // function taking the environment first when f captures anything.
+    // Generating it can find more functions.
+    void generate_function(const FunctionExpression* f, std::string &environments, std::string &prototypes,
+                           std::string &definitions) {
+        auto name = function_name(f);
+
+        std::string signature = "static ";
+        if (f->return_type == DataType::Undefined && !returns_value(f->body)) {
+            signature += "void";
+        } else {
+            signature += value_type(f->return_type, nullptr);
+        }
+        signature += " " + name + "(";
+
+        if (!f->captures.empty()) {
+            environments += "struct " + environment_name(f) + " {\n";
+            for (auto d : f->captures) {
+                environments += "  " + capture_type(d) + " " + std::string(d->identifier) + ";\n";
+            }
+            environments += "};\n\n";
+            signature += "struct " + environment_name(f) + "* env";
+        }
+        for (auto d : f->parameter_declarations) {
+            if (signature.back() != '(') {
+                signature += ", ";
+            }
+            signature += value_type(d->data_type, static_shape(d), d->element_type) + " " + std::string(d->identifier);
+        }
+        if (signature.back() == '(') {
+            signature += "void";
+        }
+        signature += ")";
+        prototypes += signature + ";\n";
+
+        string_builder::StringBuilder out;
+        auto outer_sb = sb;
+        auto outer_function = current_function;
+        auto outer_top_level = top_level;
+        sb = &out;
+        current_function = f;
+        top_level = false;
+
+        sb->append_line(signature);
+        visit(f->body);
+        sb->append_line("");
+
+        sb = outer_sb;
+        current_function = outer_function;
+        top_level = outer_top_level;
+        definitions += out.get_string();
+    }
+
+    // appends the struct and field table of shape to structs
+    void generate_shape(const Shape* shape, std::string &structs) {
+        string_builder::StringBuilder out;
+        auto outer_sb = sb;
+        sb = &out;
+        generate_shape_struct(shape);
+        sb = outer_sb;
+        structs += out.get_string();
+    }
+
+    void generate_shape_struct(const Shape* shape) {
+        auto name = shape_name(shape);
+        sb->append_line("struct " + name + " {");
+        sb->increase_indent();
+        sb->append_line("const mango_shape* _shape;");
+        for (auto &f : shape->fields) {
+            sb->append(value_type(f.type, f.shape, f.element_type));
+            sb->append_no_indent(" ");
+            sb->append_no_indent(f.name);
+            sb->append_line_no_indent(";");
+        }
+        sb->decrease_indent();
+        sb->append_line("};");
+        sb->append_line("");
+
+        if (shape->fields.empty()) {
+            sb->append_line("static const mango_shape " + name + "_info = {0, NULL};");
+            sb->append_line("");
+            return;
+        }
+
+        sb->append_line("static const mango_field_info " + name + "_fields[] = {");
+        sb->increase_indent();
+        for (auto &f : shape->fields) {
+            sb->append("{\"");
+            sb->append_no_indent(f.name);
+            sb->append_no_indent("\", offsetof(struct " + name + ", ");
+            sb->append_no_indent(f.name);
+            sb->append_line_no_indent("), " + std::to_string(static_cast<int>(f.type)) + "},");
+        }
+        sb->decrease_indent();
+        sb->append_line("};");
+        sb->append_line("static const mango_shape " + name + "_info = {" +
+            std::to_string(shape->fields.size()) + ", " + name + "_fields};");
+        sb->append_line("");
+    }
+};
+
+// the C definition of the index'th string literal, in read only storage
+static std::string literal(size_t index, std::string_view value) {
+    // FNV-1a, never 0 since that means the hash isn't known
+    uint32_t hash = 2166136261u;
+    std::string chars;
+    for (unsigned char c : value) {
+        hash = (hash ^ c) * 16777619u;
+        if (c == '"' || c == '\\') {
+            chars += '\\';
+            chars += static_cast<char>(c);
+        } else if (c < ' ' || c > '~') {
+            char escaped[5];
+            snprintf(escaped, sizeof(escaped), "\\%03o", c);
+            chars += escaped;
+        } else {
+            chars += static_cast<char>(c);
+        }
+    }
+    if (hash == 0) {
+        hash = 1;
+    }
+
+    return "static const mango_string mango_literal_" + std::to_string(index) + " = {" + std::to_string(value.size()) +
+           ", MANGO_INTERNED, " + std::to_string(hash) + "u, {.big = {\"" + chars + "\", NULL}}};\n";
+}
+
+std::string Program::generate() {
+    string_builder::StringBuilder sb;
+    CGenerator generator(&sb);
+
+    sb.append_line("int main() {");
+    sb.increase_indent();
+
+    for (auto s : statements) {
+        generator.top_level = s->kind == NodeKind::DeclarationStatement || s->kind == NodeKind::ExpressionStatement;
+        generator.visit(s);
+    }
+
+    sb.append_line("return 0;");
+
+    sb.decrease_indent();
+    sb.append_line("}");
+
+    std::string structs;
+    for (auto shape : shapes) {
+        generator.generate_shape(shape, structs);
+    }
+
+    std::string environments;
+    std::string prototypes;
+    std::string definitions;
+    for (size_t i = 0; i < generator.functions.size(); i++) {
+        generator.generate_function(generator.functions[i], environments, prototypes, definitions);
+    }
+    if (generator.failed) {
+        return "";
+    }
+    if (!prototypes.empty()) {
+        prototypes += "\n";
+    }
+
+    auto uses_arrays = !generator.array_types.empty();
+
+    std::string prelude;
+    if (generator.uses_bool) {
+        prelude += "#include <stdbool.h>\n";
+    }
+    if (!shapes.empty() || uses_arrays || generator.uses_strings || generator.uses_print || generator.uses_division) {
+        prelude += runtime_headers;
+    } else if (!prelude.empty()) {
+        prelude += "\n";
+    }
+    if (generator.uses_strings) {
+        prelude += string_runtime;
+        for (size_t i = 0; i < generator.literals.size(); i++) {
+            prelude += literal(i, generator.literals[i]);
+        }
+        prelude += generator.literals.empty() ? "" : "\n";
+    }
+    if (generator.uses_print) {
+        prelude += print_runtime;
+    }
+    if (generator.uses_arithmetic) {
+        prelude += arithmetic_runtime;
+    }
+    if (generator.uses_division) {
+        prelude += division_runtime;
+    }
+    if (!shapes.empty()) {
+        prelude += object_runtime;
+    }
+    if (uses_arrays) {
+        prelude += array_runtime;
+        for (auto &type : generator.array_types) {
+            prelude += "MANGO_ARRAY(" + type + ")\n";
+        }
+        prelude += "\n";
+    }
+    return prelude + structs + environments + prototypes + definitions + sb.get_string();
+}
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "token.h"
+
+namespace mango {
+
+// what the lexer should do when it sees a character at the start of a token
+enum class CharKind : uint8_t {
+    Invalid,
+    Whitespace,
+    NewLine,
+    IdentifierStart,
+    Digit,
+    Quote,
+    Punctuation,
+};
+
+struct CharClass {
+    CharKind kind = CharKind::Invalid;
+    bool identifier_continue = false;
+    TokenType token = TokenType::EndOfFile;
+};
+
+constexpr std::array<CharClass, 256> make_char_classes() {
+    std::array<CharClass, 256> table{};
+
+    for (int c = 'a'; c <= 'z'; c++) {
+        table[c] = {CharKind::IdentifierStart, true};
+    }
+
+    for (int c = 'A'; c <= 'Z'; c++) {
+        table[c] = {CharKind::IdentifierStart, true};
+    }
+
+    for (int c = '0'; c <= '9'; c++) {
+        table[c] = {CharKind::Digit, true};
+    }
+
+    table['_'] = {CharKind::Invalid, true};
+
+    table[' '] = {CharKind::Whitespace};
+    table['\t'] = {CharKind::Whitespace};
+    table['\r'] = {CharKind::Whitespace};
+    table['\n'] = {CharKind::NewLine};
+    table['"'] = {CharKind::Quote};
+
+    table[':'] = {CharKind::Punctuation, false, TokenType::Colon};
+    table[';'] = {CharKind::Punctuation, false, TokenType::SemiColon};
+    table[','] = {CharKind::Punctuation, false, TokenType::Comma};
+    table['.'] = {CharKind::Punctuation, false, TokenType::Dot};
+    table['='] = {CharKind::Punctuation, false, TokenType::Equals};
+    table['('] = {CharKind::Punctuation, false, TokenType::LeftParen};
+    table[')'] = {CharKind::Punctuation, false, TokenType::RightParen};
+    table['{'] = {CharKind::Punctuation, false, TokenType::LeftBrace};
+    table['}'] = {CharKind::Punctuation, false, TokenType::RightBrace};
+    table['<'] = {CharKind::Punctuation, false, TokenType::LeftAngleBracket};
+    table['>'] = {CharKind::Punctuation, false, TokenType::RightAngleBracket};
+    table['+'] = {CharKind::Punctuation, false, TokenType::Plus};
+    table['-'] = {CharKind::Punctuation, false, TokenType::Minus};
+    table['*'] = {CharKind::Punctuation, false, TokenType::Asterisk};
+    table['/'] = {CharKind::Punctuation, false, TokenType::Slash};
+    table['!'] = {CharKind::Punctuation, false, TokenType::Exclamation};
+    table['&'] = {CharKind::Punctuation, false, TokenType::Ampersand};
+    table['|'] = {CharKind::Punctuation, false, TokenType::Pipe};
+    table['['] = {CharKind::Punctuation, false, TokenType::LeftBracket};
+    table[']'] = {CharKind::Punctuation, false, TokenType::RightBracket};
+
+    return table;
+}
+
+inline constexpr std::array<CharClass, 256> char_classes = make_char_classes();
+
+inline const CharClass &char_class(char c) {
+    return char_classes[static_cast<unsigned char>(c)];
+}
+
+}
@@ -0,0 +1,192 @@
+#include "closures.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "uses.h"
+
+namespace mango {
+
+class ClosureResolver : public Visitor<ClosureResolver> {
+    // the function each variable is declared in, null for the program
+    std::unordered_map<const DeclarationStatement*, const FunctionExpression*> owners;
+    std::unordered_set<const DeclarationStatement*> assigned;
+    // the functions being visited, innermost last
+    std::vector<FunctionExpression*> open;
+
+    // every function between the use and d's declaration captures d
+    void reference(const DeclarationStatement* d) {
+        if (!d) {
+            return;
+        }
+
+        auto it = owners.find(d);
+        auto owner = it == owners.end() ? nullptr : it->second;
+        for (auto i = open.size(); i-- > 0;) {
+            auto f = open[i];
+            // a function calling itself doesn't need to capture itself
+            if (f == owner || f->declaration == d) {
+                break;
+            }
+            auto &list = captures[f];
+            if (std::find(list.begin(), list.end(), d) == list.end()) {
+                list.push_back(d);
+            }
+        }
+    }
+
+public:
+    // every function, in the order they're declared
+    std::vector<FunctionExpression*> functions;
+    std::unordered_map<const FunctionExpression*, std::vector<const DeclarationStatement*>> captures;
+
+    explicit ClosureResolver(const Uses &uses) {
+        for (auto e : uses.assignments) {
+            if (e->left->kind == NodeKind::IdentifierExpression) {
+                assigned.insert(static_cast<IdentifierExpression*>(e->left)->declaration);
+            }
+        }
+    }
+
+    // the function calls through d always call, if there is one
+    const FunctionExpression* known_function(const DeclarationStatement* d) const {
+        if (!d || d->value->kind != NodeKind::FunctionExpression || assigned.count(d)) {
+            return nullptr;
+        }
+        return static_cast<const FunctionExpression*>(d->value);
+    }
+
+    using Visitor::visit;
+
+    void visit(UndefinedExpression* e) {}
+    void visit(IntegerLiteralExpression* e) {}
+    void visit(StringLiteralExpression* e) {}
+    void visit(BooleanLiteralExpression* e) {}
+
+    void visit(IdentifierExpression* e) {
+        reference(e->declaration);
+    }
+
+    void visit(FunctionExpression* e) {
+        functions.push_back(e);
+        captures[e];
+        for (auto d : e->parameter_declarations) {
+            owners[d] = e;
+        }
+
+        open.push_back(e);
+        visit(e->body);
+        open.pop_back();
+    }
+
+    void visit(ObjectExpression* e) {
+        for (auto &p : e->properties) {
+            visit(p.value);
+        }
+    }
+
+    void visit(ArrayExpression* e) {
+        for (auto element : e->elements) {
+            visit(element);
+        }
+    }
+
+    void visit(MemberExpression* e) {
+        reference(e->declaration);
+        if (e->computed) {
+            visit(e->property);
+        }
+    }
+
+    void visit(FunctionCallExpression* e) {
+        for (auto arg : e->arguments) {
+            visit(arg);
+        }
+        e->function = known_function(e->declaration);
+        reference(e->declaration);
+    }
+
+    void visit(BinaryExpression* e) {
+        walk_left_chain(e, [this](Expression* left) { visit(left); },
+                        [this](BinaryExpression* b) { visit(b->right); });
+    }
+
+    void visit(UnaryExpression* e) {
+        visit(e->argument);
+    }
+
+    void visit(AssignmentExpression* e) {
+        visit(e->left);
+        visit(e->right);
+    }
+
+    void visit(BlockStatement* s) {
+        for (auto st : s->statements) {
+            visit(st);
+        }
+    }
+
+    void visit(DeclarationStatement* s) {
+        owners[s] = open.empty() ? nullptr : open.back();
+        if (s->value->kind == NodeKind::FunctionExpression) {
+            static_cast<FunctionExpression*>(s->value)->declaration = s;
+        }
+        visit(s->value);
+    }
+
+    void visit(ReturnStatement* s) { visit(s->value); }
+    void visit(ExpressionStatement* s) { visit(s->value); }
+
+    void visit(IfStatement* s) {
+        visit(s->condition);
+        visit(s->if_block);
+        if (s->else_block) {
+            visit(s->else_block);
+        }
+    }
+
+    void visit(WhileStatement* s) {
+        visit(s->condition);
+        visit(s->body);
+    }
+};
+
+void resolve_closures(Program &program) {
+    Uses uses;
+    for (auto s : program.statements) {
+        uses.visit(s);
+    }
+
+    ClosureResolver resolver(uses);
+    for (auto s : program.statements) {
+        resolver.visit(s);
+    }
+
+    // Calling a known function means capturing it, but that only matters
+    // if it captures something itself, which isn't known until its whole
+    // body has been visited. Drop the ones that turned out not to.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto f : resolver.functions) {
+            auto &list = resolver.captures[f];
+            auto end = std::remove_if(list.begin(), list.end(), [&](const DeclarationStatement* d) {
+                auto known = resolver.known_function(d);
+                return known && resolver.captures[known].empty();
+            });
+            if (end != list.end()) {
+                list.erase(end, list.end());
+                changed = true;
+            }
+        }
+    }
+
+    for (auto f : resolver.functions) {
+        auto &list = resolver.captures[f];
+        f->captures = program.arena.copy_array<const DeclarationStatement*>(list.begin(), list.end());
+    }
+}
+
+}
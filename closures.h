@@ -0,0 +1,15 @@
+#pragma once
+
+#include "ast.h"
+
+namespace mango {
+
+// Works out which variables each function uses from the functions (or
+// the program) around it, FunctionExpression::captures, and which calls
+// go to a function known before the program runs, those made through a
+// variable declared with a function and never assigned. A function that
+// calls a known function that captures something captures that function
+// too, since the call needs what it captured. Runs after infer_types.
+void resolve_closures(Program &program);
+
+}
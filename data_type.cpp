@@ -1,5 +1,6 @@
 #include "data_type.h"
 
+#include <cassert>
 #include <unordered_map>
 #include <iostream>
 
@@ -9,6 +10,8 @@ auto data_type_string_lookup = std::unordered_map<DataType, std::string>{
         {DataType::Integer,   "integer"},
         {DataType::Function,  "function"},
         {DataType::Bool,      "bool"},
+        {DataType::Object,    "object"},
+        {DataType::Array,     "array"},
 };
 
 std::string data_type_to_string(const DataType dt) {
@@ -1,8 +1,9 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 
-enum class DataType {
+enum class DataType : uint8_t {
     Undefined,
     Integer,
 //    Float,
@@ -0,0 +1,849 @@
+#include "evaluate.h"
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+
+#include "types.h"
+#include "uses.h"
+#include "value.h"
+
+namespace mango {
+
+namespace {
+
+// the lowest address the running thread's stack can grow down to, nullptr
+// where that can't be found out. looking it up reads /proc for the main
+// thread, so it's done once per thread
+const char* machine_stack_bottom() {
+#if defined(__linux__)
+    thread_local const char* bottom = [] {
+        pthread_attr_t attributes;
+        if (pthread_getattr_np(pthread_self(), &attributes) != 0) {
+            return static_cast<const char*>(nullptr);
+        }
+        void* address = nullptr;
+        size_t size = 0;
+        pthread_attr_getstack(&attributes, &address, &size);
+        pthread_attr_destroy(&attributes);
+        return static_cast<const char*>(address);
+    }();
+    return bottom;
+#else
+    return nullptr;
+#endif
+}
+
+Value undefined() {
+    Value v;
+    v.type = ValueType::Undefined;
+    return v;
+}
+
+Value integer(int32_t i) {
+    Value v;
+    v.type = ValueType::Integer;
+    v.integer = i;
+    return v;
+}
+
+Value boolean(bool b) {
+    Value v;
+    v.type = ValueType::Bool;
+    v.boolean = b;
+    return v;
+}
+
+Value function_value(ClosureValue* closure) {
+    Value v;
+    v.type = ValueType::Function;
+    v.closure = closure;
+    return v;
+}
+
+int32_t wrap(uint32_t v) {
+    return static_cast<int32_t>(v);
+}
+
+// What the evaluator keeps for each node of some kind, looked up by the
+// node's address. Reads are on every variable use, so it's open addressed
+// with a multiplicative hash instead of an unordered_map's buckets.
+template<typename Node, typename T>
+class NodeMap {
+    struct Entry {
+        const Node* node = nullptr;
+        T value{};
+    };
+
+    std::vector<Entry> entries = std::vector<Entry>(16);
+    size_t count = 0;
+    // 64 minus log2 of the table size, the top bits of the hash index it
+    int shift = 60;
+
+    size_t find(const Node* node) const {
+        auto i = static_cast<size_t>((reinterpret_cast<uintptr_t>(node) * 0x9e3779b97f4a7c15ull) >> shift);
+        while (entries[i].node != node && entries[i].node) {
+            i = (i + 1) & (entries.size() - 1);
+        }
+        return i;
+    }
+
+public:
+    T &operator[](const Node* node) {
+        auto i = find(node);
+        if (entries[i].node) {
+            return entries[i].value;
+        }
+        // kept at most half full so probes stay short
+        if (2 * (count + 1) > entries.size()) {
+            auto old = std::move(entries);
+            entries = std::vector<Entry>(old.size() * 2);
+            shift--;
+            for (auto &e : old) {
+                if (e.node) {
+                    entries[find(e.node)] = e;
+                }
+            }
+            i = find(node);
+        }
+        count++;
+        entries[i].node = node;
+        return entries[i].value;
+    }
+
+    // node must be in the map
+    const T &at(const Node* node) const { return entries[find(node)].value; }
+};
+
+// where the evaluator finds a variable when the program runs
+enum class SlotKind : uint8_t {
+    // in the running function's frame
+    Local,
+    // in a cell in the running function's frame, some function captures it
+    Cell,
+    // one of the running function's captures
+    Capture,
+    // the running function itself
+    Self,
+    // a function that captures nothing, index is which
+    Function,
+};
+
+struct Slot {
+    SlotKind kind = SlotKind::Local;
+    uint32_t index = 0;
+};
+
+// the field a member expression last found and the shape it was found in
+struct FieldCache {
+    const Shape* shape = nullptr;
+    int field = -1;
+};
+
+struct FunctionInfo {
+    // null for the top level
+    const FunctionExpression* expression;
+    // the size of the function's frame
+    uint32_t slots = 0;
+    // where each variable the function captures is in the function that
+    // makes it, a Cell, Capture or Self
+    std::vector<Slot> captures;
+    std::vector<uint32_t> boxed_parameters;
+};
+
+// Gives every declaration a slot in its function's frame and every use of
+// a variable the slot it's in, seen from the function using it.
+class SlotResolver : public Visitor<SlotResolver> {
+    std::unordered_set<const DeclarationStatement*> boxed;
+    std::unordered_map<const DeclarationStatement*, uint32_t> owners;
+    // the functions being resolved, innermost last
+    std::vector<uint32_t> open;
+    // the names reported as undeclared
+    std::unordered_set<std::string_view> unresolved;
+
+    FunctionInfo &current() { return functions[open.back()]; }
+
+    Slot declare(DeclarationStatement* d) {
+        auto &f = current();
+        Slot slot{boxed.count(d) ? SlotKind::Cell : SlotKind::Local, f.slots++};
+        declarations[d] = slot;
+        owners[d] = open.back();
+        return slot;
+    }
+
+    Slot locate(const DeclarationStatement* d, std::string_view name) {
+        if (d) {
+            auto owner = owners.find(d);
+            if (owner != owners.end() && owner->second == open.back()) {
+                return declarations.at(d);
+            }
+            auto f = current().expression;
+            if (f) {
+                for (size_t i = 0; i < f->captures.size(); i++) {
+                    if (f->captures[i] == d) {
+                        return {SlotKind::Capture, static_cast<uint32_t>(i)};
+                    }
+                }
+                if (d == f->declaration && !f->captures.empty()) {
+                    return {SlotKind::Self, 0};
+                }
+            }
+            // functions that capture nothing aren't captured, they're the
+            // same wherever they're used from
+            if (d->value->kind == NodeKind::FunctionExpression) {
+                auto it = ids.find(static_cast<FunctionExpression*>(d->value));
+                if (it != ids.end()) {
+                    return {SlotKind::Function, it->second};
+                }
+            }
+        }
+
+        // a name is located more than once as it's resolved, say so once
+        if (unresolved.insert(name).second) {
+            std::cerr << "can't find " << name << "\n";
+        }
+        failed = true;
+        assert(false);
+        return {};
+    }
+
+public:
+    // set when a name can't be resolved, the reason is printed where it's
+    // found
+    bool failed = false;
+    // functions[0] is the top level
+    std::vector<FunctionInfo> functions{FunctionInfo{nullptr}};
+    std::unordered_map<const FunctionExpression*, uint32_t> ids;
+    // where each variable is in its function's frame, a Local or a Cell
+    NodeMap<DeclarationStatement, Slot> declarations;
+    // the variable each identifier, member and call expression uses, seen
+    // from the function it's in
+    NodeMap<Expression, Slot> variables;
+    // the fields of objects whose shape is known before the program runs
+    NodeMap<MemberExpression, FieldCache> fields;
+
+    explicit SlotResolver(Program &program) {
+        Uses uses;
+        for (auto s : program.statements) {
+            uses.visit(s);
+        }
+        for (auto f : uses.functions) {
+            boxed.insert(f->captures.begin(), f->captures.end());
+        }
+        open.push_back(0);
+    }
+
+    using Visitor::visit;
+
+    void visit(UndefinedExpression* e) {}
+    void visit(IntegerLiteralExpression* e) {}
+    void visit(StringLiteralExpression* e) {}
+    void visit(BooleanLiteralExpression* e) {}
+
+    void visit(IdentifierExpression* e) { variables[e] = locate(e->declaration, e->value); }
+
+    void visit(FunctionExpression* e) {
+        auto id = static_cast<uint32_t>(functions.size());
+        ids.emplace(e, id);
+        FunctionInfo info{e};
+        for (auto d : e->captures) {
+            info.captures.push_back(locate(d, d->identifier));
+        }
+        functions.push_back(std::move(info));
+
+        open.push_back(id);
+        for (auto d : e->parameter_declarations) {
+            auto slot = declare(d);
+            if (slot.kind == SlotKind::Cell) {
+                current().boxed_parameters.push_back(slot.index);
+            }
+        }
+        visit(e->body);
+        open.pop_back();
+    }
+
+    void visit(ObjectExpression* e) {
+        for (auto &p : e->properties) {
+            visit(p.value);
+        }
+    }
+
+    void visit(ArrayExpression* e) {
+        for (auto element : e->elements) {
+            visit(element);
+        }
+    }
+
+    void visit(MemberExpression* e) {
+        variables[e] = locate(e->declaration, e->identifier);
+        if (e->computed) {
+            visit(e->property);
+            return;
+        }
+        // fields of objects whose shape is known are found without a lookup
+        auto d = e->declaration;
+        if (d && d->shape && !d->dynamic_shape) {
+            fields[e] = {d->shape, d->shape->field(static_cast<IdentifierExpression*>(e->property)->value)};
+        }
+    }
+
+    void visit(FunctionCallExpression* e) {
+        for (auto arg : e->arguments) {
+            visit(arg);
+        }
+        if (is_print(e)) {
+            return;
+        }
+        if (!e->declaration) {
+            std::cerr << "can't call " << e->value << ", it isn't declared\n";
+            failed = true;
+            assert(false);
+            return;
+        }
+        if (e->function && e->function->captures.empty()) {
+            variables[e] = {SlotKind::Function, ids.at(e->function)};
+        } else {
+            variables[e] = locate(e->declaration, e->value);
+        }
+    }
+
+    void visit(BinaryExpression* e) {
+        walk_left_chain(e, [this](Expression* left) { visit(left); },
+                        [this](BinaryExpression* b) { visit(b->right); });
+    }
+
+    void visit(UnaryExpression* e) { visit(e->argument); }
+
+    void visit(AssignmentExpression* e) {
+        visit(e->left);
+        visit(e->right);
+    }
+
+    void visit(BlockStatement* s) {
+        for (auto st : s->statements) {
+            visit(st);
+        }
+    }
+
+    void visit(DeclarationStatement* s) {
+        // declared first so a function can call itself
+        declare(s);
+        visit(s->value);
+    }
+
+    void visit(ReturnStatement* s) { visit(s->value); }
+    void visit(ExpressionStatement* s) { visit(s->value); }
+
+    void visit(IfStatement* s) {
+        visit(s->condition);
+        visit(s->if_block);
+        if (s->else_block) {
+            visit(s->else_block);
+        }
+    }
+
+    void visit(WhileStatement* s) {
+        visit(s->condition);
+        visit(s->body);
+    }
+};
+
+// what running a statement did
+enum class Flow : uint8_t {
+    Next,
+    Return,
+    Fail,
+};
+
+class Evaluator : public Visitor<Evaluator, Value, Flow> {
+    static constexpr size_t stack_size = 1 << 20;
+    // Calls are walked on the C++ stack, so how deep they can go depends on
+    // how big it is. A call fails once the stack is within reserve bytes of
+    // its end, what's left is for the statements and expressions of the
+    // innermost call. Where the end can't be found calls stop at max_depth,
+    // which fits in 1MB.
+    static constexpr size_t machine_stack_reserve = 512 << 10;
+    static constexpr size_t max_depth = 2000;
+
+    FILE* out;
+    const std::vector<FunctionInfo> &functions;
+    const std::unordered_map<const FunctionExpression*, uint32_t> &ids;
+    const NodeMap<DeclarationStatement, Slot> &declarations;
+    const NodeMap<Expression, Slot> &variables;
+    // the field each member expression found last, for the next object
+    // with the same shape
+    NodeMap<MemberExpression, FieldCache> fields;
+    Arena heap;
+    std::unique_ptr<Value[]> stack;
+    Value* stack_end;
+    // the running function's frame and the free slots after it
+    Value* frame;
+    Value* top;
+    ClosureValue* closure = nullptr;
+    size_t depth = 0;
+    // nullptr when calls are limited by max_depth instead
+    const char* machine_stack_limit;
+    // functions that capture nothing need only one closure each
+    std::vector<ClosureValue*> plain;
+    Value returned;
+    bool failed = false;
+
+    // reports an error, the program stops at the end of the statement
+    template<typename... Args>
+    Value fail(const Args &... args) {
+        if (!failed) {
+            fflush(out);
+            (std::cerr << ... << args) << "\n";
+            failed = true;
+        }
+        return undefined();
+    }
+
+    Value* values(size_t n) {
+        return static_cast<Value*>(heap.allocate(sizeof(Value) * n, alignof(Value)));
+    }
+
+    ClosureValue* make_closure(uint32_t id) {
+        auto &f = functions[id];
+        auto made = heap.make<ClosureValue>();
+        made->function = id;
+        made->cells = nullptr;
+        if (!f.captures.empty()) {
+            made->cells = static_cast<Cell**>(heap.allocate(sizeof(Cell*) * f.captures.size(), alignof(Cell*)));
+        }
+        for (size_t i = 0; i < f.captures.size(); i++) {
+            auto &slot = f.captures[i];
+            if (slot.kind == SlotKind::Cell) {
+                made->cells[i] = frame[slot.index].cell;
+            } else if (slot.kind == SlotKind::Capture) {
+                made->cells[i] = closure->cells[slot.index];
+            } else {
+                auto cell = heap.make<Cell>();
+                cell->value = function_value(closure);
+                made->cells[i] = cell;
+            }
+        }
+        return made;
+    }
+
+    Value read(const Slot &slot) {
+        switch (slot.kind) {
+            case SlotKind::Local:
+                return frame[slot.index];
+            case SlotKind::Cell:
+                return frame[slot.index].cell->value;
+            case SlotKind::Capture:
+                return closure->cells[slot.index]->value;
+            case SlotKind::Self:
+                return function_value(closure);
+            case SlotKind::Function:
+                if (!plain[slot.index]) {
+                    plain[slot.index] = make_closure(slot.index);
+                }
+                return function_value(plain[slot.index]);
+        }
+        return undefined();
+    }
+
+    void write(const Slot &slot, const Value &v) {
+        switch (slot.kind) {
+            case SlotKind::Local:
+                frame[slot.index] = v;
+                break;
+            case SlotKind::Cell:
+                frame[slot.index].cell->value = v;
+                break;
+            case SlotKind::Capture:
+                closure->cells[slot.index]->value = v;
+                break;
+            default:
+                break;
+        }
+    }
+
+    // the index of the field called name in object, remembered for e for
+    // the next object with the same shape
+    int field(MemberExpression* e, ObjectValue* object) {
+        auto &cache = fields[e];
+        if (object->shape != cache.shape) {
+            cache.shape = object->shape;
+            cache.field = object->shape->field(static_cast<IdentifierExpression*>(e->property)->value);
+        }
+        return cache.field;
+    }
+
+    // the element of array a that index is, null when it isn't one
+    Value* element(const Value &a, const Value &index) {
+        if (a.type != ValueType::Array || index.type != ValueType::Integer) {
+            fail("can't index ", type_name(a.type), " with ", type_name(index.type));
+            return nullptr;
+        }
+        if (static_cast<uint32_t>(index.integer) >= a.array->length) {
+            fail("index ", index.integer, " is out of bounds of an array of length ", a.array->length);
+            return nullptr;
+        }
+        return &a.array->items[index.integer];
+    }
+
+    Value call(FunctionCallExpression* e, uint32_t id, ClosureValue* called) {
+        auto &f = functions[id];
+        if (e->arguments.size() != f.expression->parameters.size()) {
+            return fail(e->value, " takes ", f.expression->parameters.size(), " arguments but got ",
+                        e->arguments.size());
+        }
+        auto machine_stack_low = machine_stack_limit
+                                         ? static_cast<const char*>(__builtin_frame_address(0)) < machine_stack_limit
+                                         : depth == max_depth;
+        if (machine_stack_low || top + f.slots > stack_end) {
+            return fail("stack overflow");
+        }
+
+        // the arguments go straight into the new frame, which is claimed
+        // first so calls made while working them out go after it
+        auto callee = top;
+        top += f.slots;
+        for (size_t i = 0; i < e->arguments.size(); i++) {
+            callee[i] = visit(e->arguments[i]);
+        }
+        if (failed) {
+            top = callee;
+            return undefined();
+        }
+        for (auto slot : f.boxed_parameters) {
+            auto cell = heap.make<Cell>();
+            cell->value = callee[slot];
+            callee[slot].type = ValueType::Cell;
+            callee[slot].cell = cell;
+        }
+
+        auto caller_frame = frame;
+        auto caller_closure = closure;
+        frame = callee;
+        closure = called;
+        depth++;
+        auto flow = visit(f.expression->body);
+        depth--;
+        frame = caller_frame;
+        closure = caller_closure;
+        top = callee;
+        return flow == Flow::Return ? returned : undefined();
+    }
+
+    // b's operator applied to left and b's right operand
+    Value operate(BinaryExpression* b, const Value &left) {
+        if (b->op == Operator::And) {
+            return boolean(truthy(left) && truthy(visit(b->right)));
+        }
+        if (b->op == Operator::Or) {
+            return boolean(truthy(left) || truthy(visit(b->right)));
+        }
+        return binary(b->op, left, visit(b->right));
+    }
+
+    Value binary(Operator op, const Value &x, const Value &y) {
+        auto integers = x.type == ValueType::Integer && y.type == ValueType::Integer;
+        switch (op) {
+            case Operator::Plus:
+                if (integers) {
+                    return integer(wrap(static_cast<uint32_t>(x.integer) + static_cast<uint32_t>(y.integer)));
+                }
+                if (x.type == ValueType::String || y.type == ValueType::String) {
+                    auto v = concat(heap, x, y);
+                    failed |= v.type == ValueType::Undefined;
+                    return v;
+                }
+                return fail("can't add ", type_name(x.type), " and ", type_name(y.type));
+            case Operator::EqualTo:
+                return boolean(equal(x, y));
+            case Operator::NotEqualTo:
+                return boolean(!equal(x, y));
+            default:
+                break;
+        }
+
+        if (!integers) {
+            const char* what = op == Operator::Minus      ? "subtract"
+                               : op == Operator::Multiply ? "multiply"
+                               : op == Operator::Divide   ? "divide"
+                                                          : "compare";
+            return fail("can't ", what, " ", type_name(x.type), " and ", type_name(y.type));
+        }
+        auto l = x.integer;
+        auto r = y.integer;
+        switch (op) {
+            case Operator::Minus:
+                return integer(wrap(static_cast<uint32_t>(l) - static_cast<uint32_t>(r)));
+            case Operator::Multiply:
+                return integer(wrap(static_cast<uint32_t>(l) * static_cast<uint32_t>(r)));
+            case Operator::Divide:
+                if (r == 0) {
+                    return fail("division by zero");
+                }
+                // INT_MIN / -1 overflows, wrap it around like the rest
+                return integer(r == -1 ? wrap(0u - static_cast<uint32_t>(l)) : l / r);
+            case Operator::LessThan:
+                return boolean(l < r);
+            case Operator::LessThanOrEqualTo:
+                return boolean(l <= r);
+            case Operator::GreaterThan:
+                return boolean(l > r);
+            case Operator::GreaterThanOrEqualTo:
+                return boolean(l >= r);
+            default:
+                return fail("not a binary operator ", op);
+        }
+    }
+
+public:
+    Evaluator(FILE* out, SlotResolver &resolver)
+            : out(out), functions(resolver.functions), ids(resolver.ids), declarations(resolver.declarations),
+              variables(resolver.variables), fields(std::move(resolver.fields)), stack(new Value[stack_size]),
+              stack_end(stack.get() + stack_size), frame(stack.get()), top(stack.get()),
+              plain(resolver.functions.size(), nullptr) {
+        auto bottom = machine_stack_bottom();
+        machine_stack_limit = bottom ? bottom + machine_stack_reserve : nullptr;
+    }
+
+    bool run(Program &program) {
+        if (functions[0].slots > stack_size) {
+            fail("stack overflow");
+            return false;
+        }
+        top = frame + functions[0].slots;
+        for (auto s : program.statements) {
+            auto flow = visit(s);
+            if (flow != Flow::Next) {
+                break;
+            }
+        }
+        fflush(out);
+        return !failed;
+    }
+
+    using Visitor::visit;
+
+    Value visit(UndefinedExpression* e) { return undefined(); }
+    Value visit(IntegerLiteralExpression* e) { return integer(e->value); }
+    Value visit(BooleanLiteralExpression* e) { return boolean(e->value); }
+    Value visit(IdentifierExpression* e) { return read(variables.at(e)); }
+
+    Value visit(StringLiteralExpression* e) {
+        Value v;
+        v.type = ValueType::String;
+        v.buffered = false;
+        v.length = static_cast<uint32_t>(e->value.size());
+        v.chars = e->value.data();
+        return v;
+    }
+
+    Value visit(FunctionExpression* e) { return function_value(make_closure(ids.at(e))); }
+
+    Value visit(ObjectExpression* e) {
+        auto object = heap.make<ObjectValue>();
+        object->shape = e->shape;
+        object->fields = values(e->properties.size());
+        for (size_t i = 0; i < e->properties.size(); i++) {
+            object->fields[i] = visit(e->properties[i].value);
+        }
+        Value v;
+        v.type = ValueType::Object;
+        v.object = object;
+        return v;
+    }
+
+    Value visit(ArrayExpression* e) {
+        auto array = heap.make<ArrayValue>();
+        array->length = static_cast<uint32_t>(e->elements.size());
+        array->items = values(e->elements.size());
+        for (size_t i = 0; i < e->elements.size(); i++) {
+            array->items[i] = visit(e->elements[i]);
+        }
+        Value v;
+        v.type = ValueType::Array;
+        v.array = array;
+        return v;
+    }
+
+    Value visit(MemberExpression* e) {
+        auto object = read(variables.at(e));
+        if (e->computed) {
+            auto index = visit(e->property);
+            auto item = element(object, index);
+            return item ? *item : undefined();
+        }
+
+        auto name = static_cast<IdentifierExpression*>(e->property)->value;
+        if (object.type == ValueType::Object) {
+            auto i = field(e, object.object);
+            return i >= 0 ? object.object->fields[i] : fail("object has no field ", name);
+        }
+        if (object.type == ValueType::Array && name == "length") {
+            return integer(static_cast<int32_t>(object.array->length));
+        }
+        return fail("can't get ", name, " of ", type_name(object.type));
+    }
+
+    Value visit(FunctionCallExpression* e) {
+        if (is_print(e)) {
+            // all the arguments are worked out before any are printed
+            auto first = top;
+            if (top + e->arguments.size() > stack_end) {
+                return fail("stack overflow");
+            }
+            top += e->arguments.size();
+            for (size_t i = 0; i < e->arguments.size(); i++) {
+                first[i] = visit(e->arguments[i]);
+            }
+            if (!failed) {
+                for (size_t i = 0; i < e->arguments.size(); i++) {
+                    if (i > 0) {
+                        fputc(' ', out);
+                    }
+                    print_value(out, first[i]);
+                }
+                fputc('\n', out);
+            }
+            top = first;
+            return undefined();
+        }
+
+        auto &slot = variables.at(e);
+        if (slot.kind == SlotKind::Function) {
+            return call(e, slot.index, nullptr);
+        }
+        auto callee = read(slot);
+        if (callee.type != ValueType::Function) {
+            return fail("can't call ", type_name(callee.type));
+        }
+        return call(e, callee.closure->function, callee.closure);
+    }
+
+    Value visit(BinaryExpression* e) {
+        if (e->left->kind != NodeKind::BinaryExpression) {
+            return operate(e, visit(e->left));
+        }
+
+        Value value;
+        walk_left_chain(e, [&](Expression* left) { value = visit(left); },
+                        [&](BinaryExpression* b) {
+                            if (!failed) {
+                                value = operate(b, value);
+                            }
+                        });
+        return value;
+    }
+
+    Value visit(UnaryExpression* e) { return boolean(!truthy(visit(e->argument))); }
+
+    Value visit(AssignmentExpression* e) {
+        if (e->left->kind == NodeKind::IdentifierExpression) {
+            auto value = visit(e->right);
+            write(variables.at(e->left), value);
+            return value;
+        }
+
+        auto left = static_cast<MemberExpression*>(e->left);
+        auto object = read(variables.at(left));
+        if (left->computed) {
+            auto index = visit(left->property);
+            auto value = visit(e->right);
+            if (auto item = failed ? nullptr : element(object, index)) {
+                *item = value;
+            }
+            return value;
+        }
+
+        auto value = visit(e->right);
+        auto name = static_cast<IdentifierExpression*>(left->property)->value;
+        if (object.type != ValueType::Object) {
+            return fail("can't set ", name, " of ", type_name(object.type));
+        }
+        auto i = field(left, object.object);
+        if (i < 0) {
+            return fail("object has no field ", name);
+        }
+        object.object->fields[i] = value;
+        return value;
+    }
+
+    Flow visit(BlockStatement* s) {
+        for (auto st : s->statements) {
+            auto flow = visit(st);
+            if (flow != Flow::Next) {
+                return flow;
+            }
+        }
+        return Flow::Next;
+    }
+
+    Flow visit(DeclarationStatement* s) {
+        auto value = visit(s->value);
+        auto &slot = declarations.at(s);
+        if (slot.kind == SlotKind::Cell) {
+            auto cell = heap.make<Cell>();
+            cell->value = value;
+            value.type = ValueType::Cell;
+            value.cell = cell;
+        }
+        frame[slot.index] = value;
+        return failed ? Flow::Fail : Flow::Next;
+    }
+
+    Flow visit(ReturnStatement* s) {
+        returned = visit(s->value);
+        return failed ? Flow::Fail : Flow::Return;
+    }
+
+    Flow visit(IfStatement* s) {
+        auto condition = truthy(visit(s->condition));
+        if (failed) {
+            return Flow::Fail;
+        }
+        if (condition) {
+            return visit(s->if_block);
+        }
+        return s->else_block ? visit(s->else_block) : Flow::Next;
+    }
+
+    Flow visit(WhileStatement* s) {
+        while (true) {
+            auto condition = truthy(visit(s->condition));
+            if (failed) {
+                return Flow::Fail;
+            }
+            if (!condition) {
+                return Flow::Next;
+            }
+            auto flow = visit(s->body);
+            if (flow != Flow::Next) {
+                return flow;
+            }
+        }
+    }
+
+    Flow visit(ExpressionStatement* s) {
+        visit(s->value);
+        return failed ? Flow::Fail : Flow::Next;
+    }
+};
+
+}
+
+bool evaluate(Program &program, FILE* out) {
+    SlotResolver resolver(program);
+    for (auto s : program.statements) {
+        resolver.visit(s);
+    }
+    if (resolver.failed) {
+        return false;
+    }
+    return Evaluator(out, resolver).run(program);
+}
+
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdio>
+
+#include "ast.h"
+
+namespace mango {
+
+// Runs the program by walking its tree, printing what it prints to out.
+// First every variable is resolved to a slot in the frame of the function
+// it's declared in, or to one of the running function's captures, so
+// running it never looks a name up. Slower than the VM on long running
+// programs but it starts right away, and it's the reference for what a
+// program means that the other backends are tested against. Runs after
+// infer_types and resolve_closures. Returns false if a name in the
+// program can't be resolved, or it fails when it runs, after saying why
+// on stderr. Like the VM it never frees what the program allocates before
+// it returns, see vm.h.
+//
+// Calls are walked on the C++ stack, about 1KB each, so a stack overflow
+// comes when the thread's stack runs low: around 8 thousand calls deep on
+// an 8MB stack, mango run --eval gives it 256MB. The VM runs out when its
+// registers do instead, so the two don't overflow at the same depth.
+bool evaluate(Program &program, FILE* out = stdout);
+
+}
@@ -0,0 +1,754 @@
+#include "flat_ast.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace mango {
+
+class Flattener {
+    FlatAst &ast;
+    std::unordered_map<std::string_view, uint32_t> string_ids;
+    // child lists are gathered here before being copied into extra so
+    // nested lists don't interleave
+    std::vector<uint32_t> stack;
+
+    uint32_t add(NodeKind kind, uint8_t op = 0, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+        ast.node_storage.push_back(FlatNode{kind, op, a, b, c});
+        return ast.node_storage.size() - 1;
+    }
+
+    uint32_t intern(std::string_view s) {
+        auto entry = string_ids.find(s);
+        if (entry != string_ids.end()) {
+            return entry->second;
+        }
+
+        uint32_t id = ast.offset_storage.size() - 1;
+        ast.string_storage.insert(ast.string_storage.end(), s.begin(), s.end());
+        ast.offset_storage.push_back(ast.string_storage.size());
+        // key on the arena copy of the string, it outlives the flattener
+        string_ids.emplace(s, id);
+        return id;
+    }
+
+    // moves everything on the stack above first into extra
+    uint32_t pop_range(size_t first) {
+        uint32_t start = ast.extra_storage.size();
+        ast.extra_storage.insert(ast.extra_storage.end(), stack.begin() + first, stack.end());
+        stack.resize(first);
+        return start;
+    }
+
+public:
+    explicit Flattener(FlatAst &ast) : ast(ast) {}
+
+    uint32_t flatten(Expression* e) {
+        switch (e->kind) {
+            case NodeKind::UndefinedExpression:
+                return add(e->kind);
+            case NodeKind::IdentifierExpression:
+                return add(e->kind, 0, intern(static_cast<IdentifierExpression*>(e)->value));
+            case NodeKind::IntegerLiteralExpression:
+                return add(e->kind, 0, static_cast<uint32_t>(static_cast<IntegerLiteralExpression*>(e)->value));
+            case NodeKind::StringLiteralExpression:
+                return add(e->kind, 0, intern(static_cast<StringLiteralExpression*>(e)->value));
+            case NodeKind::BooleanLiteralExpression:
+                return add(e->kind, static_cast<BooleanLiteralExpression*>(e)->value);
+            case NodeKind::FunctionExpression: {
+                auto fe = static_cast<FunctionExpression*>(e);
+                auto body = flatten(fe->body);
+                auto first = stack.size();
+                for (auto p : fe->parameters) {
+                    stack.push_back(intern(p));
+                }
+                auto count = stack.size() - first;
+                return add(e->kind, 0, pop_range(first), count, body);
+            }
+            case NodeKind::ObjectExpression: {
+                auto oe = static_cast<ObjectExpression*>(e);
+                auto first = stack.size();
+                for (auto &p : oe->properties) {
+                    auto value = flatten(p.value);
+                    stack.push_back(intern(p.key));
+                    stack.push_back(value);
+                }
+                return add(e->kind, 0, pop_range(first), oe->properties.size());
+            }
+            case NodeKind::ArrayExpression: {
+                auto ae = static_cast<ArrayExpression*>(e);
+                auto first = stack.size();
+                for (auto element : ae->elements) {
+                    auto n = flatten(element);
+                    stack.push_back(n);
+                }
+                return add(e->kind, 0, pop_range(first), ae->elements.size());
+            }
+            case NodeKind::MemberExpression: {
+                auto me = static_cast<MemberExpression*>(e);
+                auto property = flatten(me->property);
+                return add(e->kind, me->computed, intern(me->identifier), property);
+            }
+            case NodeKind::FunctionCallExpression: {
+                auto fce = static_cast<FunctionCallExpression*>(e);
+                auto first = stack.size();
+                for (auto arg : fce->arguments) {
+                    auto n = flatten(arg);
+                    stack.push_back(n);
+                }
+                return add(e->kind, 0, intern(fce->value), pop_range(first), fce->arguments.size());
+            }
+            case NodeKind::BinaryExpression: {
+                auto b = static_cast<BinaryExpression*>(e);
+                auto left = flatten(b->left);
+                auto right = flatten(b->right);
+                return add(e->kind, static_cast<uint8_t>(b->op), left, right);
+            }
+            case NodeKind::UnaryExpression: {
+                auto ue = static_cast<UnaryExpression*>(e);
+                auto argument = flatten(ue->argument);
+                return add(e->kind, static_cast<uint8_t>(ue->op), argument);
+            }
+            case NodeKind::AssignmentExpression: {
+                auto ae = static_cast<AssignmentExpression*>(e);
+                auto left = flatten(ae->left);
+                auto right = flatten(ae->right);
+                return add(e->kind, 0, left, right);
+            }
+            default:
+                std::cerr << "not an expression\n";
+                assert(false);
+        }
+        return no_node;
+    }
+
+    uint32_t flatten(Statement* s) {
+        auto node = flatten_statement(s);
+        // children were added first, so locations stay sorted by node
+        ast.location_storage.push_back(FlatLocation{node, s->line, s->offset, s->length});
+        return node;
+    }
+
+    uint32_t flatten_statement(Statement* s) {
+        switch (s->kind) {
+            case NodeKind::BlockStatement: {
+                auto bs = static_cast<BlockStatement*>(s);
+                auto first = stack.size();
+                for (auto st : bs->statements) {
+                    auto n = flatten(st);
+                    stack.push_back(n);
+                }
+                return add(s->kind, 0, pop_range(first), bs->statements.size());
+            }
+            case NodeKind::DeclarationStatement: {
+                auto ds = static_cast<DeclarationStatement*>(s);
+                auto value = flatten(ds->value);
+                return add(s->kind, static_cast<uint8_t>(ds->data_type), intern(ds->identifier), value);
+            }
+            case NodeKind::ReturnStatement:
+                return add(s->kind, 0, flatten(static_cast<ReturnStatement*>(s)->value));
+            case NodeKind::IfStatement: {
+                auto is = static_cast<IfStatement*>(s);
+                auto condition = flatten(is->condition);
+                auto if_block = flatten(is->if_block);
+                auto else_block = is->else_block ? flatten(is->else_block) : no_node;
+                return add(s->kind, 0, condition, if_block, else_block);
+            }
+            case NodeKind::WhileStatement: {
+                auto ws = static_cast<WhileStatement*>(s);
+                auto condition = flatten(ws->condition);
+                auto body = flatten(ws->body);
+                return add(s->kind, 0, condition, body);
+            }
+            case NodeKind::ExpressionStatement:
+                return add(s->kind, 0, flatten(static_cast<ExpressionStatement*>(s)->value));
+            default:
+                std::cerr << "not a statement\n";
+                assert(false);
+        }
+        return no_node;
+    }
+
+    void flatten(const Program &program) {
+        auto first = stack.size();
+        for (auto s : program.statements) {
+            auto n = flatten(s);
+            stack.push_back(n);
+        }
+        ast.statement_count = program.statements.size();
+        ast.first_statement = pop_range(first);
+        ast.use_storage();
+    }
+};
+
+FlatAst flatten(const Program &program) {
+    FlatAst ast;
+    Flattener(ast).flatten(program);
+    return ast;
+}
+
+FlatAst Program::flatten() const {
+    return mango::flatten(*this);
+}
+
+void FlatAst::use_storage() {
+    nodes = {node_storage.data(), node_storage.size()};
+    extra = {extra_storage.data(), extra_storage.size()};
+    string_data = {string_storage.data(), string_storage.size()};
+    string_offsets = {offset_storage.data(), offset_storage.size()};
+    locations = {location_storage.data(), location_storage.size()};
+}
+
+const FlatLocation* FlatAst::location(uint32_t node) const {
+    auto l = std::lower_bound(locations.begin(), locations.end(), node,
+                              [](const FlatLocation &l, uint32_t node) { return l.node < node; });
+    if (l == locations.end() || l->node != node) {
+        return nullptr;
+    }
+    return l;
+}
+
+size_t FlatAst::bytes() const {
+    return nodes.size() * sizeof(FlatNode) + extra.size() * sizeof(uint32_t) + string_data.size() +
+           string_offsets.size() * sizeof(uint32_t) + locations.size() * sizeof(FlatLocation);
+}
+
+// mirrors the print methods in ast.cpp
+class FlatPrinter {
+    const FlatAst &ast;
+    string_builder::StringBuilder &sb;
+
+public:
+    FlatPrinter(const FlatAst &ast, string_builder::StringBuilder &sb) : ast(ast), sb(sb) {}
+
+    void print(uint32_t index) {
+        auto &n = ast.nodes[index];
+
+        switch (n.kind) {
+            case NodeKind::UndefinedExpression:
+                sb.append_line_no_indent("UndefinedExpression {}");
+                break;
+            case NodeKind::IdentifierExpression:
+                sb.append_no_indent("IdentifierExpression { value: ");
+                sb.append_no_indent(ast.string(n.a));
+                sb.append_no_indent(" }");
+                break;
+            case NodeKind::IntegerLiteralExpression:
+                sb.append_no_indent("IntegerLiteralExpression { value: ");
+                sb.append_no_indent(std::to_string(static_cast<int>(n.a)));
+                sb.append_no_indent(" }");
+                break;
+            case NodeKind::StringLiteralExpression:
+                sb.append_no_indent("StringLiteralExpression { value: ");
+                sb.append_no_indent(ast.string(n.a));
+                sb.append_no_indent(" }");
+                break;
+            case NodeKind::BooleanLiteralExpression:
+                sb.append_no_indent("BooleanLiteralExpression { value: ");
+                sb.append_no_indent(n.op ? "true" : "false");
+                sb.append_no_indent(" }");
+                break;
+            case NodeKind::FunctionExpression:
+                sb.append_line_no_indent("FunctionExpression {");
+                sb.increase_indent();
+                sb.append_line("parameters: [");
+                sb.increase_indent();
+                for (uint32_t i = 0; i < n.b; i++) {
+                    sb.append_line(ast.string(ast.extra[n.a + i]));
+                }
+                sb.decrease_indent();
+                sb.append_line("]");
+                sb.append("value: ");
+                print(n.c);
+                sb.decrease_indent();
+                sb.append_line("}");
+                break;
+            case NodeKind::ObjectExpression:
+                sb.append_line_no_indent("ObjectExpression {");
+                sb.append_line("}");
+                break;
+            case NodeKind::ArrayExpression:
+                sb.append_line_no_indent("ArrayExpression {");
+                sb.append_line("elements: [");
+                sb.increase_indent();
+                for (uint32_t i = 0; i < n.b; i++) {
+                    sb.append("");
+                    print(ast.extra[n.a + i]);
+                    sb.append_line("");
+                }
+                sb.decrease_indent();
+                sb.append_line("");
+                sb.append_line("]");
+                sb.decrease_indent();
+                sb.append_line("}");
+                break;
+            case NodeKind::MemberExpression:
+                sb.append_line_no_indent("MemberExpression {");
+                sb.increase_indent();
+                sb.append("object: ");
+                sb.append_line_no_indent(ast.string(n.a));
+                sb.append("property: ");
+                print(n.b);
+                sb.decrease_indent();
+                sb.append_no_indent(" }");
+                break;
+            case NodeKind::FunctionCallExpression:
+                sb.append_line_no_indent("FunctionCallExpression {");
+                sb.increase_indent();
+                sb.append("value: ");
+                sb.append_line_no_indent(ast.string(n.a));
+                sb.append_line("arguments: [");
+                sb.increase_indent();
+                for (uint32_t i = 0; i < n.c; i++) {
+                    sb.append("");
+                    print(ast.extra[n.b + i]);
+                    sb.append_line("");
+                }
+                sb.decrease_indent();
+                sb.append_line("");
+                sb.append_line("]");
+                sb.decrease_indent();
+                sb.append_line("}");
+                break;
+            case NodeKind::BinaryExpression:
+                sb.append_line_no_indent("BinaryExpression {");
+                sb.increase_indent();
+                sb.append("operator: ");
+                sb.append_line_no_indent(operator_to_string(static_cast<Operator>(n.op)));
+                sb.append("left: ");
+                print(n.a);
+                sb.append_line("");
+                sb.append("right: ");
+                print(n.b);
+                sb.append_line("");
+                sb.decrease_indent();
+                sb.append("}");
+                break;
+            case NodeKind::UnaryExpression:
+                sb.append_line_no_indent("UnaryExpression {");
+                sb.increase_indent();
+                sb.append("operator: ");
+                sb.append_line_no_indent(operator_to_string(static_cast<Operator>(n.op)));
+                sb.append("argument: ");
+                print(n.a);
+                sb.append_line("");
+                sb.decrease_indent();
+                sb.append("}");
+                break;
+            case NodeKind::AssignmentExpression:
+                sb.append_line_no_indent("AssignmentExpression {");
+                sb.increase_indent();
+                sb.append("left: ");
+                print(n.a);
+                sb.append_line("");
+                sb.append("right: ");
+                print(n.b);
+                sb.append_line("");
+                sb.decrease_indent();
+                sb.append("}");
+                break;
+            case NodeKind::BlockStatement:
+                sb.append_line_no_indent("BlockStatement {");
+                sb.increase_indent();
+                sb.append_line("value: [");
+                sb.increase_indent();
+                if (n.b > 0) {
+                    for (uint32_t i = 0; i < n.b; i++) {
+                        print(ast.extra[n.a + i]);
+                    }
+                } else {
+                    sb.append_line("<empty>");
+                }
+                sb.decrease_indent();
+                sb.append_line("]");
+                sb.decrease_indent();
+                sb.append_line("}");
+                break;
+            case NodeKind::DeclarationStatement:
+                sb.append_line("DeclarationStatement {");
+                sb.increase_indent();
+                sb.append("type: ");
+                sb.append_line_no_indent(data_type_to_string(static_cast<DataType>(n.op)));
+                sb.append("identifier: ");
+                sb.append_line_no_indent(ast.string(n.a));
+                sb.append("value: ");
+                print(n.b);
+                sb.append_line_no_indent("");
+                sb.decrease_indent();
+                sb.append_line("}");
+                break;
+            case NodeKind::ReturnStatement:
+                sb.append_line("ReturnStatement {");
+                sb.increase_indent();
+                sb.append("value: ");
+                print(n.a);
+                sb.append_line("");
+                sb.decrease_indent();
+                sb.append_line("}");
+                break;
+            case NodeKind::IfStatement:
+                sb.append_line("IfStatement {");
+                sb.increase_indent();
+                sb.append("condition: ");
+                print(n.a);
+                sb.append_line("");
+                sb.append("if_block: ");
+                print(n.b);
+                sb.append_line("");
+                sb.append("else_block: ");
+                if (n.c != no_node) {
+                    print(n.c);
+                } else {
+                    sb.append_no_indent("<null>");
+                }
+                sb.append_line("");
+                sb.decrease_indent();
+                sb.append_line("}");
+                break;
+            case NodeKind::WhileStatement:
+                sb.append_line("WhileStatement {");
+                sb.increase_indent();
+                sb.append("condition: ");
+                print(n.a);
+                sb.append_line("");
+                sb.append("body: ");
+                print(n.b);
+                sb.append_line("");
+                sb.decrease_indent();
+                sb.append_line("}");
+                break;
+            case NodeKind::ExpressionStatement:
+                sb.append_line("ExpressionStatement {");
+                sb.increase_indent();
+                sb.append("value: ");
+                print(n.a);
+                sb.append_line("");
+                sb.decrease_indent();
+                sb.append_line("}");
+                break;
+        }
+    }
+};
+
+std::string FlatAst::print() const {
+    string_builder::StringBuilder sb;
+    FlatPrinter printer(*this, sb);
+
+    sb.append_line("Program {");
+    sb.increase_indent();
+
+    sb.append_line("statements: [");
+    sb.increase_indent();
+
+    for (uint32_t i = 0; i < statement_count; i++) {
+        printer.print(extra[first_statement + i]);
+    }
+
+    sb.decrease_indent();
+    sb.append_line("]");
+
+    sb.decrease_indent();
+    sb.append_line("}");
+
+    return sb.get_string();
+}
+
+bool FlatAst::valid() const {
+    if (string_offsets.size() == 0 || string_offsets[0] != 0) {
+        return false;
+    }
+    for (size_t i = 1; i < string_offsets.size(); i++) {
+        if (string_offsets[i] < string_offsets[i - 1] || string_offsets[i] > string_data.size()) {
+            return false;
+        }
+    }
+
+    auto is_statement = [this](uint32_t node) { return nodes[node].kind >= NodeKind::BlockStatement; };
+    // children have to come before node i and be the right sort of node
+    auto expression = [&](uint32_t child, uint32_t i) { return child < i && !is_statement(child); };
+    auto statement = [&](uint32_t child, uint32_t i) { return child < i && is_statement(child); };
+    auto is_string = [this](uint32_t id) { return id < string_count(); };
+    auto in_extra = [this](uint32_t first, size_t count) {
+        return first <= extra.size() && count <= extra.size() - first;
+    };
+    auto is_operator = [](uint8_t op) {
+        return op >= static_cast<uint8_t>(Operator::Plus) && op <= static_cast<uint8_t>(Operator::Or);
+    };
+
+    for (uint32_t i = 0; i < nodes.size(); i++) {
+        auto &n = nodes[i];
+        bool ok = true;
+
+        switch (n.kind) {
+            case NodeKind::UndefinedExpression:
+            case NodeKind::IntegerLiteralExpression:
+            case NodeKind::BooleanLiteralExpression:
+                break;
+            case NodeKind::IdentifierExpression:
+            case NodeKind::StringLiteralExpression:
+                ok = is_string(n.a);
+                break;
+            case NodeKind::FunctionExpression:
+                ok = in_extra(n.a, n.b) && statement(n.c, i);
+                for (uint32_t p = 0; ok && p < n.b; p++) {
+                    ok = is_string(extra[n.a + p]);
+                }
+                break;
+            case NodeKind::ObjectExpression:
+                ok = in_extra(n.a, size_t(n.b) * 2);
+                for (uint32_t p = 0; ok && p < n.b; p++) {
+                    ok = is_string(extra[n.a + p * 2]) && expression(extra[n.a + p * 2 + 1], i);
+                }
+                break;
+            case NodeKind::ArrayExpression:
+                ok = in_extra(n.a, n.b);
+                for (uint32_t e = 0; ok && e < n.b; e++) {
+                    ok = expression(extra[n.a + e], i);
+                }
+                break;
+            case NodeKind::MemberExpression:
+                ok = is_string(n.a) && expression(n.b, i);
+                break;
+            case NodeKind::FunctionCallExpression:
+                ok = is_string(n.a) && in_extra(n.b, n.c);
+                for (uint32_t a = 0; ok && a < n.c; a++) {
+                    ok = expression(extra[n.b + a], i);
+                }
+                break;
+            case NodeKind::BinaryExpression:
+                ok = is_operator(n.op) && expression(n.a, i) && expression(n.b, i);
+                break;
+            case NodeKind::UnaryExpression:
+                ok = is_operator(n.op) && expression(n.a, i);
+                break;
+            case NodeKind::AssignmentExpression:
+                ok = expression(n.a, i) && expression(n.b, i);
+                break;
+            case NodeKind::BlockStatement:
+                ok = in_extra(n.a, n.b);
+                for (uint32_t s = 0; ok && s < n.b; s++) {
+                    ok = statement(extra[n.a + s], i);
+                }
+                break;
+            case NodeKind::DeclarationStatement:
+                ok = n.op <= static_cast<uint8_t>(DataType::Array) && is_string(n.a) && expression(n.b, i);
+                break;
+            case NodeKind::ReturnStatement:
+            case NodeKind::ExpressionStatement:
+                ok = expression(n.a, i);
+                break;
+            case NodeKind::IfStatement:
+                ok = expression(n.a, i) && statement(n.b, i) && (n.c == no_node || statement(n.c, i));
+                break;
+            case NodeKind::WhileStatement:
+                ok = expression(n.a, i) && statement(n.b, i);
+                break;
+            default:
+                ok = false;
+        }
+
+        if (!ok) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < locations.size(); i++) {
+        auto node = locations[i].node;
+        if (node >= nodes.size() || !is_statement(node) || (i > 0 && node <= locations[i - 1].node)) {
+            return false;
+        }
+    }
+
+    if (!in_extra(first_statement, statement_count)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < statement_count; i++) {
+        auto node = extra[first_statement + i];
+        if (node >= nodes.size() || !is_statement(node)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+Program FlatAst::unflatten() const {
+    Program program;
+    auto &arena = program.arena;
+
+    std::vector<std::string_view> strings(string_count());
+    for (uint32_t i = 0; i < strings.size(); i++) {
+        strings[i] = arena.copy_string(string(i));
+    }
+
+    // children come before their parents, so by the time a node is built
+    // everything it points to has been
+    std::vector<Expression*> expressions(nodes.size());
+    std::vector<Statement*> statements(nodes.size());
+    auto location = locations.begin();
+
+    auto expression_list = [&](uint32_t first, uint32_t count) {
+        auto list = arena.make_array<Expression*>(count);
+        for (uint32_t i = 0; i < count; i++) {
+            list[i] = expressions[extra[first + i]];
+        }
+        return list;
+    };
+
+    for (uint32_t i = 0; i < nodes.size(); i++) {
+        auto &n = nodes[i];
+
+        switch (n.kind) {
+            case NodeKind::UndefinedExpression:
+                expressions[i] = arena.make<UndefinedExpression>();
+                break;
+            case NodeKind::IdentifierExpression: {
+                auto e = arena.make<IdentifierExpression>();
+                e->value = strings[n.a];
+                expressions[i] = e;
+                break;
+            }
+            case NodeKind::IntegerLiteralExpression: {
+                auto e = arena.make<IntegerLiteralExpression>();
+                e->value = static_cast<int>(n.a);
+                expressions[i] = e;
+                break;
+            }
+            case NodeKind::StringLiteralExpression: {
+                auto e = arena.make<StringLiteralExpression>();
+                e->value = strings[n.a];
+                expressions[i] = e;
+                break;
+            }
+            case NodeKind::BooleanLiteralExpression: {
+                auto e = arena.make<BooleanLiteralExpression>();
+                e->value = n.op != 0;
+                expressions[i] = e;
+                break;
+            }
+            case NodeKind::FunctionExpression: {
+                auto e = arena.make<FunctionExpression>();
+                auto parameters = arena.make_array<std::string_view>(n.b);
+                for (uint32_t p = 0; p < n.b; p++) {
+                    parameters[p] = strings[extra[n.a + p]];
+                }
+                e->parameters = parameters;
+                e->body = statements[n.c];
+                expressions[i] = e;
+                break;
+            }
+            case NodeKind::ObjectExpression: {
+                auto e = arena.make<ObjectExpression>();
+                auto properties = arena.make_array<ObjectProperty>(n.b);
+                for (uint32_t p = 0; p < n.b; p++) {
+                    properties[p] = {strings[extra[n.a + p * 2]], expressions[extra[n.a + p * 2 + 1]]};
+                }
+                e->properties = properties;
+                expressions[i] = e;
+                break;
+            }
+            case NodeKind::ArrayExpression: {
+                auto e = arena.make<ArrayExpression>();
+                e->elements = expression_list(n.a, n.b);
+                expressions[i] = e;
+                break;
+            }
+            case NodeKind::MemberExpression: {
+                auto e = arena.make<MemberExpression>();
+                e->identifier = strings[n.a];
+                e->property = expressions[n.b];
+                e->computed = n.op != 0;
+                expressions[i] = e;
+                break;
+            }
+            case NodeKind::FunctionCallExpression: {
+                auto e = arena.make<FunctionCallExpression>();
+                e->value = strings[n.a];
+                e->arguments = expression_list(n.b, n.c);
+                expressions[i] = e;
+                break;
+            }
+            case NodeKind::BinaryExpression: {
+                auto e = arena.make<BinaryExpression>();
+                e->op = static_cast<Operator>(n.op);
+                e->left = expressions[n.a];
+                e->right = expressions[n.b];
+                expressions[i] = e;
+                break;
+            }
+            case NodeKind::UnaryExpression: {
+                auto e = arena.make<UnaryExpression>();
+                e->op = static_cast<Operator>(n.op);
+                e->argument = expressions[n.a];
+                expressions[i] = e;
+                break;
+            }
+            case NodeKind::AssignmentExpression: {
+                auto e = arena.make<AssignmentExpression>();
+                e->left = expressions[n.a];
+                e->right = expressions[n.b];
+                expressions[i] = e;
+                break;
+            }
+            case NodeKind::BlockStatement: {
+                auto s = arena.make<BlockStatement>();
+                auto list = arena.make_array<Statement*>(n.b);
+                for (uint32_t c = 0; c < n.b; c++) {
+                    list[c] = statements[extra[n.a + c]];
+                }
+                s->statements = list;
+                statements[i] = s;
+                break;
+            }
+            case NodeKind::DeclarationStatement: {
+                auto s = arena.make<DeclarationStatement>();
+                s->data_type = static_cast<DataType>(n.op);
+                s->identifier = strings[n.a];
+                s->value = expressions[n.b];
+                statements[i] = s;
+                break;
+            }
+            case NodeKind::ReturnStatement: {
+                auto s = arena.make<ReturnStatement>();
+                s->value = expressions[n.a];
+                statements[i] = s;
+                break;
+            }
+            case NodeKind::IfStatement: {
+                auto s = arena.make<IfStatement>();
+                s->condition = expressions[n.a];
+                s->if_block = statements[n.b];
+                s->else_block = n.c != no_node ? statements[n.c] : nullptr;
+                statements[i] = s;
+                break;
+            }
+            case NodeKind::WhileStatement: {
+                auto s = arena.make<WhileStatement>();
+                s->condition = expressions[n.a];
+                s->body = statements[n.b];
+                statements[i] = s;
+                break;
+            }
+            case NodeKind::ExpressionStatement: {
+                auto s = arena.make<ExpressionStatement>();
+                s->value = expressions[n.a];
+                statements[i] = s;
+                break;
+            }
+        }
+
+        if (location != locations.end() && location->node == i) {
+            statements[i]->line = location->line;
+            statements[i]->offset = location->offset;
+            statements[i]->length = location->length;
+            location++;
+        }
+    }
+
+    for (uint32_t i = 0; i < statement_count; i++) {
+        program.statements.push_back(statements[extra[first_statement + i]]);
+    }
+
+    return program;
+}
+
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.h"
+
+namespace mango {
+
+constexpr uint32_t no_node = UINT32_MAX;
+
+// A node of a FlatAst, what a, b and c hold depends on the kind:
+//
+//   UndefinedExpression       -
+//   IdentifierExpression      a: name string
+//   IntegerLiteralExpression  a: value
+//   StringLiteralExpression   a: value string
+//   BooleanLiteralExpression  op: value
+//   FunctionExpression        a, b: parameter name strings in extra, c: body
+//   ObjectExpression          a, b: (key string, value) pairs in extra
+//   ArrayExpression           a, b: elements in extra
+//   MemberExpression          op: computed, a: object name string, b: property
+//   FunctionCallExpression    a: name string, b, c: arguments in extra
+//   BinaryExpression          op: operator, a: left, b: right
+//   UnaryExpression           op: operator, a: argument
+//   AssignmentExpression      a: left, b: right
+//   BlockStatement            a, b: statements in extra
+//   DeclarationStatement      op: data type, a: name string, b: value
+//   ReturnStatement           a: value
+//   IfStatement               a: condition, b: if block, c: else block or no_node
+//   WhileStatement            a: condition, b: body
+//   ExpressionStatement       a: value
+//
+// where "a, b: ... in extra" is a range starting at a with b entries.
+struct FlatNode {
+    NodeKind kind;
+    uint8_t op;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+};
+
+static_assert(sizeof(FlatNode) == 16, "flat nodes should stay small");
+
+// where a statement node came from, relative to its top level statement
+// like in the tree, see Statement
+struct FlatLocation {
+    uint32_t node;
+    int line;
+    uint32_t offset;
+    uint32_t length;
+};
+
+// FlatAst is a compact copy of a Program's tree: nodes live in one
+// contiguous array and refer to each other by 32-bit index, children
+// are always stored before their parents so passes that only need to
+// see every node can loop over the array front to back. Variable length
+// child lists live in a shared extra array and every identifier and
+// string is interned once into a single string table.
+//
+// The arrays are views, either into storage owned by the FlatAst when
+// it was built by flatten, or into a cache file it was loaded from (see
+// ast_cache.h), so loading one doesn't copy its nodes, it only reads
+// them once to check every index in them is valid.
+class FlatAst {
+    friend class Flattener;
+
+    std::vector<FlatNode> node_storage;
+    std::vector<uint32_t> extra_storage;
+    std::vector<char> string_storage;
+    std::vector<uint32_t> offset_storage{0};
+    std::vector<FlatLocation> location_storage;
+
+    // keeps memory the views point into alive when it isn't the storage
+    std::shared_ptr<const void> backing;
+
+    void use_storage();
+
+public:
+    ArenaArray<const FlatNode> nodes;
+    ArenaArray<const uint32_t> extra;
+    // string i is string_data[string_offsets[i], string_offsets[i + 1])
+    std::string_view string_data;
+    ArenaArray<const uint32_t> string_offsets;
+    // statement locations, sorted by node
+    ArenaArray<const FlatLocation> locations;
+    // top level statements, a range in extra
+    uint32_t first_statement = 0;
+    uint32_t statement_count = 0;
+
+    FlatAst() = default;
+    FlatAst(FlatAst &&) = default;
+    FlatAst &operator=(FlatAst &&) = default;
+
+    std::string_view string(uint32_t id) const {
+        return string_data.substr(string_offsets[id], string_offsets[id + 1] - string_offsets[id]);
+    }
+
+    size_t string_count() const { return string_offsets.size() - 1; }
+
+    const uint32_t* range(uint32_t first) const { return extra.begin() + first; }
+
+    // the location of a statement node, or nullptr for expressions
+    const FlatLocation* location(uint32_t node) const;
+
+    // keeps the memory the views were pointed at alive with the ast
+    void set_backing(std::shared_ptr<const void> owner) { backing = std::move(owner); }
+
+    size_t bytes() const;
+    // whether every index is in range and every child comes before its
+    // parent, anything read from a file is checked with it before use
+    bool valid() const;
+    // prints the same output as Program::print
+    std::string print() const;
+    // rebuilds the tree, without recursing so any depth can be rebuilt
+    Program unflatten() const;
+};
+
+FlatAst flatten(const Program &program);
+
+}
@@ -0,0 +1,544 @@
+#include "fold.h"
+
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+#include "visitor.h"
+
+namespace mango {
+
+class NodeCounter : public Visitor<NodeCounter, size_t> {
+public:
+    using Visitor::visit;
+
+    size_t visit(UndefinedExpression* e) { return 1; }
+    size_t visit(IdentifierExpression* e) { return 1; }
+    size_t visit(IntegerLiteralExpression* e) { return 1; }
+    size_t visit(StringLiteralExpression* e) { return 1; }
+    size_t visit(BooleanLiteralExpression* e) { return 1; }
+    size_t visit(FunctionExpression* e) { return 1 + visit(e->body); }
+    size_t visit(MemberExpression* e) { return 1 + visit(e->property); }
+    size_t visit(UnaryExpression* e) { return 1 + visit(e->argument); }
+    size_t visit(AssignmentExpression* e) { return 1 + visit(e->left) + visit(e->right); }
+
+    size_t visit(ObjectExpression* e) {
+        size_t count = 1;
+        for (auto &p : e->properties) {
+            count += visit(p.value);
+        }
+        return count;
+    }
+
+    size_t visit(ArrayExpression* e) {
+        size_t count = 1;
+        for (auto element : e->elements) {
+            count += visit(element);
+        }
+        return count;
+    }
+
+    size_t visit(FunctionCallExpression* e) {
+        size_t count = 1;
+        for (auto arg : e->arguments) {
+            count += visit(arg);
+        }
+        return count;
+    }
+
+    size_t visit(BinaryExpression* e) {
+        size_t count = 0;
+        walk_left_chain(e, [&](Expression* left) { count += visit(left); },
+                        [&](BinaryExpression* b) { count += 1 + visit(b->right); });
+        return count;
+    }
+
+    size_t visit(BlockStatement* s) {
+        size_t count = 1;
+        for (auto st : s->statements) {
+            count += visit(st);
+        }
+        return count;
+    }
+
+    size_t visit(DeclarationStatement* s) { return 1 + visit(s->value); }
+    size_t visit(ReturnStatement* s) { return 1 + visit(s->value); }
+    size_t visit(ExpressionStatement* s) { return 1 + visit(s->value); }
+    size_t visit(WhileStatement* s) { return 1 + visit(s->condition) + visit(s->body); }
+
+    size_t visit(IfStatement* s) {
+        return 1 + visit(s->condition) + visit(s->if_block) + (s->else_block ? visit(s->else_block) : 0);
+    }
+};
+
+size_t count_nodes(Program &program) {
+    NodeCounter counter;
+    size_t count = 0;
+    for (auto s : program.statements) {
+        count += counter.visit(s);
+    }
+    return count;
+}
+
+// the value of an integer or boolean literal, booleans are 0 or 1 like
+// in the generated C
+bool literal_value(Expression* e, int &value) {
+    if (e->kind == NodeKind::IntegerLiteralExpression) {
+        value = static_cast<IntegerLiteralExpression*>(e)->value;
+        return true;
+    }
+    if (e->kind == NodeKind::BooleanLiteralExpression) {
+        value = static_cast<BooleanLiteralExpression*>(e)->value;
+        return true;
+    }
+    return false;
+}
+
+bool is_literal(Expression* e, int value) {
+    int v;
+    return literal_value(e, v) && v == value;
+}
+
+bool is_logical_operator(Operator op) {
+    switch (op) {
+        case Operator::LessThan:
+        case Operator::LessThanOrEqualTo:
+        case Operator::GreaterThan:
+        case Operator::GreaterThanOrEqualTo:
+        case Operator::EqualTo:
+        case Operator::NotEqualTo:
+        case Operator::And:
+        case Operator::Or:
+        case Operator::Not:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// whether e is always 0 or 1, so it can stand in for "true && e"
+bool is_boolean(Expression* e) {
+    switch (e->kind) {
+        case NodeKind::BooleanLiteralExpression:
+            return true;
+        case NodeKind::UnaryExpression:
+            return is_logical_operator(static_cast<UnaryExpression*>(e)->op);
+        case NodeKind::BinaryExpression:
+            return is_logical_operator(static_cast<BinaryExpression*>(e)->op);
+        default:
+            return false;
+    }
+}
+
+// whether evaluating e can't do anything but produce a value, so it can
+// be dropped
+bool is_pure(Expression* e) {
+    switch (e->kind) {
+        case NodeKind::UndefinedExpression:
+        case NodeKind::IdentifierExpression:
+        case NodeKind::IntegerLiteralExpression:
+        case NodeKind::StringLiteralExpression:
+        case NodeKind::BooleanLiteralExpression:
+        case NodeKind::FunctionExpression:
+            return true;
+        case NodeKind::UnaryExpression:
+            return is_pure(static_cast<UnaryExpression*>(e)->argument);
+        case NodeKind::BinaryExpression: {
+            auto b = static_cast<BinaryExpression*>(e);
+            // division can trap
+            return b->op != Operator::Divide && is_pure(b->left) && is_pure(b->right);
+        }
+        default:
+            return false;
+    }
+}
+
+// folds expressions to simpler ones, and statements to simpler ones or
+// nullptr when they can be removed
+class Folder : public Visitor<Folder, Expression*, Statement*> {
+    Arena &arena;
+
+    Expression* make_integer(int value) {
+        auto e = arena.make<IntegerLiteralExpression>();
+        e->value = value;
+        e->type = DataType::Integer;
+        return e;
+    }
+
+    Expression* make_boolean(bool value) {
+        auto e = arena.make<BooleanLiteralExpression>();
+        e->value = value;
+        e->type = DataType::Bool;
+        return e;
+    }
+
+    // evaluates l op r, returns nullptr when it can't be evaluated at
+    // compile time
+    Expression* evaluate(Operator op, int l, int r) {
+        // wrap around instead of overflowing
+        auto ul = static_cast<uint32_t>(l);
+        auto ur = static_cast<uint32_t>(r);
+
+        switch (op) {
+            case Operator::Plus:
+                return make_integer(static_cast<int>(ul + ur));
+            case Operator::Minus:
+                return make_integer(static_cast<int>(ul - ur));
+            case Operator::Multiply:
+                return make_integer(static_cast<int>(ul * ur));
+            case Operator::Divide:
+                // leave what would trap to run time
+                if (r == 0 || (l == INT_MIN && r == -1)) {
+                    return nullptr;
+                }
+                return make_integer(l / r);
+            case Operator::LessThan:
+                return make_boolean(l < r);
+            case Operator::LessThanOrEqualTo:
+                return make_boolean(l <= r);
+            case Operator::GreaterThan:
+                return make_boolean(l > r);
+            case Operator::GreaterThanOrEqualTo:
+                return make_boolean(l >= r);
+            case Operator::EqualTo:
+                return make_boolean(l == r);
+            case Operator::NotEqualTo:
+                return make_boolean(l != r);
+            case Operator::And:
+                return make_boolean(l && r);
+            case Operator::Or:
+                return make_boolean(l || r);
+            case Operator::Not:
+                break;
+        }
+        return nullptr;
+    }
+
+    // simplifies b, whose operands have already been folded
+    Expression* simplify(BinaryExpression* b) {
+        auto op = b->op;
+        auto left = b->left;
+        auto right = b->right;
+        int l = 0, r = 0;
+        bool left_constant = literal_value(left, l);
+        bool right_constant = literal_value(right, r);
+
+        if (left_constant && right_constant) {
+            if (auto e = evaluate(op, l, r)) {
+                return e;
+            }
+            return b;
+        }
+
+        switch (op) {
+            case Operator::Plus:
+                // "s" + 0 is "s0", only integer additions of 0 go away
+                if (b->type == DataType::String) {
+                    break;
+                }
+                if (is_literal(right, 0)) {
+                    return left;
+                }
+                if (is_literal(left, 0)) {
+                    return right;
+                }
+                // (e + c1) + c2 and friends become e + (c1 + c2)
+                if (right_constant && left->kind == NodeKind::BinaryExpression) {
+                    if (auto e = combine(static_cast<BinaryExpression*>(left), r)) {
+                        return e;
+                    }
+                }
+                break;
+            case Operator::Minus:
+                if (is_literal(right, 0)) {
+                    return left;
+                }
+                if (right_constant && left->kind == NodeKind::BinaryExpression && r != INT_MIN) {
+                    if (auto e = combine(static_cast<BinaryExpression*>(left), -r)) {
+                        return e;
+                    }
+                }
+                break;
+            case Operator::Multiply:
+                if (is_literal(right, 1)) {
+                    return left;
+                }
+                if (is_literal(left, 1)) {
+                    return right;
+                }
+                if ((is_literal(right, 0) && is_pure(left)) || (is_literal(left, 0) && is_pure(right))) {
+                    return make_integer(0);
+                }
+                break;
+            case Operator::Divide:
+                if (is_literal(right, 1)) {
+                    return left;
+                }
+                break;
+            case Operator::And:
+                if (left_constant) {
+                    // the right side is only evaluated when the left is true
+                    if (!l) {
+                        return make_boolean(false);
+                    }
+                    if (is_boolean(right)) {
+                        return right;
+                    }
+                } else if (right_constant) {
+                    if (r && is_boolean(left)) {
+                        return left;
+                    }
+                    if (!r && is_pure(left)) {
+                        return make_boolean(false);
+                    }
+                }
+                break;
+            case Operator::Or:
+                if (left_constant) {
+                    if (l) {
+                        return make_boolean(true);
+                    }
+                    if (is_boolean(right)) {
+                        return right;
+                    }
+                } else if (right_constant) {
+                    if (!r && is_boolean(left)) {
+                        return left;
+                    }
+                    if (r && is_pure(left)) {
+                        return make_boolean(true);
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+
+        return b;
+    }
+
+    // folds "inner + c" where inner is e + c1 or e - c1 into e + (c1 + c),
+    // returns nullptr if inner isn't one of those
+    Expression* combine(BinaryExpression* inner, int c) {
+        int c1;
+        if ((inner->op != Operator::Plus && inner->op != Operator::Minus) || !literal_value(inner->right, c1)) {
+            return nullptr;
+        }
+        // "s" + 1 + 2 is "s12", not "s3"
+        if (inner->type == DataType::String) {
+            return nullptr;
+        }
+
+        if (inner->op == Operator::Minus) {
+            if (c1 == INT_MIN) {
+                return nullptr;
+            }
+            c1 = -c1;
+        }
+
+        auto sum = static_cast<int>(static_cast<uint32_t>(c1) + static_cast<uint32_t>(c));
+        if (sum == 0) {
+            return inner->left;
+        }
+
+        auto b = arena.make<BinaryExpression>();
+        // keep literals positive when possible, the lexer has no negative
+        // numbers either
+        b->op = sum < 0 && sum != INT_MIN ? Operator::Minus : Operator::Plus;
+        b->left = inner->left;
+        b->right = make_integer(b->op == Operator::Minus ? -sum : sum);
+        b->type = inner->type;
+        return b;
+    }
+
+    // if, while and function bodies can't be removed, an empty block
+    // stands in for them
+    Statement* fold_body(Statement* s) {
+        auto folded = visit(s);
+        if (folded == nullptr) {
+            auto block = arena.make<BlockStatement>();
+            block->line = s->line;
+            block->offset = s->offset;
+            block->length = s->length;
+            return block;
+        }
+        return folded;
+    }
+
+    // a statement standing in for another takes over its position
+    static Statement* replace(Statement* old, Statement* s) {
+        if (s != nullptr) {
+            s->line = old->line;
+            s->offset = old->offset;
+            s->length = old->length;
+        }
+        return s;
+    }
+
+public:
+    using Visitor::visit;
+
+    explicit Folder(Arena &arena) : arena(arena) {}
+
+    Expression* visit(UndefinedExpression* e) { return e; }
+    Expression* visit(IdentifierExpression* e) { return e; }
+    Expression* visit(IntegerLiteralExpression* e) { return e; }
+    Expression* visit(StringLiteralExpression* e) { return e; }
+    Expression* visit(BooleanLiteralExpression* e) { return e; }
+    Expression* visit(MemberExpression* e) { return e; }
+
+    Expression* visit(FunctionExpression* e) {
+        e->body = fold_body(e->body);
+        return e;
+    }
+
+    Expression* visit(ObjectExpression* e) {
+        for (auto &p : e->properties) {
+            p.value = visit(p.value);
+        }
+        return e;
+    }
+
+    Expression* visit(ArrayExpression* e) {
+        for (auto &element : e->elements) {
+            element = visit(element);
+        }
+        return e;
+    }
+
+    Expression* visit(FunctionCallExpression* e) {
+        for (auto &arg : e->arguments) {
+            arg = visit(arg);
+        }
+        return e;
+    }
+
+    Expression* visit(AssignmentExpression* e) {
+        e->right = visit(e->right);
+        return e;
+    }
+
+    Expression* visit(UnaryExpression* e) {
+        // counts the nots like the parser does, "!!!!x" chains can be long
+        int nots = 0;
+        Expression* argument = e;
+        while (argument->kind == NodeKind::UnaryExpression &&
+               static_cast<UnaryExpression*>(argument)->op == Operator::Not) {
+            nots++;
+            argument = static_cast<UnaryExpression*>(argument)->argument;
+        }
+        if (argument == e) {
+            e->argument = visit(e->argument);
+            return e;
+        }
+
+        argument = visit(argument);
+
+        int value;
+        if (literal_value(argument, value)) {
+            return make_boolean(nots % 2 == 0 ? value != 0 : value == 0);
+        }
+
+        // "!!b" is b when b is already 0 or 1, otherwise "!!x" is as
+        // simple as it gets
+        if (!is_boolean(argument) && nots >= 2) {
+            nots = 2 - nots % 2;
+        } else {
+            nots %= 2;
+        }
+
+        for (int i = 0; i < nots; i++) {
+            auto ue = arena.make<UnaryExpression>();
+            ue->op = Operator::Not;
+            ue->argument = argument;
+            ue->type = DataType::Bool;
+            argument = ue;
+        }
+        return argument;
+    }
+
+    Expression* visit(BinaryExpression* e) {
+        // folds the chain bottom up, each operation after its operands
+        Expression* folded = nullptr;
+        walk_left_chain(e, [&](Expression* left) { folded = visit(left); },
+                        [&](BinaryExpression* b) {
+                            b->left = folded;
+                            b->right = visit(b->right);
+                            folded = simplify(b);
+                        });
+        return folded;
+    }
+
+    Statement* visit(BlockStatement* s) {
+        // removed statements are dropped, the block only ever shrinks
+        size_t count = 0;
+        for (auto st : s->statements) {
+            if (auto folded = visit(st)) {
+                s->statements[count++] = folded;
+            }
+        }
+        s->statements.count = count;
+        return s;
+    }
+
+    Statement* visit(DeclarationStatement* s) {
+        s->value = visit(s->value);
+        return s;
+    }
+
+    Statement* visit(ReturnStatement* s) {
+        s->value = visit(s->value);
+        return s;
+    }
+
+    Statement* visit(ExpressionStatement* s) {
+        s->value = visit(s->value);
+        return s;
+    }
+
+    Statement* visit(IfStatement* s) {
+        s->condition = visit(s->condition);
+
+        int value;
+        if (literal_value(s->condition, value)) {
+            if (value) {
+                return replace(s, visit(s->if_block));
+            }
+            return s->else_block ? replace(s, visit(s->else_block)) : nullptr;
+        }
+
+        s->if_block = fold_body(s->if_block);
+        if (s->else_block) {
+            s->else_block = visit(s->else_block);
+        }
+        return s;
+    }
+
+    Statement* visit(WhileStatement* s) {
+        s->condition = visit(s->condition);
+        if (is_literal(s->condition, 0)) {
+            return nullptr;
+        }
+        s->body = fold_body(s->body);
+        return s;
+    }
+};
+
+FoldStats fold_constants(Program &program) {
+    FoldStats stats{};
+    stats.nodes_before = count_nodes(program);
+
+    Folder folder(program.arena);
+    size_t count = 0;
+    for (auto s : program.statements) {
+        if (auto folded = folder.visit(s)) {
+            program.statements[count++] = folded;
+        }
+    }
+    program.statements.resize(count);
+
+    stats.nodes_after = count_nodes(program);
+    return stats;
+}
+
+}
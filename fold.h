@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+#include "ast.h"
+
+namespace mango {
+
+struct FoldStats {
+    size_t nodes_before;
+    size_t nodes_after;
+
+    size_t eliminated() const { return nodes_before - nodes_after; }
+};
+
+// the number of nodes in the program's tree
+size_t count_nodes(Program &program);
+
+// Folds constant subtrees, simplifies identities like "x * 1" and "!!b"
+// and removes if and while statements whose condition is constant. Runs
+// before code generation, the tree is rewritten in place and new nodes
+// come from the program's arena. Integers wrap like 32-bit ints do, and
+// nothing that can have side effects is dropped unless it would never
+// have been evaluated.
+FoldStats fold_constants(Program &program);
+
+}
@@ -0,0 +1,742 @@
+#include "jit.h"
+
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <tuple>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define MANGO_JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace mango {
+
+#ifdef MANGO_JIT_X86_64
+
+namespace {
+
+enum Reg : uint8_t { rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi, r12 = 12 };
+
+// condition codes, what follows 0x0f 0x80 in a jcc and 0x0f 0x90 in a setcc
+enum Condition : uint8_t {
+    below = 0x2,
+    above_equal = 0x3,
+    equal = 0x4,
+    not_equal = 0x5,
+    above = 0x7,
+    less = 0xc,
+    greater_equal = 0xd,
+    less_equal = 0xe,
+    greater = 0xf,
+};
+
+Condition negate(Condition c) {
+    return static_cast<Condition>(c ^ 1);
+}
+
+// base + disp
+struct Mem {
+    Reg base;
+    int32_t disp;
+};
+
+// Encodes the handful of x86-64 instructions the compiler needs, every
+// one either register to register or between a register and base + disp.
+class Assembler {
+public:
+    std::vector<uint8_t> bytes;
+
+    size_t position() const { return bytes.size(); }
+
+    void byte(uint8_t b) { bytes.push_back(b); }
+
+    void dword(uint32_t v) {
+        for (int i = 0; i < 4; i++) {
+            byte(static_cast<uint8_t>(v >> (8 * i)));
+        }
+    }
+
+    // opcode reg, [m]
+    void op(std::initializer_list<uint8_t> opcode, int reg, Mem m, bool wide = false) {
+        rex(wide, reg, m.base);
+        for (auto b : opcode) {
+            byte(b);
+        }
+        int base = m.base & 7;
+        int mod = m.disp == 0 && base != rbp ? 0 : m.disp == static_cast<int8_t>(m.disp) ? 1 : 2;
+        byte(static_cast<uint8_t>(mod << 6 | (reg & 7) << 3 | base));
+        if (base == rsp) {
+            byte(0x24);
+        }
+        if (mod == 1) {
+            byte(static_cast<uint8_t>(m.disp));
+        } else if (mod == 2) {
+            dword(static_cast<uint32_t>(m.disp));
+        }
+    }
+
+    // opcode reg, rm between registers
+    void op(std::initializer_list<uint8_t> opcode, int reg, int rm, bool wide = false) {
+        rex(wide, reg, rm);
+        for (auto b : opcode) {
+            byte(b);
+        }
+        byte(static_cast<uint8_t>(0xc0 | (reg & 7) << 3 | (rm & 7)));
+    }
+
+    void load32(Reg to, Mem m) { op({0x8b}, to, m); }
+    void store32(Mem m, Reg from) { op({0x89}, from, m); }
+    void load64(Reg to, Mem m) { op({0x8b}, to, m, true); }
+    void store64(Mem m, Reg from) { op({0x89}, from, m, true); }
+    void store8(Mem m, uint8_t v) {
+        op({0xc6}, 0, m);
+        byte(v);
+    }
+    void store32(Mem m, uint32_t v) {
+        op({0xc7}, 0, m);
+        dword(v);
+    }
+    // sign extends v
+    void store64(Mem m, uint32_t v) {
+        op({0xc7}, 0, m, true);
+        dword(v);
+    }
+    void compare8(Mem m, uint8_t v) {
+        op({0x80}, 7, m);
+        byte(v);
+    }
+    void compare32(Mem m, int8_t v) {
+        op({0x83}, 7, m);
+        byte(static_cast<uint8_t>(v));
+    }
+    void compare32(Reg x, int8_t v) {
+        op({0x83}, 7, x);
+        byte(static_cast<uint8_t>(v));
+    }
+    void set(Condition c, Reg to) { op({0x0f, static_cast<uint8_t>(0x90 | c)}, 0, to); }
+
+    // a jump to somewhere not known yet, returns where to patch it
+    size_t jump() {
+        byte(0xe9);
+        dword(0);
+        return position() - 4;
+    }
+    size_t jump(Condition c) {
+        byte(0x0f);
+        byte(static_cast<uint8_t>(0x80 | c));
+        dword(0);
+        return position() - 4;
+    }
+    void patch(size_t at, size_t target) {
+        auto rel = static_cast<uint32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+        std::memcpy(&bytes[at], &rel, 4);
+    }
+
+private:
+    void rex(bool wide, int reg, int base) {
+        uint8_t prefix = 0x40 | wide << 3 | (reg >> 3) << 2 | base >> 3;
+        if (prefix != 0x40) {
+            byte(prefix);
+        }
+    }
+};
+
+static_assert(sizeof(Value) == 16, "compiled code copies values as 16 bytes");
+static_assert(offsetof(ArrayValue, length) == 0 && offsetof(ArrayValue, items) == 8, "");
+static_assert(offsetof(ObjectValue, fields) == 8, "");
+static_assert(sizeof(JitFrame) == 16 && offsetof(JitFrame, ip) == 4 && offsetof(JitFrame, registers) == 8, "");
+
+constexpr int32_t type_offset = offsetof(Value, type);
+constexpr int32_t payload_offset = offsetof(Value, integer);
+static_assert(type_offset == 0 && payload_offset == 8, "values are written as two halves");
+
+// compiled code keeps the registers in r12 and the JitState in rbx
+Mem state(size_t offset) {
+    return {rbx, static_cast<int32_t>(offset)};
+}
+
+uint8_t tag(ValueType type) {
+    return static_cast<uint8_t>(type);
+}
+
+// Compiles instructions start to end of one function. Every instruction
+// reads and writes the registers in memory like the VM would, so stopping
+// anywhere leaves the VM a frame it can carry on with. Types aren't
+// tracked past jump targets, within straight line code a register checked
+// or written once is known after.
+class Compiler {
+    const Bytecode &bytecode;
+    uint32_t index;
+    const BytecodeFunction &function;
+    uint32_t start, end;
+    Assembler as;
+    std::vector<size_t> labels;
+    std::vector<bool> targets;
+    // jumps to patch with the instruction they go to
+    std::vector<std::pair<size_t, uint32_t>> fixups;
+    // jumps out to the stub stopping at an instruction, and whether a
+    // guard failed
+    std::vector<std::tuple<size_t, uint32_t, bool>> exits;
+    std::unordered_map<uint32_t, ValueType> known;
+    // the register the last instruction compared into, and how, so a
+    // branch on it can use the flags
+    uint32_t flags_register = UINT32_MAX;
+    Condition flags_condition = equal;
+    bool compared = false;
+
+    static Mem reg(uint32_t i, int32_t offset = 0) { return {r12, static_cast<int32_t>(i * sizeof(Value)) + offset}; }
+
+    bool in_region(uint32_t target) const { return target >= start && target < end; }
+
+    void stop(size_t jump, uint32_t ip, bool guard) { exits.emplace_back(jump, ip, guard); }
+
+    // jumps to instruction target on c, leaving compiled code if it's
+    // outside what's compiled
+    void branch(Condition c, uint32_t target) {
+        auto at = as.jump(c);
+        if (in_region(target)) {
+            fixups.emplace_back(at, target);
+        } else {
+            stop(at, target, false);
+        }
+    }
+
+    void jump(uint32_t target) {
+        auto at = as.jump();
+        if (in_region(target)) {
+            fixups.emplace_back(at, target);
+        } else {
+            stop(at, target, false);
+        }
+    }
+
+    // stops at ip unless register i holds a value of type
+    void expect(uint32_t i, ValueType type, uint32_t ip) {
+        auto it = known.find(i);
+        if (it != known.end() && it->second == type) {
+            return;
+        }
+        as.compare8(reg(i, type_offset), tag(type));
+        stop(as.jump(not_equal), ip, true);
+        known[i] = type;
+    }
+
+    // Values are written and copied 8 bytes at a time, so reading one
+    // right after it's written is forwarded from the store instead of
+    // waiting for it, the type's 8 bytes clear the string fields
+    void set_type(uint32_t i, ValueType type) {
+        as.store64(reg(i, type_offset), tag(type));
+        known[i] = type;
+    }
+
+    // from is a 32 bit result, so its upper half is clear
+    void set_integer(uint32_t i, Reg from) {
+        as.store64(reg(i, payload_offset), from);
+        set_type(i, ValueType::Integer);
+    }
+
+    void set_bool(uint32_t i, Condition c) {
+        as.set(c, rax);
+        // movzx eax, al
+        as.op({0x0f, 0xb6}, rax, rax);
+        as.store64(reg(i, payload_offset), rax);
+        set_type(i, ValueType::Bool);
+        flags_register = i;
+        flags_condition = c;
+        compared = true;
+    }
+
+    // from and to can be based on rax
+    void copy(Mem to, Mem from) {
+        as.load64(rcx, from);
+        as.load64(rdx, Mem{from.base, from.disp + 8});
+        as.store64(to, rcx);
+        as.store64(Mem{to.base, to.disp + 8}, rdx);
+    }
+
+    // eax <- b op c, op one of add, sub and imul as reg, [m]
+    void arithmetic(const Instruction &in, std::initializer_list<uint8_t> opcode) {
+        as.load32(rax, reg(in.b, payload_offset));
+        as.op(opcode, rax, reg(in.c, payload_offset));
+        set_integer(in.a, rax);
+    }
+
+    void compare(const Instruction &in, Condition c) {
+        as.load32(rax, reg(in.b, payload_offset));
+        as.op({0x3b}, rax, reg(in.c, payload_offset));
+        set_bool(in.a, c);
+    }
+
+    // sets ZF when register i is falsy, stops at ip for anything but
+    // integers and bools
+    void test(uint32_t i, uint32_t ip) {
+        auto it = known.find(i);
+        auto type = it == known.end() ? ValueType::Undefined : it->second;
+        if (type == ValueType::Bool) {
+            as.compare8(reg(i, payload_offset), 0);
+            return;
+        }
+        if (type == ValueType::Integer) {
+            as.compare32(reg(i, payload_offset), 0);
+            return;
+        }
+        as.op({0x0f, 0xb6}, rax, reg(i, type_offset));
+        as.compare32(rax, static_cast<int8_t>(tag(ValueType::Bool)));
+        auto not_bool = as.jump(not_equal);
+        as.compare8(reg(i, payload_offset), 0);
+        auto done = as.jump();
+        as.patch(not_bool, as.position());
+        as.compare32(rax, static_cast<int8_t>(tag(ValueType::Integer)));
+        stop(as.jump(not_equal), ip, true);
+        as.compare32(reg(i, payload_offset), 0);
+        as.patch(done, as.position());
+    }
+
+    // branches to target when register i is truthy, or falsy
+    void branch_on(uint32_t i, bool truthy, uint32_t target, uint32_t ip) {
+        if (flags_register == i) {
+            branch(truthy ? flags_condition : negate(flags_condition), target);
+            return;
+        }
+        test(i, ip);
+        branch(truthy ? not_equal : equal, target);
+    }
+
+    // rax <- the address of item c of the array in register b, stops at ip
+    // when it's out of bounds unless checked is false
+    void item(uint32_t b, uint32_t c, uint32_t ip, bool checked) {
+        as.load64(rax, reg(b, payload_offset));
+        as.load32(rcx, reg(c, payload_offset));
+        if (checked) {
+            as.op({0x3b}, rcx, Mem{rax, 0});
+            stop(as.jump(above_equal), ip, false);
+        }
+        as.load64(rax, Mem{rax, 8});
+        // shl rcx, 4, the upper half of rcx is clear after the load
+        as.op({0xc1}, 4, rcx, true);
+        as.byte(4);
+        as.op({0x01}, rcx, rax, true);
+    }
+
+    bool instruction(uint32_t ip) {
+        auto &in = function.code[ip];
+        auto whole_function = start == 0 && end == function.code.size();
+        switch (in.op) {
+            case Op::Move: {
+                copy(reg(in.a), reg(in.b));
+                auto it = known.find(in.b);
+                if (it != known.end()) {
+                    known[in.a] = it->second;
+                } else {
+                    known.erase(in.a);
+                }
+                return true;
+            }
+            case Op::LoadInt:
+                as.store64(reg(in.a, payload_offset), in.b);
+                set_type(in.a, ValueType::Integer);
+                return true;
+            case Op::LoadBool:
+                as.store64(reg(in.a, payload_offset), in.b != 0);
+                set_type(in.a, ValueType::Bool);
+                return true;
+            case Op::LoadUndefined:
+                set_type(in.a, ValueType::Undefined);
+                return true;
+            case Op::Add:
+            case Op::Subtract:
+            case Op::Multiply:
+            case Op::Less:
+            case Op::LessEqual:
+            case Op::Greater:
+            case Op::GreaterEqual:
+            case Op::Equal:
+            case Op::NotEqual:
+            case Op::Divide:
+                // the VM does anything but integers
+                expect(in.b, ValueType::Integer, ip);
+                expect(in.c, ValueType::Integer, ip);
+                break;
+            default:
+                break;
+        }
+
+        switch (in.op) {
+            case Op::Add:
+            case Op::AddInt:
+                arithmetic(in, {0x03});
+                return true;
+            case Op::Subtract:
+            case Op::SubtractInt:
+                arithmetic(in, {0x2b});
+                return true;
+            case Op::Multiply:
+            case Op::MultiplyInt:
+                arithmetic(in, {0x0f, 0xaf});
+                return true;
+            case Op::Divide: {
+                // the VM says why dividing by zero fails
+                as.load32(rcx, reg(in.c, payload_offset));
+                as.op({0x85}, rcx, rcx);
+                stop(as.jump(equal), ip, false);
+                as.load32(rax, reg(in.b, payload_offset));
+                // INT_MIN / -1 overflows, wrap it around like the VM
+                as.compare32(rcx, -1);
+                auto divide = as.jump(not_equal);
+                as.op({0xf7}, 3, rax);
+                auto done = as.jump();
+                as.patch(divide, as.position());
+                as.byte(0x99);
+                as.op({0xf7}, 7, rcx);
+                as.patch(done, as.position());
+                set_integer(in.a, rax);
+                return true;
+            }
+            case Op::Less:
+            case Op::LessInt:
+                compare(in, less);
+                return true;
+            case Op::LessEqual:
+            case Op::LessEqualInt:
+                compare(in, less_equal);
+                return true;
+            case Op::Greater:
+            case Op::GreaterInt:
+                compare(in, greater);
+                return true;
+            case Op::GreaterEqual:
+            case Op::GreaterEqualInt:
+                compare(in, greater_equal);
+                return true;
+            case Op::Equal:
+            case Op::EqualInt:
+                compare(in, equal);
+                return true;
+            case Op::NotEqual:
+            case Op::NotEqualInt:
+                compare(in, not_equal);
+                return true;
+            case Op::Not:
+                test(in.b, ip);
+                set_bool(in.a, equal);
+                return true;
+            case Op::Jump:
+                jump(in.b);
+                return true;
+            case Op::JumpIfFalse:
+                branch_on(in.a, false, in.b, ip);
+                return true;
+            case Op::JumpIfTrue:
+            case Op::Loop:
+                branch_on(in.a, true, in.b, ip);
+                return true;
+            case Op::GetField:
+                expect(in.b, ValueType::Object, ip);
+                as.load64(rax, reg(in.b, payload_offset));
+                as.load64(rax, Mem{rax, 8});
+                copy(reg(in.a), Mem{rax, static_cast<int32_t>(in.c * sizeof(Value))});
+                known.erase(in.a);
+                return true;
+            case Op::SetField:
+                expect(in.a, ValueType::Object, ip);
+                as.load64(rax, reg(in.a, payload_offset));
+                as.load64(rax, Mem{rax, 8});
+                copy(Mem{rax, static_cast<int32_t>(in.b * sizeof(Value))}, reg(in.c));
+                return true;
+            case Op::GetIndex:
+            case Op::GetIndexUnchecked: {
+                auto checked = in.op == Op::GetIndex;
+                if (checked) {
+                    expect(in.b, ValueType::Array, ip);
+                    expect(in.c, ValueType::Integer, ip);
+                }
+                item(in.b, in.c, ip, checked);
+                copy(reg(in.a), Mem{rax, 0});
+                known.erase(in.a);
+                return true;
+            }
+            case Op::SetIndex:
+                expect(in.a, ValueType::Array, ip);
+                expect(in.b, ValueType::Integer, ip);
+                item(in.a, in.b, ip, true);
+                copy(Mem{rax, 0}, reg(in.c));
+                return true;
+            case Op::Length:
+                expect(in.b, ValueType::Array, ip);
+                as.load64(rax, reg(in.b, payload_offset));
+                as.load32(rax, Mem{rax, 0});
+                set_integer(in.a, rax);
+                return true;
+            case Op::CallDirect: {
+                auto &callee = bytecode.functions[in.c];
+                // the VM says why when the stack is full
+                as.op({0x8d}, rdi, reg(in.b), true);
+                as.op({0x8d}, rax, Mem{rdi, static_cast<int32_t>(callee.registers * sizeof(Value))}, true);
+                as.op({0x3b}, rax, state(offsetof(JitState, stack_end)), true);
+                stop(as.jump(above), ip, false);
+                as.op({0x81}, 7, state(offsetof(JitState, depth)));
+                as.dword(Jit::max_depth);
+                stop(as.jump(above_equal), ip, false);
+                // the callee's compiled code, it's a guard because the
+                // callee is only ever thrown away on failed guards
+                as.load64(rax, state(offsetof(JitState, entries)));
+                as.load64(rax, Mem{rax, static_cast<int32_t>(in.c * sizeof(void*))});
+                as.op({0x85}, rax, rax, true);
+                stop(as.jump(equal), ip, true);
+                as.op({0xff}, 0, state(offsetof(JitState, depth)));
+                as.op({0x89}, rbx, rsi, true);
+                as.op({0xff}, 2, rax);
+                as.op({0xff}, 1, state(offsetof(JitState, depth)));
+                as.op({0x85}, rax, rax);
+                stop(as.jump(not_equal), ip, false);
+                copy(reg(in.a), state(offsetof(JitState, result)));
+                known.clear();
+                return true;
+            }
+            case Op::Return:
+                if (!whole_function) {
+                    stop(as.jump(), ip, false);
+                    return true;
+                }
+                copy(state(offsetof(JitState, result)), reg(in.a));
+                as.op({0x31}, rax, rax);
+                epilogues.push_back(as.jump());
+                return true;
+            case Op::ReturnUndefined:
+                if (!whole_function) {
+                    stop(as.jump(), ip, false);
+                    return true;
+                }
+                as.store64(state(offsetof(JitState, result) + type_offset), tag(ValueType::Undefined));
+                as.op({0x31}, rax, rax);
+                epilogues.push_back(as.jump());
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    std::vector<size_t> epilogues;
+
+public:
+    Compiler(const Bytecode &bytecode, uint32_t index, uint32_t start, uint32_t end)
+            : bytecode(bytecode), index(index), function(bytecode.functions[index]), start(start), end(end),
+              labels(end - start), targets(end - start) {}
+
+    // the machine code, empty if something can't be compiled
+    std::vector<uint8_t> compile() {
+        targets[0] = true;
+        for (auto ip = start; ip < end; ip++) {
+            auto &in = function.code[ip];
+            auto jumps = in.op == Op::Jump || in.op == Op::JumpIfFalse || in.op == Op::JumpIfTrue || in.op == Op::Loop;
+            if (jumps && in_region(in.b)) {
+                targets[in.b - start] = true;
+            }
+        }
+
+        // push rbx, r12, rbp, which also keeps the stack aligned
+        as.byte(0x53);
+        as.byte(0x41);
+        as.byte(0x54);
+        as.byte(0x55);
+        as.op({0x89}, rdi, r12, true);
+        as.op({0x89}, rsi, rbx, true);
+
+        for (auto ip = start; ip < end; ip++) {
+            if (targets[ip - start]) {
+                known.clear();
+            }
+            labels[ip - start] = as.position();
+            compared = false;
+            if (!instruction(ip)) {
+                return {};
+            }
+            // flags only last until the instruction after the compare
+            if (!compared || (ip + 1 < end && targets[ip + 1 - start])) {
+                flags_register = UINT32_MAX;
+            }
+        }
+        jump(end);
+
+        // stops at the instruction in edx, pushing a JitFrame for this
+        // function
+        std::unordered_map<uint64_t, size_t> stubs;
+        size_t guard_failed = 0, stopped = 0;
+        std::vector<std::pair<size_t, bool>> to_common;
+        for (auto &[at, ip, guard] : exits) {
+            auto key = static_cast<uint64_t>(ip) << 1 | guard;
+            auto it = stubs.find(key);
+            if (it == stubs.end()) {
+                it = stubs.emplace(key, as.position()).first;
+                as.byte(0xba);
+                as.dword(ip);
+                to_common.emplace_back(as.jump(), guard);
+            }
+            as.patch(at, it->second);
+        }
+        guard_failed = as.position();
+        as.store8(state(offsetof(JitState, guard_failed)), 1);
+        stopped = as.position();
+        as.load32(rcx, state(offsetof(JitState, frame_count)));
+        as.op({0xc1}, 4, rcx, true);
+        as.byte(4);
+        as.op({0x03}, rcx, state(offsetof(JitState, frames)), true);
+        as.store32(Mem{rcx, 0}, index);
+        as.store32(Mem{rcx, 4}, rdx);
+        as.store64(Mem{rcx, 8}, r12);
+        as.op({0xff}, 0, state(offsetof(JitState, frame_count)));
+        as.byte(0xb8);
+        as.dword(Jit::stopped);
+        auto epilogue = as.position();
+        // pop rbp, r12, rbx
+        as.byte(0x5d);
+        as.byte(0x41);
+        as.byte(0x5c);
+        as.byte(0x5b);
+        as.byte(0xc3);
+
+        for (auto &[at, guard] : to_common) {
+            as.patch(at, guard ? guard_failed : stopped);
+        }
+        for (auto at : epilogues) {
+            as.patch(at, epilogue);
+        }
+        for (auto &[at, target] : fixups) {
+            as.patch(at, labels[target - start]);
+        }
+        return std::move(as.bytes);
+    }
+};
+
+}
+
+#endif
+
+Jit::Jit(const Bytecode &bytecode, const Value* stack_end)
+        : state(), bytecode(bytecode), entries(bytecode.functions.size()), calls(bytecode.functions.size()),
+          tried(bytecode.functions.size()), compiling(bytecode.functions.size()),
+          guard_failures(bytecode.functions.size()), heat(bytecode.functions.size()), frames(max_depth + 2) {
+    state.entries = entries.data();
+    state.stack_end = stack_end;
+    state.frames = frames.data();
+}
+
+Jit::~Jit() {
+#ifdef MANGO_JIT_X86_64
+    for (auto &c : code) {
+        munmap(c.memory, c.size);
+    }
+#endif
+}
+
+bool Jit::supported() {
+#ifdef MANGO_JIT_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+Jit::Native Jit::compile(uint32_t function, uint32_t start, uint32_t end) {
+#ifdef MANGO_JIT_X86_64
+    // compile what's called first, so calling it is a guard that rarely
+    // fails
+    auto &f = bytecode.functions[function];
+    for (auto ip = start; ip < end; ip++) {
+        auto &in = f.code[ip];
+        if (in.op != Op::CallDirect) {
+            continue;
+        }
+        compile_function(in.c);
+        if (entries[in.c] == nullptr && !compiling[in.c]) {
+            return nullptr;
+        }
+    }
+
+    auto machine_code = Compiler(bytecode, function, start, end).compile();
+    if (machine_code.empty()) {
+        return nullptr;
+    }
+    auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto size = (machine_code.size() + page - 1) / page * page;
+    auto memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    std::memcpy(memory, machine_code.data(), machine_code.size());
+    // never writable and executable at once
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return nullptr;
+    }
+    code.push_back({memory, size});
+    return reinterpret_cast<Native>(memory);
+#else
+    (void) function;
+    (void) start;
+    (void) end;
+    return nullptr;
+#endif
+}
+
+void Jit::compile_function(uint32_t function) {
+    if (tried[function]) {
+        return;
+    }
+    tried[function] = true;
+    compiling[function] = true;
+    auto size = static_cast<uint32_t>(bytecode.functions[function].code.size());
+    entries[function] = reinterpret_cast<void*>(compile(function, 0, size));
+    compiling[function] = false;
+}
+
+Jit::Native Jit::loop(uint32_t function, uint32_t ip) {
+    auto &counts = heat[function];
+    if (counts.empty()) {
+        counts.resize(bytecode.functions[function].code.size());
+    }
+    auto &count = counts[ip];
+    auto key = static_cast<uint64_t>(function) << 32 | ip;
+    if (count < hot) {
+        if (++count < hot) {
+            return nullptr;
+        }
+        auto body = bytecode.functions[function].code[ip].b;
+        auto native = body <= ip ? compile(function, body, ip + 1) : nullptr;
+        if (native == nullptr) {
+            // never try again
+            count = hot + 1;
+            return nullptr;
+        }
+        loops[key] = {native, 0};
+    }
+    if (count > hot) {
+        return nullptr;
+    }
+    return loops[key].native;
+}
+
+void Jit::stopped_function(uint32_t function) {
+    if (!state.guard_failed) {
+        return;
+    }
+    state.guard_failed = 0;
+    if (++guard_failures[function] >= max_guard_failures) {
+        entries[function] = nullptr;
+    }
+}
+
+void Jit::stopped_loop(uint32_t function, uint32_t ip) {
+    if (!state.guard_failed) {
+        return;
+    }
+    state.guard_failed = 0;
+    auto &loop = loops[static_cast<uint64_t>(function) << 32 | ip];
+    if (++loop.guard_failures >= max_guard_failures) {
+        heat[function][ip] = hot + 1;
+    }
+}
+
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "bytecode.h"
+#include "value.h"
+
+namespace mango {
+
+// where compiled code left the interpreter to carry on, one for every
+// frame compiled code was running when it stopped, innermost first. ip is
+// where the innermost one continues and the call the others are in.
+struct JitFrame {
+    uint32_t function;
+    uint32_t ip;
+    Value* registers;
+};
+
+// What compiled code and the VM share, compiled code finds it at fixed
+// offsets so it has to stay standard layout.
+struct JitState {
+    // what the function compiled code called returned
+    Value result;
+    // the compiled code of every function, nullptr if it isn't compiled
+    void* const* entries;
+    const Value* stack_end;
+    JitFrame* frames;
+    uint32_t frame_count;
+    // how deep compiled code has called into compiled code, it's limited so
+    // the machine stack can't overflow
+    uint32_t depth;
+    // set when compiled code stopped because a value wasn't the type it
+    // was compiled for
+    uint8_t guard_failed;
+};
+
+// Compiles the bytecode functions and while loops the VM runs often to
+// x86-64 machine code, straight into executable memory. Compiled code
+// works on the VM's registers in memory, so whenever it meets something
+// it can't do, like adding values that aren't integers, it stops and the
+// VM carries on from the same instruction. Only integer, bool and array
+// instructions, jumps and direct calls are compiled, a function or loop
+// that uses anything else stays interpreted. On other machines nothing is
+// ever compiled.
+class Jit {
+public:
+    // compiled code returns returned when the function returned, with what
+    // it returned in JitState::result, or stopped when the VM has to carry
+    // on from JitState::frames
+    static constexpr uint32_t returned = 0;
+    static constexpr uint32_t stopped = 1;
+    using Native = uint32_t (*)(Value* registers, JitState* state);
+
+    // calls or loop iterations before a function or loop is compiled
+    static constexpr uint32_t hot = 1000;
+    // times compiled code can stop on a failed guard before it's thrown
+    // away and the function or loop is interpreted for good
+    static constexpr uint32_t max_guard_failures = 100;
+    static constexpr uint32_t max_depth = 1000;
+
+    JitState state;
+
+private:
+    struct Loop {
+        Native native;
+        uint32_t guard_failures;
+    };
+
+    struct Code {
+        void* memory;
+        size_t size;
+    };
+
+    const Bytecode &bytecode;
+    std::vector<void*> entries;
+    std::vector<uint32_t> calls;
+    // whether compiling the function was tried, and whether it's being
+    // compiled, calls to it can be compiled before it's done
+    std::vector<bool> tried;
+    std::vector<bool> compiling;
+    std::vector<uint32_t> guard_failures;
+    // iterations of each loop by the instruction ending it, per function
+    std::vector<std::vector<uint32_t>> heat;
+    std::unordered_map<uint64_t, Loop> loops;
+    std::vector<JitFrame> frames;
+    std::vector<Code> code;
+
+    Native compile(uint32_t function, uint32_t start, uint32_t end);
+    void compile_function(uint32_t function);
+
+public:
+    Jit(const Bytecode &bytecode, const Value* stack_end);
+    ~Jit();
+    Jit(const Jit &) = delete;
+    Jit &operator=(const Jit &) = delete;
+
+    // whether this machine gets compiled code at all
+    static bool supported();
+
+    // counts a call of function, returns its compiled code once it's hot
+    Native call(uint32_t function) {
+        if (entries[function] == nullptr) {
+            if (calls[function] >= hot || ++calls[function] < hot) {
+                return nullptr;
+            }
+            compile_function(function);
+        }
+        return reinterpret_cast<Native>(entries[function]);
+    }
+
+    // counts an iteration of the loop ending at ip in function, returns the
+    // compiled loop once it's hot, to enter at the start of its body
+    Native loop(uint32_t function, uint32_t ip);
+
+    // compiled code entered at function or at the loop ending at ip
+    // stopped, throws it away once it stopped on failed guards too often
+    void stopped_function(uint32_t function);
+    void stopped_loop(uint32_t function, uint32_t ip);
+};
+
+}
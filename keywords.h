@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <string_view>
+
+#include "token.h"
+
+namespace mango {
+
+struct Keyword {
+    std::string_view text;
+    TokenType type;
+};
+
+inline constexpr Keyword keyword_list[] = {
+        {"var",    TokenType::KwVar},
+        {"func",   TokenType::KwFunc},
+        {"return", TokenType::KwReturn},
+        {"if",     TokenType::KwIf},
+        {"else",   TokenType::KwElse},
+        {"while",  TokenType::KwWhile},
+        {"true",   TokenType::KwTrue},
+        {"false",  TokenType::KwFalse},
+};
+
+// Perfect hash over the keyword set, found by searching for shifts that
+// give every keyword its own slot. make_keyword_table refuses to compile
+// if a new keyword collides, in which case the hash needs changing.
+constexpr size_t keyword_table_size = 16;
+
+constexpr size_t keyword_hash(std::string_view text) {
+    auto first = static_cast<unsigned char>(text[0]);
+    auto last = static_cast<unsigned char>(text[text.size() - 1]);
+    return (first + (last << 1) + text.size()) & (keyword_table_size - 1);
+}
+
+constexpr std::array<Keyword, keyword_table_size> make_keyword_table() {
+    std::array<Keyword, keyword_table_size> table{};
+
+    for (auto &keyword : keyword_list) {
+        auto &slot = table[keyword_hash(keyword.text)];
+        if (!slot.text.empty()) {
+            throw "keyword hash collision";
+        }
+        slot = keyword;
+    }
+
+    return table;
+}
+
+inline constexpr std::array<Keyword, keyword_table_size> keyword_table = make_keyword_table();
+
+// returns the keyword's token type, or Identifier if text isn't a keyword
+constexpr TokenType keyword_type(std::string_view text) {
+    auto &slot = keyword_table[keyword_hash(text)];
+    return slot.text == text ? slot.type : TokenType::Identifier;
+}
+
+static_assert(keyword_type("while") == TokenType::KwWhile);
+static_assert(keyword_type("whale") == TokenType::Identifier);
+
+}
@@ -1,119 +1,242 @@
 #include "lexer.h"
 
-#include <regex>
+#include <algorithm>
+#include <cassert>
+#include <climits>
 
-namespace mango {
+#include "char_class.h"
+#include "keywords.h"
+#include "scan.h"
 
-bool Lexer::is_keyword(std::string text) {
-    for (auto keyword : keywords) {
-        if (text == keyword)
-            return true;
-    }
+namespace mango {
 
-    return false;
+Token Lexer::make_token(TokenType type, size_t start, int token_line, int token_column) {
+    auto offset = static_cast<uint32_t>(start);
+    auto length = static_cast<uint32_t>(index - start);
+    return Token{type, file, offset, length, token_line, token_column, 0};
 }
 
-char Lexer::current_char() {
-    return source.at(index);
+void Lexer::advance_to(size_t end, const LineCount &lines) {
+    if (lines.newlines > 0) {
+        line += lines.newlines;
+        column = static_cast<int>(end - lines.last_newline);
+    } else {
+        column += static_cast<int>(end - index);
+    }
+    index = end;
 }
 
-char Lexer::next_char() {
-    index++;
-    column++;
-    if (index >= source.size()) {
-        return '\0';
-    }
-    return source.at(index);
+bool Lexer::get_string() {
+    LineCount lines;
+    auto end = scanner.find_string_end(source.data(), index, source.size(), lines);
+    advance_to(end, lines);
+    return end < source.size();
 }
 
-void Lexer::add_token(TokenType type, std::string value) {
-    tokens.push_back(Token{type, value, "test_file", line, column});
+void Lexer::get_identifier() {
+    auto end = scanner.skip_identifier(source.data(), index, source.size());
+    column += static_cast<int>(end - index);
+    index = end;
 }
 
-std::string Lexer::get_string() {
-    std::string text = "";
-    auto c = current_char();
+int Lexer::get_number() {
+    auto end = scanner.skip_digits(source.data(), index, source.size());
+    long long n = 0;
 
-    while (c != '"') {
-        text += c;
-        c = next_char();
+    // the rest of the digits are skipped once it's too large, the parser
+    // reports it
+    for (auto i = index; i < end && n <= INT_MAX; i++) {
+        n = n * 10 + (source[i] - '0');
     }
 
-    return text;
+    column += static_cast<int>(end - index);
+    index = end;
+    return n > INT_MAX ? number_too_large : static_cast<int>(n);
 }
 
-bool is_valid_identifier_character(char c) {
-    return std::regex_match(std::string{c}, std::regex("\\w+"));
+void Lexer::reset(const SourceFile &src) {
+    reset(src, 0, src.text().size(), 1, 1);
 }
 
-std::string Lexer::get_identifier() {
-    std::string text = "";
+void Lexer::reset(const SourceFile &src, size_t start, size_t end, int start_line, int start_column) {
+    source = src.text().substr(0, end);
+    file = src.id();
+    index = start;
+    line = start_line;
+    column = start_column;
 
-    auto c = current_char();
-
-    while (c != ' ' && is_valid_identifier_character(c) && c != '\n' && c != ';') {
-        text += c;
-        c = next_char();
+    if (source.size() > UINT32_MAX) {
+        std::cerr << "source file too large\n";
+        assert(false);
     }
+}
 
-    index--;
+Token Lexer::next_token() {
+    while (index < source.size()) {
+        auto c = source[index];
+        auto &cc = char_class(c);
+        auto start = index;
+        auto token_line = line;
+        auto token_column = column;
+
+        switch (cc.kind) {
+            case CharKind::Whitespace:
+            case CharKind::NewLine: {
+                LineCount lines;
+                advance_to(scanner.skip_whitespace(source.data(), index, source.size(), lines), lines);
+                break;
+            }
+            case CharKind::IdentifierStart: {
+                get_identifier();
+                return make_token(keyword_type(source.substr(start, index - start)), start, token_line, token_column);
+            }
+            case CharKind::Digit: {
+                auto n = get_number();
+                auto t = make_token(TokenType::Number, start, token_line, token_column);
+                t.number = n;
+                return t;
+            }
+            case CharKind::Quote: {
+                // the token's value excludes the quotes
+                index++;
+                column++;
+                auto terminated = get_string();
+                auto t = make_token(TokenType::String, start + 1, token_line, token_column);
+                if (!terminated) {
+                    // leave it for the parser to report, an editor relexes
+                    // every keystroke and the closing quote may be next
+                    t.number = unterminated_string;
+                    return t;
+                }
+                // skip the closing quote
+                index++;
+                column++;
+                return t;
+            }
+            case CharKind::Punctuation:
+                index++;
+                column++;
+                return make_token(cc.token, start, token_line, token_column);
+            case CharKind::Invalid:
+                std::cerr << "unexpected token " << c << "\n";
+                assert(false);
+                // skip it like whitespace so release builds keep going
+                index++;
+                column++;
+                break;
+        }
+    }
 
-    return text;
+    return make_token(TokenType::EndOfFile, index, line, column);
 }
 
-std::string Lexer::get_number() {
-    std::string n = "";
-    auto c = current_char();
+std::vector<Token> Lexer::get_tokens(const SourceFile &src) {
+    reset(src);
+
+    std::vector<Token> tokens;
 
-    while (isnumber(c)) {
-        n += c;
-        c = next_char();
+    while (true) {
+        auto &t = tokens.emplace_back(next_token());
+        if (t.type == TokenType::EndOfFile) {
+            break;
+        }
     }
 
-    index--;
+    return tokens;
+}
+
+// the source range a token was lexed from, strings include their quotes
+// except an unterminated string, which has no closing one
+uint32_t token_start(const Token &t) {
+    return t.type == TokenType::String ? t.offset - 1 : t.offset;
+}
 
-    return n;
+uint32_t token_end(const Token &t) {
+    auto closing = t.type == TokenType::String && t.number != unterminated_string;
+    return t.offset + t.length + (closing ? 1 : 0);
 }
 
-std::vector<Token> Lexer::get_tokens(std::string src) {
-    source = src;
+RelexResult Lexer::relex(const SourceFile &src, std::vector<Token> &tokens, const TextEdit &edit) {
+    auto delta = static_cast<int64_t>(edit.inserted.size()) - edit.removed;
+    auto old_edit_end = edit.offset + edit.removed;
+    auto new_edit_end = edit.offset + edit.inserted.size();
+
+    // the first token that touches the edit
+    auto touched = std::lower_bound(tokens.begin(), tokens.end(), edit.offset, [](const Token &t, uint32_t offset) {
+        return token_end(t) < offset;
+    }) - tokens.begin();
+
+    // The token before it ends before the edit, so it lexes the same, and
+    // the lexer has no state between tokens so it's a safe place to start.
+    size_t first = 0;
+    if (touched > 0) {
+        first = touched - 1;
+        auto &t = tokens[first];
+        reset(src, token_start(t), src.text().size(), t.line, t.column);
+    } else {
+        reset(src);
+    }
 
-    auto c = current_char();
+    relexed.clear();
+    auto old = first;
+    Token resync{};
 
-    while (c) {
-        if (c == '\n') {
-            line++;
-            column = 1;
-        }
+    while (true) {
+        auto t = next_token();
+        auto start = token_start(t);
 
-        if (isalpha(c)) {
-            auto text = get_identifier();
-            auto type = is_keyword(text) ? TokenType::Keyword : TokenType::Identifier;
-            add_token(type, text);
-        } else if (isnumber(c)) {
-            auto n = get_number();
-            add_token(TokenType::Number, n);
-        } else if (c == '"') {
-            next_char();
-            auto s = get_string();
-            add_token(TokenType::String, s);
-        } else {
-            if (c == ' ' || c == '\n') {
-                // skip
-            } else if (auto entry = single_char_tokens.find(c); entry != single_char_tokens.end()) {
-                add_token(entry->second, std::string{c});
-            } else {
-                std::cerr << "unexpected token " << c << "\n";
-                assert(false);
+        if (start >= new_edit_end) {
+            // the text from here on is unchanged, so once a token starts
+            // where an old token started the rest of the tokens match
+            while (old < tokens.size() && (token_start(tokens[old]) < old_edit_end ||
+                                           token_start(tokens[old]) + delta < start)) {
+                old++;
+            }
+
+            if (old < tokens.size() && token_start(tokens[old]) + delta == start) {
+                resync = t;
+                break;
             }
         }
 
-        c = next_char();
+        relexed.push_back(t);
+        assert(t.type != TokenType::EndOfFile);
     }
 
-    add_token(TokenType::EndOfFile, "");
+    auto removed = old - first;
+    auto line_delta = resync.line - tokens[old].line;
+    auto column_delta = resync.column - tokens[old].column;
+    auto resync_line = tokens[old].line;
 
-    return tokens;
+    if (relexed.size() > removed) {
+        tokens.insert(tokens.begin() + old, relexed.size() - removed, Token{});
+    } else if (relexed.size() < removed) {
+        tokens.erase(tokens.begin() + first + relexed.size(), tokens.begin() + old);
+    }
+    std::copy(relexed.begin(), relexed.end(), tokens.begin() + first);
+
+    // only the tokens left on the resync line move column, and most
+    // edits don't add or remove lines, so the bulk of the tail usually
+    // only needs its offset shifted
+    auto i = first + relexed.size();
+    for (; i < tokens.size() && tokens[i].line == resync_line; i++) {
+        tokens[i].column += column_delta;
+        tokens[i].line += line_delta;
+        tokens[i].offset += delta;
+    }
+
+    if (line_delta != 0) {
+        for (; i < tokens.size(); i++) {
+            tokens[i].line += line_delta;
+            tokens[i].offset += delta;
+        }
+    } else if (delta != 0) {
+        for (; i < tokens.size(); i++) {
+            tokens[i].offset += delta;
+        }
+    }
+
+    return RelexResult{first, removed, relexed.size()};
 }
 
-}
\ No newline at end of file
+}
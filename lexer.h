@@ -1,59 +1,65 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iostream>
-#include <unordered_map>
 
+#include "scan.h"
 #include "token.h"
+#include "source_file.h"
 
 namespace mango {
 
+// get_tokens_parallel hands each thread chunks of at least this many
+// bytes, a source under two chunks is lexed on the calling thread
+constexpr size_t min_parallel_chunk_size = 64 * 1024;
+
+// which tokens an incremental relex replaced: the removed tokens starting
+// at first were replaced with inserted new ones
+struct RelexResult {
+    size_t first;
+    size_t removed;
+    size_t inserted;
+};
+
 class Lexer {
-    std::string source;
-    int index = 0;
-    std::vector<Token> tokens;
-    std::vector<std::string> keywords{"var", "func", "return", "if", "else", "while", "true", "false"};
-    std::unordered_map<char, TokenType> single_char_tokens = {
-            {':',  TokenType::Colon},
-            {';',  TokenType::SemiColon},
-            {',',  TokenType::Comma},
-            {'.',  TokenType::Dot},
-            {'=',  TokenType::Equals},
-            {'(',  TokenType::LeftParen},
-            {')',  TokenType::RightParen},
-            {'{',  TokenType::LeftBrace},
-            {'}',  TokenType::RightBrace},
-            {'<',  TokenType::LeftAngleBracket},
-            {'>',  TokenType::RightAngleBracket},
-            {'+',  TokenType::Plus},
-            {'-',  TokenType::Minus},
-            {'*',  TokenType::Asterisk},
-            {'/',  TokenType::Slash},
-            {'!',  TokenType::Exclamation},
-            {'&',  TokenType::Ampersand},
-            {'|',  TokenType::Pipe},
-            {'<',  TokenType::LeftAngleBracket},
-            {'>',  TokenType::RightAngleBracket},
-            {'[',  TokenType::LeftBracket},
-            {']',  TokenType::RightBracket},
-            {'\n', TokenType::NewLine}
-    };
+    std::string_view source;
+    uint16_t file = 0;
+    size_t index = 0;
 
     int line = 1;
     int column = 1;
 
-    bool is_keyword(std::string text);
-    char current_char();
-    char next_char();
-    void add_token(TokenType type, std::string value);
-    std::string get_identifier();
-    std::string get_string();
-    std::string get_number();
+    // scratch space for relex
+    std::vector<Token> relexed;
+
+    void advance_to(size_t end, const LineCount &lines);
+    Token make_token(TokenType type, size_t start, int token_line, int token_column);
+    void get_identifier();
+    // false if the source ends before the closing quote
+    bool get_string();
+    int get_number();
 
 public:
-    std::vector<Token> get_tokens(std::string src);
+    // starts lexing src from the beginning
+    void reset(const SourceFile &src);
+    // starts lexing src at start, which must be the start of a token or
+    // whitespace, with the line and column of that position. lexing
+    // stops at end.
+    void reset(const SourceFile &src, size_t start, size_t end, int start_line, int start_column);
+    // returns the next token in the source, once the end is reached
+    // every call returns an EndOfFile token
+    Token next_token();
+    std::vector<Token> get_tokens(const SourceFile &src);
+    // lexes src split into chunks on up to threads threads, the tokens
+    // are identical to get_tokens
+    std::vector<Token> get_tokens_parallel(const SourceFile &src, int threads);
+    // updates tokens, previously lexed from src, after edit has been
+    // applied to src. lexing restarts at the last token that ends before
+    // the edit and stops as soon as a token starts where an old token
+    // used to, the tokens after that only have their positions shifted.
+    RelexResult relex(const SourceFile &src, std::vector<Token> &tokens, const TextEdit &edit);
 };
 
 }
-
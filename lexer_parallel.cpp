@@ -0,0 +1,139 @@
+#include "lexer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace mango {
+
+// runs work(i) for every i in [0, count) on up to threads threads, each
+// thread takes the next unclaimed index so uneven chunks balance out
+template<typename F>
+void parallel_for(size_t count, int threads, F work) {
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (auto i = next++; i < count; i = next++) {
+            work(i);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto &t : pool) {
+        t.join();
+    }
+}
+
+struct ChunkCounts {
+    size_t quotes = 0;
+    size_t newlines = 0;
+};
+
+ChunkCounts count_quotes_and_newlines(const char* s, size_t start, size_t end) {
+    ChunkCounts counts;
+    for (auto i = start; i < end; i++) {
+        counts.quotes += s[i] == '"';
+        counts.newlines += s[i] == '\n';
+    }
+    return counts;
+}
+
+std::vector<Token> Lexer::get_tokens_parallel(const SourceFile &src, int threads) {
+    auto text = src.text();
+    auto size = text.size();
+    auto chunk_count = std::min(static_cast<size_t>(threads) * 4, size / min_parallel_chunk_size);
+
+    if (threads <= 1 || chunk_count <= 1) {
+        return get_tokens(src);
+    }
+
+    // Strings are the only tokens that can contain a newline, and they
+    // have no escapes, so a newline is between tokens exactly when an
+    // even number of quotes come before it. Count quotes and newlines in
+    // evenly sized ranges first so each range knows the string state and
+    // line number at its start without lexing what comes before it.
+    std::vector<ChunkCounts> counts(chunk_count);
+    parallel_for(chunk_count, threads, [&](size_t i) {
+        counts[i] = count_quotes_and_newlines(text.data(), size * i / chunk_count, size * (i + 1) / chunk_count);
+    });
+
+    // each chunk starts just after the first newline outside a string
+    // at or after its range's start
+    struct Chunk {
+        size_t start;
+        size_t end;
+        int line;
+    };
+    std::vector<Chunk> chunks;
+    chunks.push_back({0, size, 1});
+
+    ChunkCounts before;
+    for (size_t i = 1; i < chunk_count; i++) {
+        before.quotes += counts[i - 1].quotes;
+        before.newlines += counts[i - 1].newlines;
+
+        // the previous chunk's search already ran past this range
+        auto p = size * i / chunk_count;
+        if (p < chunks.back().start) {
+            continue;
+        }
+
+        auto quotes = before.quotes;
+        auto newlines = before.newlines;
+        for (; p < size; p++) {
+            if (text[p] == '\n') {
+                newlines++;
+                if (quotes % 2 == 0) {
+                    break;
+                }
+            } else if (text[p] == '"') {
+                quotes++;
+            }
+        }
+
+        if (p + 1 >= size) {
+            break;
+        }
+
+        chunks.back().end = p + 1;
+        chunks.push_back({p + 1, size, static_cast<int>(newlines) + 1});
+    }
+
+    std::vector<std::vector<Token>> chunk_tokens(chunks.size());
+    Token end_of_file{};
+    parallel_for(chunks.size(), threads, [&](size_t i) {
+        Lexer lexer;
+        lexer.reset(src, chunks[i].start, chunks[i].end, chunks[i].line, 1);
+        auto &tokens = chunk_tokens[i];
+        while (true) {
+            auto t = lexer.next_token();
+            if (t.type == TokenType::EndOfFile) {
+                if (i == chunks.size() - 1) {
+                    end_of_file = t;
+                }
+                break;
+            }
+            tokens.push_back(t);
+        }
+    });
+
+    std::vector<size_t> first_token(chunks.size() + 1, 0);
+    for (size_t i = 0; i < chunks.size(); i++) {
+        first_token[i + 1] = first_token[i] + chunk_tokens[i].size();
+    }
+
+    std::vector<Token> tokens(first_token.back() + 1);
+    parallel_for(chunks.size(), threads, [&](size_t i) {
+        std::copy(chunk_tokens[i].begin(), chunk_tokens[i].end(), tokens.begin() + first_token[i]);
+        // free each chunk as soon as it's copied
+        std::vector<Token>().swap(chunk_tokens[i]);
+    });
+    tokens.back() = end_of_file;
+
+    return tokens;
+}
+
+}
@@ -1,23 +1,231 @@
+#include <cstring>
+#include <functional>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include <pthread.h>
+
+#include "ast_cache.h"
+#include "bounds.h"
+#include "closures.h"
+#include "evaluate.h"
+#include "fold.h"
 #include "lexer.h"
 #include "parser.h"
+#include "source_file.h"
+#include "types.h"
+#include "vm.h"
+
+enum class Emit {
+    Tokens,
+    Ast,
+    Bytecode,
+    C,
+};
+
+// the passes after parsing recurse once per level of nesting, they run
+// on a thread with a stack this big plus this much per level
+constexpr size_t base_stack_size = 8 << 20;
+#if defined(__SANITIZE_ADDRESS__)
+// sanitized frames are several times bigger
+constexpr size_t stack_per_level = 4096;
+#else
+constexpr size_t stack_per_level = 512;
+#endif
+// about a million nested blocks, a 1GB stack
+constexpr size_t max_nesting_depth = 1 << 21;
+// --eval walks calls on the stack too, about 1KB each, this is room for
+// about as many as fit in the VM's registers
+constexpr size_t evaluate_stack_size = 256 << 20;
+
+// runs work on a thread with a stack of stack_size bytes and returns what
+// it returns
+int run_with_stack(size_t stack_size, const std::function<int()> &work) {
+    struct Call {
+        const std::function<int()> &work;
+        int status;
+    } call{work, 1};
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, stack_size);
+    pthread_t thread;
+    auto started = pthread_create(&thread, &attributes, [](void* p) -> void* {
+        auto call = static_cast<Call*>(p);
+        call->status = call->work();
+        return nullptr;
+    }, &call);
+    pthread_attr_destroy(&attributes);
+    if (started != 0) {
+        std::cerr << "can't start a thread with a " << (stack_size >> 20) << "MB stack\n";
+        return 1;
+    }
+    pthread_join(thread, nullptr);
+    return call.status;
+}
+
+void print_usage() {
+    std::cerr << "usage: mango [--emit=tokens|ast|bytecode|c] [--cache=<dir>] [--stats] <file>...\n"
+                 "       mango run [--vm|--eval] [--no-jit] [--cache=<dir>] [--stats] <file>...\n"
+                 "  use - to read from stdin\n"
+                 "  run runs the program instead of emitting it, --vm in the bytecode VM (the default),\n"
+                 "    --eval by walking its tree, which starts faster\n"
+                 "  --no-jit keeps the VM from compiling what runs often to machine code\n"
+                 "  --cache=<dir> reuses the ASTs of unchanged inputs from dir\n"
+                 "  --stats prints what the optimizer did to stderr\n";
+}
+
+int main(int argc, char** argv) {
+    auto emit = Emit::C;
+    std::vector<std::string> paths;
+    std::string cache_directory;
+    bool stats = false;
+    // run the program rather than emit something, in the VM or by walking
+    // its tree
+    bool run = argc > 1 && std::strcmp(argv[1], "run") == 0;
+    bool walk = false;
+    // compile what the VM runs often to machine code
+    bool compile = true;
+
+    for (int i = run ? 2 : 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--emit=tokens" && !run) {
+            emit = Emit::Tokens;
+        } else if (arg == "--emit=ast" && !run) {
+            emit = Emit::Ast;
+        } else if (arg == "--emit=bytecode" && !run) {
+            emit = Emit::Bytecode;
+        } else if (arg == "--vm" && run) {
+            walk = false;
+        } else if (arg == "--eval" && run) {
+            walk = true;
+        } else if (arg == "--no-jit" && run) {
+            compile = false;
+        } else if (arg == "--emit=c" && !run) {
+            emit = Emit::C;
+        } else if (arg.rfind("--cache=", 0) == 0 && arg.size() > 8) {
+            cache_directory = arg.substr(8);
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (arg == "-h" || arg == "--help") {
+            print_usage();
+            return 0;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "unknown option " << arg << "\n";
+            print_usage();
+            return 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+
+    if (paths.empty()) {
+        print_usage();
+        return 1;
+    }
+
+    // big inputs are lexed on every core before they're parsed
+    auto lex_threads = static_cast<int>(std::thread::hardware_concurrency());
+
+    std::unique_ptr<mango::AstCache> cache;
+    if (!cache_directory.empty()) {
+        cache = std::make_unique<mango::AstCache>(cache_directory);
+    }
+
+    for (auto &path : paths) {
+        auto file = mango::SourceFile::open(path);
+        if (!file) {
+            return 1;
+        }
+
+        if (emit == Emit::Tokens) {
+            mango::Lexer lexer;
+            for (auto &t : lexer.get_tokens_parallel(*file, lex_threads)) {
+                std::cout << t << "\n";
+            }
+            continue;
+        }
+
+        mango::Program ast;
+        auto cached = cache ? cache->load(*file) : nullptr;
+        if (cached) {
+            ast = cached->unflatten();
+        } else {
+            mango::Parser parser;
+            if (lex_threads > 1 && file->text().size() >= 2 * mango::min_parallel_chunk_size) {
+                ast = parser.parse(mango::Lexer{}.get_tokens_parallel(*file, lex_threads));
+            } else {
+                // lexed as it's parsed, without holding every token at once
+                mango::TokenStream tokens(*file);
+                ast = parser.parse(tokens);
+            }
+            if (parser.failed) {
+                return 1;
+            }
+        }
+
+        auto depth = mango::nesting_depth(ast);
+        if (depth > max_nesting_depth) {
+            std::cerr << path << ": nested " << depth << " levels deep, mango handles up to " << max_nesting_depth
+                      << "\n";
+            return 1;
+        }
+
+        auto stack_size = base_stack_size + depth * stack_per_level + (run && walk ? evaluate_stack_size : 0);
+        auto status = run_with_stack(stack_size, [&]() {
+            if (cached && emit == Emit::Ast) {
+                std::cout << cached->print();
+                return 0;
+            }
+            // only declarations keep their types in the cache
+            if (!mango::infer_types(ast)) {
+                return 1;
+            }
+            if (cache && !cached) {
+                cache->store(*file, ast.flatten());
+            }
+
+            if (emit == Emit::Ast) {
+                std::cout << ast.print();
+                return 0;
+            }
+            auto folded = mango::fold_constants(ast);
+            mango::resolve_closures(ast);
+            auto bounds = mango::eliminate_bounds_checks(ast);
+            if (stats) {
+                std::cerr << path << ": constant folding eliminated " << folded.eliminated() << " of "
+                          << folded.nodes_before << " nodes\n";
+                std::cerr << path << ": bounds check elimination removed " << bounds.eliminated << " of "
+                          << bounds.accesses << " checks\n";
+            }
+            if (run && walk) {
+                return mango::evaluate(ast) ? 0 : 1;
+            } else if (run) {
+                auto bytecode = mango::compile_bytecode(ast);
+                if (bytecode.functions.empty()) {
+                    return 1;
+                }
+                return mango::VM(bytecode, stdout, compile).run() ? 0 : 1;
+            } else if (emit == Emit::Bytecode) {
+                auto bytecode = mango::compile_bytecode(ast);
+                if (bytecode.functions.empty()) {
+                    return 1;
+                }
+                std::cout << bytecode.print();
+            } else {
+                auto c = ast.generate();
+                if (c.empty()) {
+                    return 1;
+                }
+                std::cout << c;
+            }
+            return 0;
+        });
+        if (status != 0) {
+            return status;
+        }
+    }
 
-int main() {
-    std::string src = "var x = 1;"
-                      "x = x + 123 + 12;"
-                      "if(x > 50) {"
-                      "x = x + 34;"
-                      "}";
-
-
-    mango::Lexer lexer;
-    auto tokens = lexer.get_tokens(src);
-    mango::Parser parser;
-    auto ast = parser.parse(tokens);
-    std::cout << ast.print() << "\n";
-    auto out = ast.generate();
-    std::cout << out;
     return 0;
 }
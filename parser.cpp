@@ -1,27 +1,30 @@
 #include "parser.h"
 
+#include <algorithm>
+
 namespace mango {
 
-Token Parser::current_token() {
-    return tokens.at(index);
+const Token &Parser::current_token() {
+    return tokens->at(index);
 }
 
-Token Parser::next_token() {
-    return tokens.at(++index);
+const Token &Parser::next_token() {
+    return tokens->at(++index);
 }
 
-Token Parser::peek_next_token() {
-    return tokens.at(index + 1);
+const Token &Parser::peek_next_token() {
+    return tokens->at(index + 1);
 }
 
 void Parser::backup() {
     index--;
 }
 
-Token Parser::expect(TokenType type) {
-    auto t = next_token();
+const Token &Parser::expect(TokenType type) {
+    auto &t = next_token();
     if (t.type != type) {
         std::cerr << "expected token type \"" << type << "\" and got " << t << "\"\n";
+        failed = true;
         assert(false);
     }
     return t;
@@ -33,103 +36,71 @@ void Parser::expect_optional(TokenType type) {
     }
 }
 
-Operator Parser::get_operator() {
-    auto t = current_token();
-    auto next = peek_next_token();
-
-    switch (t.type) {
-        case TokenType::Keyword:
-        case TokenType::Identifier:
-        case TokenType::Number:
-        case TokenType::String:
-        case TokenType::Colon:
-        case TokenType::Dot:
-        case TokenType::Comma:
-        case TokenType::SemiColon:
-        case TokenType::LeftParen:
-        case TokenType::RightParen:
-        case TokenType::LeftBrace:
-        case TokenType::RightBrace:
-        case TokenType::LeftBracket:
-        case TokenType::RightBracket:
-        case TokenType::NewLine:
-        case TokenType::EndOfFile:
-            std::cerr << "invalid operator \"" << t.value << "\"\n";
-            assert(false);
-        case TokenType::Plus:
-            return Operator::Plus;
-        case TokenType::Minus:
-            return Operator::Minus;
-        case TokenType::Asterisk:
-            return Operator::Multiply;
-        case TokenType::Slash:
-            return Operator::Divide;
-        case TokenType::Equals:
-            if (next.type != TokenType::Equals) {
-                break;
-            }
-            next_token();
-            return Operator::EqualTo;
-        case TokenType::Exclamation:
-            if (next.type == TokenType::Equals) {
-                next_token();
-                return Operator::NotEqualTo;
-            }
+// binary operators are one or two tokens long, second is EndOfFile for
+// single token operators. two token operators come first so "<=" is
+// matched before "<".
+struct BinaryOperatorTokens {
+    TokenType first;
+    TokenType second;
+    Operator op;
+};
 
-            return Operator::Not;
-        case TokenType::Ampersand: {
-            if (next.type == TokenType::Ampersand) {
-                next_token();
-                return Operator::And;
-            }
+const BinaryOperatorTokens binary_operator_tokens[] = {
+        {TokenType::Equals,            TokenType::Equals,    Operator::EqualTo},
+        {TokenType::Exclamation,       TokenType::Equals,    Operator::NotEqualTo},
+        {TokenType::LeftAngleBracket,  TokenType::Equals,    Operator::LessThanOrEqualTo},
+        {TokenType::RightAngleBracket, TokenType::Equals,    Operator::GreaterThanOrEqualTo},
+        {TokenType::Ampersand,         TokenType::Ampersand, Operator::And},
+        {TokenType::Pipe,              TokenType::Pipe,      Operator::Or},
+        {TokenType::LeftAngleBracket,  TokenType::EndOfFile, Operator::LessThan},
+        {TokenType::RightAngleBracket, TokenType::EndOfFile, Operator::GreaterThan},
+        {TokenType::Plus,              TokenType::EndOfFile, Operator::Plus},
+        {TokenType::Minus,             TokenType::EndOfFile, Operator::Minus},
+        {TokenType::Asterisk,          TokenType::EndOfFile, Operator::Multiply},
+        {TokenType::Slash,             TokenType::EndOfFile, Operator::Divide},
+};
 
-            // TODO: handle bitwise & operator
+bool Parser::peek_binary_operator(Operator &op, int &length) {
+    auto first = peek_next_token().type;
 
-            assert(false);
+    for (auto &entry : binary_operator_tokens) {
+        if (entry.first != first) {
+            continue;
         }
-        case TokenType::Pipe: {
-            if (next.type == TokenType::Pipe) {
-                next_token();
-                return Operator::Or;
-            }
 
-            // TODO: handle bitwise | operator
+        if (entry.second == TokenType::EndOfFile) {
+            op = entry.op;
+            length = 1;
+            return true;
+        }
 
-            assert(false);
+        if (tokens->at(index + 2).type == entry.second) {
+            op = entry.op;
+            length = 2;
+            return true;
         }
-        case TokenType::LeftAngleBracket:
-            if (next.type == TokenType::Equals) {
-                next_token();
-                return Operator::LessThanOrEqualTo;
-            }
-            return Operator::LessThan;
-        case TokenType::RightAngleBracket:
-            if (next.type == TokenType::Equals) {
-                next_token();
-                return Operator::GreaterThanOrEqualTo;
-            }
-            return Operator::GreaterThan;
     }
 
-    std::cerr << "invalid operator \"" << t.value << "\"\n";
-    assert(false);
+    return false;
+}
+
+bool Parser::is_assignment() {
+    // "x = ..." but not "x == ..."
+    return peek_next_token().type == TokenType::Equals && tokens->at(index + 2).type != TokenType::Equals;
 }
 
 Statement* Parser::get_declaration_statement() {
-    auto type_token = expect(TokenType::Keyword);
     // declarations with var only for now
-    assert(type_token.value == "var");
+    expect(TokenType::KwVar);
 
-    auto id_token = expect(TokenType::Identifier);
+    auto identifier = arena->copy_string(expect(TokenType::Identifier).value());
 
     expect(TokenType::Equals);
 
-    auto next = next_token();
-
     Expression* value;
 
-    if (next.type == TokenType::SemiColon) {
-        value = new UndefinedExpression();
+    if (next_token().type == TokenType::SemiColon) {
+        value = arena->make<UndefinedExpression>();
     } else {
         backup();
         value = get_expression();
@@ -138,24 +109,22 @@ Statement* Parser::get_declaration_statement() {
         }
     }
 
-    auto s = new DeclarationStatement;
-    // TODO: check expressions for type
-    s->data_type = DataType::Integer;
-    s->identifier = id_token.value;
+    // the type is left undefined for infer_types
+    auto s = arena->make<DeclarationStatement>();
+    s->identifier = identifier;
     s->value = value;
 
     return s;
 }
 
 Statement* Parser::get_return_statement() {
-    auto keyword_token = expect(TokenType::Keyword);
-    assert(keyword_token.value == "return");
+    expect(TokenType::KwReturn);
 
-    auto s = new ReturnStatement;
+    auto s = arena->make<ReturnStatement>();
 
     // check for return without a value
     if (peek_next_token().type == TokenType::SemiColon) {
-        s->value = new UndefinedExpression;
+        s->value = arena->make<UndefinedExpression>();
         return s;
     }
 
@@ -165,80 +134,28 @@ Statement* Parser::get_return_statement() {
     return s;
 }
 
-Statement* Parser::get_if_statement() {
-    auto keyword_token = expect(TokenType::Keyword);
-    assert(keyword_token.value == "if");
-
-    expect(TokenType::LeftParen);
-    auto condition = get_expression();
-    expect(TokenType::RightParen);
-
-    auto if_block = get_statement();
-    Statement* else_block = nullptr;
-
-    auto next = peek_next_token();
-    if (next.type == TokenType::Keyword && next.value == "else") {
-        next_token();
-        else_block = get_statement();
-    }
-
-    auto s = new IfStatement;
-    s->condition = condition;
-    s->if_block = if_block;
-    s->else_block = else_block;
-
-    return s;
-}
-
-Statement* Parser::get_while_statement() {
-    auto keyword_token = expect(TokenType::Keyword);
-    assert(keyword_token.value == "while");
-
-    expect(TokenType::LeftParen);
-    auto condition = get_expression();
-    expect(TokenType::RightParen);
-
-    auto body = get_statement();
-
-    auto s = new WhileStatement;
-    s->condition = condition;
-    s->body = body;
-    return s;
-}
-
-Statement* Parser::get_block_statement() {
-    expect(TokenType::LeftBrace);
-
-    auto s = new BlockStatement;
-
-    // check for empty block
-    if (peek_next_token().type != TokenType::RightBrace) {
-        s->statements = get_statements();
-    }
-
-    expect(TokenType::RightBrace);
-    expect_optional(TokenType::SemiColon);
-
-    return s;
+ArenaArray<Expression*> Parser::pop_expressions(size_t first) {
+    auto expressions = arena->copy_array<Expression*>(expression_stack.begin() + first, expression_stack.end());
+    expression_stack.resize(first);
+    return expressions;
 }
 
 Statement* Parser::get_expression_statement() {
-    auto s = new ExpressionStatement();
+    auto s = arena->make<ExpressionStatement>();
     s->value = get_expression();
     expect_optional(TokenType::SemiColon);
     return s;
 }
 
 Expression* Parser::get_function_expression() {
-    auto keyword_token = expect(TokenType::Keyword);
-    assert(keyword_token.value == "func");
+    expect(TokenType::KwFunc);
 
     expect(TokenType::LeftParen);
 
-    auto params = std::vector<std::string>();
+    auto first_param = name_stack.size();
 
     while (peek_next_token().type == TokenType::Identifier) {
-        params.push_back(next_token().value);
+        name_stack.push_back(arena->copy_string(next_token().value()));
         if (peek_next_token().type == TokenType::Comma) {
             next_token();
         }
@@ -248,22 +165,24 @@ Expression* Parser::get_function_expression() {
 
     auto body = get_statement();
 
-    auto fe = new FunctionExpression();
-    fe->parameters = params;
+    auto fe = arena->make<FunctionExpression>();
+    fe->parameters = arena->copy_array<std::string_view>(name_stack.begin() + first_param, name_stack.end());
+    name_stack.resize(first_param);
     fe->body = body;
 
     return fe;
 }
 
 Expression* Parser::get_function_call_expression() {
-    auto id_token = expect(TokenType::Identifier);
+    auto name = arena->copy_string(expect(TokenType::Identifier).value());
 
     expect(TokenType::LeftParen);
 
-    auto args = std::vector<Expression*>();
+    auto first_arg = expression_stack.size();
 
-    while (peek_next_token().type != TokenType::RightParen) {
-        args.push_back(get_expression());
+    while (peek_next_token().type != TokenType::RightParen && peek_next_token().type != TokenType::EndOfFile) {
+        auto arg = get_expression();
+        expression_stack.push_back(arg);
         if (peek_next_token().type == TokenType::Comma) {
             next_token();
         }
@@ -271,18 +190,18 @@ Expression* Parser::get_function_call_expression() {
 
     expect(TokenType::RightParen);
 
-    auto fce = new FunctionCallExpression();
-    fce->value = id_token.value;
-    fce->arguments = args;
+    auto fce = arena->make<FunctionCallExpression>();
+    fce->value = name;
+    fce->arguments = pop_expressions(first_arg);
     return fce;
 };
 
 Expression* Parser::get_assignment_expression() {
-    auto id_token = expect(TokenType::Identifier);
+    auto name = arena->copy_string(expect(TokenType::Identifier).value());
     expect(TokenType::Equals);
-    auto ae = new AssignmentExpression();
-    auto ie = new IdentifierExpression();
-    ie->value = id_token.value;
+    auto ae = arena->make<AssignmentExpression>();
+    auto ie = arena->make<IdentifierExpression>();
+    ie->value = name;
     ae->left = ie;
     ae->right = get_expression();
     return ae;
@@ -291,13 +210,14 @@ Expression* Parser::get_assignment_expression() {
 Expression* Parser::get_object_expression() {
     expect(TokenType::LeftBrace);
 
-    std::unordered_map<std::string, Expression*> props;
+    auto first_property = property_stack.size();
 
-    while (peek_next_token().type != TokenType::RightBrace) {
-        auto id_token = expect(TokenType::Identifier);
+    while (peek_next_token().type != TokenType::RightBrace && peek_next_token().type != TokenType::EndOfFile) {
+        auto key = arena->copy_string(expect(TokenType::Identifier).value());
         expect(TokenType::Colon);
 
-        props[id_token.value] = get_expression();
+        auto value = get_expression();
+        property_stack.push_back(ObjectProperty{key, value});
 
         if (peek_next_token().type == TokenType::Comma) {
             next_token();
@@ -306,18 +226,20 @@ Expression* Parser::get_object_expression() {
 
     expect(TokenType::RightBrace);
 
-    auto oe = new ObjectExpression();
-    oe->properties = props;
+    auto oe = arena->make<ObjectExpression>();
+    oe->properties = arena->copy_array<ObjectProperty>(property_stack.begin() + first_property, property_stack.end());
+    property_stack.resize(first_property);
     return oe;
 };
 
 Expression* Parser::get_array_expression() {
     expect(TokenType::LeftBracket);
 
-    std::vector<Expression*> elements;
+    auto first_element = expression_stack.size();
 
-    while (peek_next_token().type != TokenType::RightBracket) {
-        elements.push_back(get_expression());
+    while (peek_next_token().type != TokenType::RightBracket && peek_next_token().type != TokenType::EndOfFile) {
+        auto element = get_expression();
+        expression_stack.push_back(element);
         if (peek_next_token().type == TokenType::Comma) {
             next_token();
         }
@@ -325,27 +247,27 @@ Expression* Parser::get_array_expression() {
 
     expect(TokenType::RightBracket);
 
-    auto e = new ArrayExpression();
-    e->elements = elements;
+    auto e = arena->make<ArrayExpression>();
+    e->elements = pop_expressions(first_element);
     return e;
 };
 
 Expression* Parser::get_member_expression() {
-    auto object_id_token = expect(TokenType::Identifier);
+    auto object = arena->copy_string(expect(TokenType::Identifier).value());
     expect(TokenType::Dot);
-    auto property_id_token = expect(TokenType::Identifier);
+    auto property = arena->copy_string(expect(TokenType::Identifier).value());
 
-    auto me = new MemberExpression();
-    me->identifier = object_id_token.value;
-    auto prop = new IdentifierExpression();
-    prop->value = property_id_token.value;
+    auto me = arena->make<MemberExpression>();
+    me->identifier = object;
+    auto prop = arena->make<IdentifierExpression>();
+    prop->value = property;
     me->property = prop;
 
     return me;
 };
 
-Expression* Parser::get_expression() {
-    auto t = next_token();
+Expression* Parser::get_primary_expression() {
+    auto &t = next_token();
 
     Expression* left;
 
@@ -363,9 +285,9 @@ Expression* Parser::get_expression() {
                 backup();
                 auto me = get_member_expression();
 
-                if (peek_next_token().type == TokenType::Equals) {
+                if (is_assignment()) {
                     expect(TokenType::Equals);
-                    auto ae = new AssignmentExpression();
+                    auto ae = arena->make<AssignmentExpression>();
                     ae->left = me;
                     ae->right = get_expression();
                     return ae;
@@ -373,40 +295,49 @@ Expression* Parser::get_expression() {
 
                 left = me;
             } else if (peek_next_token().type == TokenType::LeftBracket) {
+                // t is only valid until the cursor moves past it
+                auto identifier = arena->copy_string(t.value());
                 expect(TokenType::LeftBracket);
                 auto inner = get_expression();
                 expect(TokenType::RightBracket);
 
-                auto me = new MemberExpression();
-                me->identifier = t.value;
+                auto me = arena->make<MemberExpression>();
+                me->identifier = identifier;
                 me->property = inner;
+                me->computed = true;
+
+                if (is_assignment()) {
+                    expect(TokenType::Equals);
+                    auto ae = arena->make<AssignmentExpression>();
+                    ae->left = me;
+                    ae->right = get_expression();
+                    return ae;
+                }
                 return me;
-            } else if (peek_next_token().type == TokenType::Equals) {
+            } else if (is_assignment()) {
                 backup();
                 left = get_assignment_expression();
             } else {
-                auto ie = new IdentifierExpression();
-                ie->value = t.value;
+                auto ie = arena->make<IdentifierExpression>();
+                ie->value = arena->copy_string(t.value());
                 left = ie;
             }
             break;
         }
 
-        case TokenType::Keyword: {
-            backup();
-
-            if (t.value == "true" || t.value == "false") {
-                auto ble = new BooleanLiteralExpression();
-                ble->value = t.value == "true";
-                left = ble;
-                next_token();
-            } else {
-                return get_function_expression();
-            }
-
+        case TokenType::KwTrue:
+        case TokenType::KwFalse: {
+            auto ble = arena->make<BooleanLiteralExpression>();
+            ble->value = t.type == TokenType::KwTrue;
+            left = ble;
             break;
         }
 
+        case TokenType::KwFunc: {
+            backup();
+            return get_function_expression();
+        }
+
         case TokenType::LeftBrace: {
             backup();
             return get_object_expression();
@@ -416,127 +347,378 @@ Expression* Parser::get_expression() {
             return get_array_expression();
         }
         case TokenType::Number: {
-            auto ile = new IntegerLiteralExpression;
-            ile->value = atoi(t.value.data());
+            if (t.number == number_too_large) {
+                std::cerr << "integer literal " << t.value() << " at " << t.line << ":" << t.column
+                          << " is too large\n";
+                failed = true;
+            }
+            auto ile = arena->make<IntegerLiteralExpression>();
+            ile->value = t.number;
             left = ile;
             break;
         }
         case TokenType::String: {
-            auto sle = new StringLiteralExpression;
-            sle->value = t.value;
+            if (t.number == unterminated_string) {
+                // still parses as a string to the end of the file, so a
+                // reparse mid-edit keeps going
+                std::cerr << "unterminated string starting at " << t.line << ":" << t.column << "\n";
+                failed = true;
+            }
+            auto sle = arena->make<StringLiteralExpression>();
+            sle->value = arena->copy_string(t.value());
             left = sle;
             break;
         }
-        case TokenType::Exclamation: {
-            auto ue = new UnaryExpression();
-            ue->op = Operator::Not;
-            ue->argument = get_expression();
-            return ue;
-        }
         default:
         UNEXPECTED_TOKEN(t);
     }
 
-    auto next = peek_next_token();
-    // check for tokens that end an expression
-    if (next.type == TokenType::SemiColon ||
-        next.type == TokenType::RightParen ||
-        next.type == TokenType::Comma ||
-        next.type == TokenType::RightBrace ||
-        next.type == TokenType::RightBracket ||
-        next.type == TokenType::EndOfFile) {
-        return left;
+    return left;
+}
+
+Expression* Parser::get_unary_expression() {
+    // prefix operators are applied innermost first, counting them rather
+    // than recursing keeps long "!!!!x" chains off the stack
+    int nots = 0;
+    while (peek_next_token().type == TokenType::Exclamation) {
+        next_token();
+        nots++;
     }
-    next_token();
 
-    auto op = get_operator();
-    auto right = get_expression();
+    auto e = get_primary_expression();
 
-    auto b = new BinaryExpression;
-    b->op = op;
-    b->left = left;
-    b->right = right;
-    return b;
+    for (int i = 0; i < nots; i++) {
+        auto ue = arena->make<UnaryExpression>();
+        ue->op = Operator::Not;
+        ue->argument = e;
+        e = ue;
+    }
+
+    return e;
 }
 
-Statement* Parser::get_statement() {
-    auto t = next_token();
+// Precedence climbing: operators of the same precedence are folded into
+// a left leaning tree by the loop, and recursion only happens to parse a
+// tighter binding right operand, so the stack depth is bounded by the
+// number of precedence levels rather than the length of the expression.
+Expression* Parser::get_binary_expression(int min_precedence) {
+    auto left = get_unary_expression();
+
+    Operator op;
+    int length;
+    while (peek_binary_operator(op, length)) {
+        auto precedence = operator_precedence(op);
+        if (precedence < min_precedence) {
+            break;
+        }
 
-    switch (t.type) {
-        case TokenType::Keyword: {
-            if (t.value == "var") {
-                backup();
-                return get_declaration_statement();
-            }
+        for (int i = 0; i < length; i++) {
+            next_token();
+        }
 
-            if (t.value == "return") {
-                backup();
-                return get_return_statement();
-            }
+        auto b = arena->make<BinaryExpression>();
+        b->op = op;
+        b->left = left;
+        b->right = get_binary_expression(precedence + 1);
+        left = b;
+    }
 
-            if (t.value == "if") {
-                backup();
-                return get_if_statement();
+    return left;
+}
+
+Expression* Parser::get_expression() {
+    return get_binary_expression(lowest_precedence);
+}
+
+void Parser::end_statement(Statement* s) {
+    auto &last = current_token();
+    s->length = last.offset + last.length - top_level_offset - s->offset;
+}
+
+// Statements that contain statements (blocks, if and while) don't
+// recurse, the statement they're waiting on is parsed by the same loop
+// after pushing a frame for them on statement_frames. Nesting depth is
+// then only limited by memory, generated code nests blocks and if
+// chains far deeper than the C++ stack allows.
+Statement* Parser::get_statement() {
+    auto base = statement_frames.size();
+
+    while (true) {
+        // descend until a statement without nested statements is parsed
+        Statement* result = nullptr;
+
+        while (result == nullptr) {
+            auto &t = next_token();
+            auto line = t.line - top_level_line;
+            auto offset = t.offset - top_level_offset;
+
+            switch (t.type) {
+                case TokenType::KwVar: {
+                    backup();
+                    result = get_declaration_statement();
+                    break;
+                }
+                case TokenType::KwReturn: {
+                    backup();
+                    result = get_return_statement();
+                    break;
+                }
+                case TokenType::KwIf: {
+                    expect(TokenType::LeftParen);
+                    auto s = arena->make<IfStatement>();
+                    s->condition = get_expression();
+                    expect(TokenType::RightParen);
+                    s->line = line;
+                    s->offset = offset;
+                    statement_frames.push_back({StatementFrame::If, s, 0});
+                    break;
+                }
+                case TokenType::KwWhile: {
+                    expect(TokenType::LeftParen);
+                    auto s = arena->make<WhileStatement>();
+                    s->condition = get_expression();
+                    expect(TokenType::RightParen);
+                    s->line = line;
+                    s->offset = offset;
+                    statement_frames.push_back({StatementFrame::While, s, 0});
+                    break;
+                }
+                case TokenType::KwTrue:
+                case TokenType::KwFalse: {
+                    backup();
+                    result = get_expression_statement();
+                    break;
+                }
+
+                case TokenType::Identifier:
+                case TokenType::Number:
+                case TokenType::String:
+                case TokenType::LeftParen:
+                case TokenType::Exclamation: {
+                    backup();
+                    auto s = arena->make<ExpressionStatement>();
+                    s->value = get_expression();
+                    expect_optional(TokenType::SemiColon);
+                    result = s;
+                    break;
+                }
+                case TokenType::LeftBrace: {
+                    auto s = arena->make<BlockStatement>();
+                    s->line = line;
+                    s->offset = offset;
+                    // check for empty block
+                    if (peek_next_token().type == TokenType::RightBrace) {
+                        next_token();
+                        expect_optional(TokenType::SemiColon);
+                        result = s;
+                    } else {
+                        statement_frames.push_back({StatementFrame::Block, s, statement_stack.size()});
+                    }
+                    break;
+                }
+                default:
+                UNEXPECTED_TOKEN(t);
+                    return nullptr;
             }
 
-            if (t.value == "while") {
-                backup();
-                return get_while_statement();
+            if (result != nullptr) {
+                result->line = line;
+                result->offset = offset;
+                end_statement(result);
             }
+        }
 
-            if (t.value == "true" || t.value == "false") {
-                backup();
-                return get_expression_statement();
+        // ascend, handing the parsed statement to the frames waiting on it
+        // until one of them needs another statement
+        bool descend = false;
+
+        while (!descend && statement_frames.size() > base) {
+            auto &frame = statement_frames.back();
+
+            switch (frame.kind) {
+                case StatementFrame::If: {
+                    auto s = static_cast<IfStatement*>(frame.statement);
+                    s->if_block = result;
+                    if (peek_next_token().type == TokenType::KwElse) {
+                        next_token();
+                        frame.kind = StatementFrame::Else;
+                        descend = true;
+                        continue;
+                    }
+                    break;
+                }
+                case StatementFrame::Else:
+                    static_cast<IfStatement*>(frame.statement)->else_block = result;
+                    break;
+                case StatementFrame::While:
+                    static_cast<WhileStatement*>(frame.statement)->body = result;
+                    break;
+                case StatementFrame::Block: {
+                    statement_stack.push_back(result);
+
+                    auto next = peek_next_token().type;
+                    if (next == TokenType::NewLine) {
+                        next_token();
+                        next = peek_next_token().type;
+                    }
+                    if (next != TokenType::EndOfFile && next != TokenType::RightBrace) {
+                        descend = true;
+                        continue;
+                    }
+
+                    auto s = static_cast<BlockStatement*>(frame.statement);
+                    s->statements = arena->copy_array<Statement*>(statement_stack.begin() + frame.first,
+                                                                  statement_stack.end());
+                    statement_stack.resize(frame.first);
+                    expect(TokenType::RightBrace);
+                    expect_optional(TokenType::SemiColon);
+                    break;
+                }
             }
 
-            UNEXPECTED_TOKEN(t);
+            result = frame.statement;
+            end_statement(result);
+            statement_frames.pop_back();
         }
 
-        case TokenType::Identifier:
-        case TokenType::Number:
-        case TokenType::String:
-        case TokenType::LeftParen:
-        case TokenType::Exclamation: {
-            backup();
-            auto s = new ExpressionStatement();
-            s->value = get_expression();
-            expect_optional(TokenType::SemiColon);
-            return s;
+        if (!descend) {
+            return result;
         }
-        case TokenType::LeftBrace: {
-            backup();
-            return get_block_statement();
-        }
-        default:
-        UNEXPECTED_TOKEN(t);
     }
-};
+}
 
-std::vector<Statement*> Parser::get_statements() {
-    std::vector<Statement*> statements;
+Statement* Parser::get_top_level_statement() {
+    auto &t = peek_next_token();
+    top_level_line = t.line;
+    top_level_offset = t.offset;
 
-    auto next = peek_next_token();
+    auto s = get_statement();
+    s->line = top_level_line;
+    s->offset = top_level_offset;
+    return s;
+}
 
-    while (next.type != TokenType::EndOfFile && next.type != TokenType::RightBrace) {
-        statements.push_back(get_statement());
-        next = peek_next_token();
-        if(next.type == TokenType::NewLine) {
+size_t Parser::get_statements() {
+    auto first = statement_stack.size();
+
+    auto next = peek_next_token().type;
+
+    while (next != TokenType::EndOfFile && next != TokenType::RightBrace) {
+        auto s = get_top_level_statement();
+        statement_stack.push_back(s);
+        next = peek_next_token().type;
+        if (next == TokenType::NewLine) {
             next_token();
-            next = peek_next_token();
+            next = peek_next_token().type;
         }
     }
 
-    return statements;
+    return first;
 }
 
-Program Parser::parse(std::vector<Token> tokens) {
-    this->tokens = tokens;
+Program Parser::parse(TokenStream &tokens) {
+    this->tokens = &tokens;
+    index = 0;
+    failed = false;
 
     Program program;
+    arena = &program.arena;
     backup();
-    program.statements = get_statements();
+    auto first = get_statements();
+    program.statements.assign(statement_stack.begin() + first, statement_stack.end());
+    statement_stack.resize(first);
+    arena = nullptr;
 
     return program;
 }
 
+Program Parser::parse(const std::vector<Token> &tokens) {
+    TokenStream stream(tokens);
+    return parse(stream);
+}
+
+ReparseResult Parser::reparse(Program &program, const SourceFile &src, const TextEdit &edit) {
+    auto &statements = program.statements;
+    auto text = src.text();
+    auto edit_end = edit.offset + edit.removed;
+    int64_t delta = static_cast<int64_t>(edit.inserted.size()) - edit.removed;
+
+    // start at the first statement reaching the edit, or the one before it
+    // as a statement without a semicolon can run on into the edited text
+    size_t first = std::lower_bound(statements.begin(), statements.end(), edit.offset,
+                                    [](Statement* s, uint32_t offset) { return s->offset + s->length < offset; }) -
+                   statements.begin();
+    if (first > 0) {
+        first--;
+    }
+
+    size_t start = 0;
+    int line = 1;
+    int column = 1;
+    if (first > 0) {
+        start = statements[first]->offset;
+        line = statements[first]->line;
+        auto line_start = text.rfind('\n', start - 1);
+        column = line_start == std::string_view::npos ? start + 1 : start - line_start;
+    }
+
+    // the old statements from resume on start after the edit, parsing can
+    // stop once it reaches where one of them starts now
+    size_t resume = first;
+    while (resume < statements.size() && statements[resume]->offset < edit_end) {
+        resume++;
+    }
+
+    TokenStream stream(src, start, line, column);
+    this->tokens = &stream;
+    index = 0;
+    failed = false;
+    arena = &program.arena;
+    backup();
+
+    auto first_new = statement_stack.size();
+    int line_delta = 0;
+
+    while (true) {
+        auto next = peek_next_token().type;
+        if (next == TokenType::NewLine) {
+            next_token();
+            next = peek_next_token().type;
+        }
+
+        if (next == TokenType::EndOfFile || next == TokenType::RightBrace) {
+            resume = statements.size();
+            break;
+        }
+
+        auto &t = peek_next_token();
+        while (resume < statements.size() && statements[resume]->offset + delta < t.offset) {
+            resume++;
+        }
+        if (resume < statements.size() && statements[resume]->offset + delta == t.offset) {
+            line_delta = t.line - statements[resume]->line;
+            break;
+        }
+
+        statement_stack.push_back(get_top_level_statement());
+    }
+
+    // nested statements are relative to their top level statement, only
+    // the kept top level statements after the edit have to move
+    for (size_t i = resume; i < statements.size(); i++) {
+        statements[i]->offset += delta;
+        statements[i]->line += line_delta;
+    }
+
+    ReparseResult result{first, resume - first, statement_stack.size() - first_new};
+    statements.erase(statements.begin() + first, statements.begin() + resume);
+    statements.insert(statements.begin() + first, statement_stack.begin() + first_new, statement_stack.end());
+    statement_stack.resize(first_new);
+
+    this->tokens = nullptr;
+    arena = nullptr;
+
+    return result;
+}
+
 }
\ No newline at end of file
@@ -1,36 +1,73 @@
 #pragma once
 
+#include <cassert>
 #include <vector>
 #include <exception>
 #include <cstdlib>
 
 #include "token.h"
+#include "token_stream.h"
 #include "ast.h"
 
 // TODO: we just crash for now, but we should have
 //  a way of returning a helpful error in the future
 #define UNEXPECTED_TOKEN(t) \
-std::cerr << "unexpected token \"" << t.value << "\"\n"; \
+std::cerr << "unexpected token \"" << t.value() << "\"\n"; \
+failed = true; \
 assert(false);
 
 namespace mango {
 
+// which top level statements an incremental reparse replaced: the
+// removed statements starting at first were replaced with inserted new
+// ones
+struct ReparseResult {
+    size_t first;
+    size_t removed;
+    size_t inserted;
+};
+
 class Parser {
     int index = 0;
-    std::vector<Token> tokens;
+    TokenStream* tokens = nullptr;
+    // the arena of the program being parsed
+    Arena* arena = nullptr;
+
+    // Child lists are collected on these stacks while they're parsed and
+    // then copied into the arena in one go, nested lists are pushed on
+    // top and popped before the outer list continues.
+    std::vector<Statement*> statement_stack;
+    std::vector<Expression*> expression_stack;
+    std::vector<ObjectProperty> property_stack;
+    std::vector<std::string_view> name_stack;
 
-    Token current_token();
-    Token next_token();
-    Token peek_next_token();
+    // a statement waiting on a nested statement, see get_statement
+    struct StatementFrame {
+        enum Kind : uint8_t { Block, If, Else, While };
+        Kind kind;
+        Statement* statement;
+        // Block: where its statements start on statement_stack
+        size_t first;
+    };
+    std::vector<StatementFrame> statement_frames;
+
+    // where the top level statement being parsed starts, the statements
+    // nested in it are positioned relative to it
+    int top_level_line = 0;
+    uint32_t top_level_offset = 0;
+
+    // tokens are borrowed from the stream, a reference is only valid
+    // until the parser has moved a couple of tokens past it
+    const Token &current_token();
+    const Token &next_token();
+    const Token &peek_next_token();
     void backup();
-    Token expect(TokenType type);
+    const Token &expect(TokenType type);
     void expect_optional(TokenType type);
-    Operator get_operator();
-    Statement* get_block_statement();
+    bool peek_binary_operator(Operator &op, int &length);
+    bool is_assignment();
     Statement* get_declaration_statement();
     Statement* get_return_statement();
-    Statement* get_if_statement();
-    Statement* get_while_statement();
     Statement* get_expression_statement();
     Expression* get_assignment_expression();
     Expression* get_member_expression();
@@ -38,12 +75,32 @@ class Parser {
     Expression* get_array_expression();
     Expression* get_function_expression();
     Expression* get_function_call_expression();
+    Expression* get_primary_expression();
+    Expression* get_unary_expression();
+    Expression* get_binary_expression(int min_precedence);
     Expression* get_expression();
     Statement* get_statement();
-    std::vector<Statement*> get_statements();
+    Statement* get_top_level_statement();
+    // sets the length of s to end at the current token
+    void end_statement(Statement* s);
+    // parses statements onto statement_stack, returns the index of the first
+    size_t get_statements();
+    ArenaArray<Expression*> pop_expressions(size_t first);
 
 public:
-    Program parse(std::vector<Token> tokens);
+    // set when the last parse or reparse reported an error
+    bool failed = false;
+
+    Program parse(TokenStream &tokens);
+    // parses an already lexed token array in place, tokens must end with
+    // an EndOfFile token
+    Program parse(const std::vector<Token> &tokens);
+    // Updates program, parsed from src before edit was applied to it, to
+    // match the edited src. Only the top level statements around the edit
+    // are parsed again, parsing stops as soon as it lines up with the
+    // start of an old statement after the edit and the rest are kept.
+    // Replaced statements stay allocated in the program's arena.
+    ReparseResult reparse(Program &program, const SourceFile &src, const TextEdit &edit);
 };
 
 }
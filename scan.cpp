@@ -0,0 +1,371 @@
+#include "scan.h"
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MANGO_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+#include "char_class.h"
+
+namespace mango {
+
+void count_newlines(LineCount &lines, uint32_t mask, size_t base) {
+    if (mask) {
+        lines.newlines += __builtin_popcount(mask);
+        lines.last_newline = base + 31 - __builtin_clz(mask);
+    }
+}
+
+size_t skip_whitespace_scalar(const char* s, size_t i, size_t end, LineCount &lines) {
+    for (; i < end; i++) {
+        auto kind = char_class(s[i]).kind;
+        if (kind == CharKind::NewLine) {
+            lines.newlines++;
+            lines.last_newline = i;
+        } else if (kind != CharKind::Whitespace) {
+            break;
+        }
+    }
+    return i;
+}
+
+size_t skip_identifier_scalar(const char* s, size_t i, size_t end) {
+    while (i < end && char_class(s[i]).identifier_continue) {
+        i++;
+    }
+    return i;
+}
+
+size_t skip_digits_scalar(const char* s, size_t i, size_t end) {
+    while (i < end && char_class(s[i]).kind == CharKind::Digit) {
+        i++;
+    }
+    return i;
+}
+
+size_t find_string_end_scalar(const char* s, size_t i, size_t end, LineCount &lines) {
+    for (; i < end && s[i] != '"'; i++) {
+        if (s[i] == '\n') {
+            lines.newlines++;
+            lines.last_newline = i;
+        }
+    }
+    return i;
+}
+
+#ifdef MANGO_SCAN_X86
+
+// The vector versions classify a whole block at once and turn it into a
+// bitmask with one bit per byte, the first zero bit ends the run. Blocks
+// are only loaded while they fit in the source, the tail is handled by
+// the scalar version.
+//
+// Most runs in typical code are a handful of characters, so the first
+// few are checked one at a time before paying for a vector load.
+constexpr size_t short_run = 8;
+
+// bytes in [lo, hi], using a signed compare since sse2 has no unsigned one
+__attribute__((target("sse2")))
+inline __m128i in_range_sse2(__m128i v, char lo, char hi) {
+    auto shifted = _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(0x80 - lo)));
+    return _mm_cmpgt_epi8(_mm_set1_epi8(static_cast<char>(0x80 + hi - lo + 1)), shifted);
+}
+
+__attribute__((target("sse2")))
+size_t skip_whitespace_sse2(const char* s, size_t i, size_t end, LineCount &lines) {
+    for (auto short_end = i + short_run; i < end && i < short_end; i++) {
+        auto kind = char_class(s[i]).kind;
+        if (kind == CharKind::NewLine) {
+            lines.newlines++;
+            lines.last_newline = i;
+        } else if (kind != CharKind::Whitespace) {
+            return i;
+        }
+    }
+
+    while (i + 16 <= end) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        auto newline = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+        auto space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+        auto whitespace = _mm_or_si128(_mm_or_si128(space, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))), newline);
+
+        uint32_t newline_mask = _mm_movemask_epi8(newline);
+        uint32_t stop_mask = ~_mm_movemask_epi8(whitespace) & 0xffff;
+        if (stop_mask) {
+            auto n = __builtin_ctz(stop_mask);
+            count_newlines(lines, newline_mask & ((1u << n) - 1), i);
+            return i + n;
+        }
+
+        count_newlines(lines, newline_mask, i);
+        i += 16;
+    }
+    return skip_whitespace_scalar(s, i, end, lines);
+}
+
+__attribute__((target("sse2")))
+size_t skip_identifier_sse2(const char* s, size_t i, size_t end) {
+    for (auto short_end = i + short_run; i < end && i < short_end; i++) {
+        if (!(char_class(s[i]).identifier_continue)) {
+            return i;
+        }
+    }
+
+    while (i + 16 <= end) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        // setting bit 5 folds upper case letters onto lower case ones
+        auto letter = in_range_sse2(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+        auto digit = in_range_sse2(v, '0', '9');
+        auto underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+        auto identifier = _mm_or_si128(_mm_or_si128(letter, digit), underscore);
+
+        uint32_t stop_mask = ~_mm_movemask_epi8(identifier) & 0xffff;
+        if (stop_mask) {
+            return i + __builtin_ctz(stop_mask);
+        }
+        i += 16;
+    }
+    return skip_identifier_scalar(s, i, end);
+}
+
+__attribute__((target("sse2")))
+size_t skip_digits_sse2(const char* s, size_t i, size_t end) {
+    for (auto short_end = i + short_run; i < end && i < short_end; i++) {
+        if (!(char_class(s[i]).kind == CharKind::Digit)) {
+            return i;
+        }
+    }
+
+    while (i + 16 <= end) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        uint32_t stop_mask = ~_mm_movemask_epi8(in_range_sse2(v, '0', '9')) & 0xffff;
+        if (stop_mask) {
+            return i + __builtin_ctz(stop_mask);
+        }
+        i += 16;
+    }
+    return skip_digits_scalar(s, i, end);
+}
+
+__attribute__((target("sse2")))
+size_t find_string_end_sse2(const char* s, size_t i, size_t end, LineCount &lines) {
+    while (i + 16 <= end) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        uint32_t newline_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        uint32_t quote_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+        if (quote_mask) {
+            auto n = __builtin_ctz(quote_mask);
+            count_newlines(lines, newline_mask & ((1u << n) - 1), i);
+            return i + n;
+        }
+
+        count_newlines(lines, newline_mask, i);
+        i += 16;
+    }
+    return find_string_end_scalar(s, i, end, lines);
+}
+
+__attribute__((target("avx2")))
+inline __m256i in_range_avx2(__m256i v, char lo, char hi) {
+    auto shifted = _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(0x80 - lo)));
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(0x80 + hi - lo + 1)), shifted);
+}
+
+__attribute__((target("avx2")))
+size_t skip_whitespace_avx2(const char* s, size_t i, size_t end, LineCount &lines) {
+    for (auto short_end = i + short_run; i < end && i < short_end; i++) {
+        auto kind = char_class(s[i]).kind;
+        if (kind == CharKind::NewLine) {
+            lines.newlines++;
+            lines.last_newline = i;
+        } else if (kind != CharKind::Whitespace) {
+            return i;
+        }
+    }
+
+    while (i + 32 <= end) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+        auto newline = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+        auto space = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                     _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+        auto whitespace = _mm256_or_si256(_mm256_or_si256(space, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))),
+                                          newline);
+
+        uint32_t newline_mask = _mm256_movemask_epi8(newline);
+        uint32_t stop_mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(whitespace));
+        if (stop_mask) {
+            auto n = __builtin_ctz(stop_mask);
+            count_newlines(lines, newline_mask & ((1u << n) - 1), i);
+            return i + n;
+        }
+
+        count_newlines(lines, newline_mask, i);
+        i += 32;
+    }
+    return skip_whitespace_sse2(s, i, end, lines);
+}
+
+__attribute__((target("avx2")))
+size_t skip_identifier_avx2(const char* s, size_t i, size_t end) {
+    for (auto short_end = i + short_run; i < end && i < short_end; i++) {
+        if (!(char_class(s[i]).identifier_continue)) {
+            return i;
+        }
+    }
+
+    while (i + 32 <= end) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+        auto letter = in_range_avx2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+        auto digit = in_range_avx2(v, '0', '9');
+        auto underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+        auto identifier = _mm256_or_si256(_mm256_or_si256(letter, digit), underscore);
+
+        uint32_t stop_mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(identifier));
+        if (stop_mask) {
+            return i + __builtin_ctz(stop_mask);
+        }
+        i += 32;
+    }
+    return skip_identifier_sse2(s, i, end);
+}
+
+__attribute__((target("avx2")))
+size_t skip_digits_avx2(const char* s, size_t i, size_t end) {
+    for (auto short_end = i + short_run; i < end && i < short_end; i++) {
+        if (!(char_class(s[i]).kind == CharKind::Digit)) {
+            return i;
+        }
+    }
+
+    while (i + 32 <= end) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+        uint32_t stop_mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(in_range_avx2(v, '0', '9')));
+        if (stop_mask) {
+            return i + __builtin_ctz(stop_mask);
+        }
+        i += 32;
+    }
+    return skip_digits_sse2(s, i, end);
+}
+
+__attribute__((target("avx2")))
+size_t find_string_end_avx2(const char* s, size_t i, size_t end, LineCount &lines) {
+    while (i + 32 <= end) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+        uint32_t newline_mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        uint32_t quote_mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+        if (quote_mask) {
+            auto n = __builtin_ctz(quote_mask);
+            count_newlines(lines, newline_mask & ((1u << n) - 1), i);
+            return i + n;
+        }
+
+        count_newlines(lines, newline_mask, i);
+        i += 32;
+    }
+    return find_string_end_sse2(s, i, end, lines);
+}
+
+#endif
+
+Scanner scalar_scanner{
+        skip_whitespace_scalar,
+        skip_identifier_scalar,
+        skip_digits_scalar,
+        find_string_end_scalar,
+};
+
+#ifdef MANGO_SCAN_X86
+Scanner sse2_scanner{
+        skip_whitespace_sse2,
+        skip_identifier_sse2,
+        skip_digits_sse2,
+        find_string_end_sse2,
+};
+
+Scanner avx2_scanner{
+        skip_whitespace_avx2,
+        skip_identifier_avx2,
+        skip_digits_avx2,
+        find_string_end_avx2,
+};
+#endif
+
+bool scan_implementation_supported(ScanImplementation impl) {
+    switch (impl) {
+        case ScanImplementation::Scalar:
+            return true;
+#ifdef MANGO_SCAN_X86
+        case ScanImplementation::SSE2:
+            return __builtin_cpu_supports("sse2");
+        case ScanImplementation::AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+ScanImplementation best_scan_implementation() {
+#ifdef MANGO_SCAN_X86
+    // this runs during static initialization, before libgcc may have
+    // looked at the cpu
+    __builtin_cpu_init();
+#endif
+    if (scan_implementation_supported(ScanImplementation::AVX2)) {
+        return ScanImplementation::AVX2;
+    }
+    if (scan_implementation_supported(ScanImplementation::SSE2)) {
+        return ScanImplementation::SSE2;
+    }
+    return ScanImplementation::Scalar;
+}
+
+ScanImplementation current_scan_implementation = ScanImplementation::Scalar;
+Scanner scanner = scalar_scanner;
+
+// pick the best implementation before main runs
+bool scan_implementation_selected = use_scan_implementation(best_scan_implementation());
+
+ScanImplementation scan_implementation() {
+    return current_scan_implementation;
+}
+
+bool use_scan_implementation(ScanImplementation impl) {
+    if (!scan_implementation_supported(impl)) {
+        return false;
+    }
+
+    switch (impl) {
+        case ScanImplementation::Scalar:
+            scanner = scalar_scanner;
+            break;
+#ifdef MANGO_SCAN_X86
+        case ScanImplementation::SSE2:
+            scanner = sse2_scanner;
+            break;
+        case ScanImplementation::AVX2:
+            scanner = avx2_scanner;
+            break;
+#endif
+    }
+
+    current_scan_implementation = impl;
+    return true;
+}
+
+const char* scan_implementation_name(ScanImplementation impl) {
+    switch (impl) {
+        case ScanImplementation::Scalar:
+            return "scalar";
+        case ScanImplementation::SSE2:
+            return "sse2";
+        case ScanImplementation::AVX2:
+            return "avx2";
+    }
+    return "unknown";
+}
+
+}
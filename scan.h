@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+
+namespace mango {
+
+// Scanning primitives used by the lexer to step over runs of characters.
+// Each takes the source, the index to start at and the end of the
+// source, and returns the index of the first character that isn't part
+// of the run (or end).
+
+// newlines seen while scanning, so the lexer can keep its line and column
+// without looking at every character again
+struct LineCount {
+    int newlines = 0;
+    size_t last_newline = 0;
+};
+
+struct Scanner {
+    // spaces, tabs, carriage returns and newlines
+    size_t (*skip_whitespace)(const char* s, size_t i, size_t end, LineCount &lines);
+    // [A-Za-z0-9_]
+    size_t (*skip_identifier)(const char* s, size_t i, size_t end);
+    // [0-9]
+    size_t (*skip_digits)(const char* s, size_t i, size_t end);
+    // returns the index of the next '"'
+    size_t (*find_string_end)(const char* s, size_t i, size_t end, LineCount &lines);
+};
+
+enum class ScanImplementation {
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+// the implementation in use, defaults to the fastest one the cpu supports
+extern Scanner scanner;
+
+ScanImplementation scan_implementation();
+// switches implementation, returns false if the cpu doesn't support it
+bool use_scan_implementation(ScanImplementation impl);
+const char* scan_implementation_name(ScanImplementation impl);
+
+}
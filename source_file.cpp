@@ -0,0 +1,131 @@
+#include "source_file.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mango {
+
+// open files indexed by id, ids are reused once a file is destroyed
+std::vector<const SourceFile*> source_files;
+
+SourceFile::SourceFile(std::string path, std::string contents)
+        : file_path(std::move(path)), owned_contents(std::move(contents)) {
+    data = owned_contents.data();
+    size = owned_contents.size();
+    register_file();
+}
+
+SourceFile::~SourceFile() {
+    if (mapped) {
+        munmap(const_cast<char*>(data), size);
+    }
+
+    source_files[file_id] = nullptr;
+}
+
+void SourceFile::register_file() {
+    size_t id = 0;
+    while (id < source_files.size() && source_files[id] != nullptr) {
+        id++;
+    }
+
+    if (id > UINT16_MAX) {
+        std::cerr << "too many open source files\n";
+        assert(false);
+    }
+
+    if (id == source_files.size()) {
+        source_files.push_back(this);
+    } else {
+        source_files[id] = this;
+    }
+
+    file_id = id;
+}
+
+void SourceFile::apply_edit(const TextEdit &edit) {
+    assert(edit.offset + edit.removed <= size);
+
+    if (mapped) {
+        owned_contents.assign(data, size);
+        munmap(const_cast<char*>(data), size);
+        mapped = false;
+    }
+
+    owned_contents.replace(edit.offset, edit.removed, edit.inserted);
+    data = owned_contents.data();
+    size = owned_contents.size();
+}
+
+bool read_all(int fd, std::string &out) {
+    char buffer[64 * 1024];
+
+    while (true) {
+        auto n = read(fd, buffer, sizeof(buffer));
+        if (n == 0) {
+            return true;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        out.append(buffer, n);
+    }
+}
+
+std::unique_ptr<SourceFile> SourceFile::open(const std::string &path) {
+    auto from_stdin = path == "-";
+    int fd = from_stdin ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "could not open " << path << ": " << strerror(errno) << "\n";
+        return nullptr;
+    }
+
+    std::unique_ptr<SourceFile> file;
+
+    struct stat st{};
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        auto size = static_cast<size_t>(st.st_size);
+        auto p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            // the lexer reads the file front to back exactly once
+            madvise(p, size, MADV_SEQUENTIAL);
+            file.reset(new SourceFile(from_stdin ? "<stdin>" : path, ""));
+            file->data = static_cast<const char*>(p);
+            file->size = size;
+            file->mapped = true;
+        }
+    }
+
+    if (!file) {
+        std::string contents;
+        if (!read_all(fd, contents)) {
+            std::cerr << "could not read " << path << ": " << strerror(errno) << "\n";
+        } else {
+            file = std::make_unique<SourceFile>(from_stdin ? "<stdin>" : path, std::move(contents));
+        }
+    }
+
+    if (!from_stdin) {
+        close(fd);
+    }
+
+    return file;
+}
+
+const SourceFile* SourceFile::get(uint16_t id) {
+    assert(id < source_files.size() && source_files[id] != nullptr);
+    return source_files[id];
+}
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace mango {
+
+// replaces removed bytes at offset with inserted
+struct TextEdit {
+    uint32_t offset;
+    uint32_t removed;
+    std::string_view inserted;
+};
+
+// SourceFile owns the text of a single input. Tokens refer to their file
+// by id and to their text by offset and length into the file's buffer,
+// so a SourceFile has to outlive every token lexed from it.
+//
+// Regular files are memory-mapped so the lexer reads the page cache
+// directly, anything that can't be mapped (pipes, stdin) is read into
+// an owned buffer.
+class SourceFile {
+    uint16_t file_id;
+    std::string file_path;
+    std::string owned_contents;
+    const char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+
+    void register_file();
+
+public:
+    SourceFile(std::string path, std::string contents);
+    ~SourceFile();
+    SourceFile(const SourceFile &) = delete;
+    SourceFile &operator=(const SourceFile &) = delete;
+
+    uint16_t id() const { return file_id; }
+    const std::string &path() const { return file_path; }
+    std::string_view text() const { return {data, size}; }
+    std::string_view text(uint32_t offset, uint32_t length) const { return {data + offset, length}; }
+
+    // edits the file in place, a mapped file is copied into memory first
+    void apply_edit(const TextEdit &edit);
+
+    // opens the file at path, "-" reads from stdin. returns nullptr and
+    // prints the reason if the file can't be read.
+    static std::unique_ptr<SourceFile> open(const std::string &path);
+    static const SourceFile* get(uint16_t id);
+};
+
+}
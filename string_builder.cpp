@@ -2,28 +2,30 @@
 
 namespace string_builder {
 
-void StringBuilder::append(std::string s) {
-    for (int i = 0; i < indent; ++i) {
-        string += " ";
+void StringBuilder::append_indent() {
+    if (indent > 0) {
+        string.append(indent < max_indent ? indent : max_indent, ' ');
     }
+}
 
+void StringBuilder::append(std::string_view s) {
+    append_indent();
     string += s;
 }
 
-void StringBuilder::append_no_indent(std::string s) {
+void StringBuilder::append_no_indent(std::string_view s) {
     string += s;
 }
 
-void StringBuilder::append_line(std::string s) {
-    for (int i = 0; i < indent; ++i) {
-        string += " ";
-    }
-
-    string += s + "\n";
+void StringBuilder::append_line(std::string_view s) {
+    append_indent();
+    string += s;
+    string += '\n';
 }
 
-void StringBuilder::append_line_no_indent(std::string s) {
-    string += s + "\n";
+void StringBuilder::append_line_no_indent(std::string_view s) {
+    string += s;
+    string += '\n';
 }
 
 std::string StringBuilder::get_string() {
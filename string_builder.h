@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
 namespace string_builder {
 
@@ -8,14 +9,19 @@ class StringBuilder {
     std::string string;
     int indent = 0;
     int indent_spaces = 2;
+    // deeper code isn't indented further, so very deeply nested code
+    // doesn't make output quadratic in its depth
+    static constexpr int max_indent = 200;
+
+    void append_indent();
 
 public:
     void increase_indent() { indent += indent_spaces; }
     void decrease_indent() { indent -= indent_spaces; }
-    void append(std::string s);
-    void append_no_indent(std::string s);
-    void append_line(std::string s);
-    void append_line_no_indent(std::string s);
+    void append(std::string_view s);
+    void append_no_indent(std::string_view s);
+    void append_line(std::string_view s);
+    void append_line_no_indent(std::string_view s);
     std::string get_string();
 };
 
@@ -1,3 +1,4 @@
+#include <cassert>
 #include <iostream>
 
 #include "token.h"
@@ -6,8 +7,22 @@ namespace mango {
 
 std::string token_type_to_string(TokenType t) {
     switch (t) {
-        case TokenType::Keyword:
-            return "Keyword";
+        case TokenType::KwVar:
+            return "KwVar";
+        case TokenType::KwFunc:
+            return "KwFunc";
+        case TokenType::KwReturn:
+            return "KwReturn";
+        case TokenType::KwIf:
+            return "KwIf";
+        case TokenType::KwElse:
+            return "KwElse";
+        case TokenType::KwWhile:
+            return "KwWhile";
+        case TokenType::KwTrue:
+            return "KwTrue";
+        case TokenType::KwFalse:
+            return "KwFalse";
         case TokenType::Identifier:
             return "Identifier";
         case TokenType::Equals:
@@ -70,7 +85,7 @@ std::ostream &operator<<(std::ostream &os, const TokenType &t) {
 }
 
 std::ostream &operator<<(std::ostream &os, const Token &t) {
-    std::string value = t.value;
+    auto value = t.value();
     if (t.type == TokenType::NewLine) {
         value = "\\n";
     }
@@ -78,7 +93,7 @@ std::ostream &operator<<(std::ostream &os, const Token &t) {
     os << "{ "
        << "Type: " << token_type_to_string(t.type) << ", "
        << "Value: " << "\"" << value << "\"" << ", "
-       << "File: " << "\"" << t.file << "\"" << ", "
+       << "File: " << "\"" << SourceFile::get(t.file)->path() << "\"" << ", "
        << "Line: " << t.line << ", "
        << "Column: " << t.column << " "
        << "}";
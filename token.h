@@ -1,13 +1,24 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <iostream>
 
+#include "source_file.h"
+
 namespace mango {
 
-enum class TokenType {
-    Keyword = 1,
-    Identifier,
+enum class TokenType : uint8_t {
+    Identifier = 1,
+    KwVar,
+    KwFunc,
+    KwReturn,
+    KwIf,
+    KwElse,
+    KwWhile,
+    KwTrue,
+    KwFalse,
     Equals,
     Number,
     String,
@@ -36,14 +47,30 @@ enum class TokenType {
 
 std::ostream &operator<<(std::ostream &os, const TokenType &t);
 
+// Tokens don't own their text, value() is a view into the SourceFile
+// they were lexed from. Number tokens are decoded by the lexer.
 struct Token {
     TokenType type;
-    std::string value;
-    std::string file;
+    uint16_t file;
+    uint32_t offset;
+    uint32_t length;
     int line;
     int column;
+    int number;
+
+    std::string_view value() const { return SourceFile::get(file)->text(offset, length); }
 };
 
+static_assert(sizeof(Token) == 24, "tokens should stay small");
+
+// set in number on a String token the source ended in before its closing
+// quote, the string runs to the end of the source
+constexpr int unterminated_string = 1;
+
+// set in number on a Number token too large for an int, literals are
+// never negative since a minus is its own token
+constexpr int number_too_large = -1;
+
 std::ostream &operator<<(std::ostream &os, const Token &t);
 
 }
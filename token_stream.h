@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "lexer.h"
+#include "token.h"
+
+namespace mango {
+
+// TokenStream hands the parser tokens by reference, either from a token
+// array it borrows or lexed on demand. When lexing, only the most recent
+// tokens are kept, in a small ring buffer, which is enough for the parser
+// to look one token ahead and back up one, so memory use doesn't grow
+// with the size of the input.
+class TokenStream {
+    static constexpr int capacity = 4;
+
+    const Token* borrowed = nullptr;
+    size_t borrowed_size = 0;
+
+    Lexer lexer;
+    Token ring[capacity];
+    int lexed = 0;
+
+public:
+    explicit TokenStream(const SourceFile &src) { lexer.reset(src); }
+
+    // lexes src from start, see Lexer::reset
+    TokenStream(const SourceFile &src, size_t start, int line, int column) {
+        lexer.reset(src, start, src.text().size(), line, column);
+    }
+
+    // tokens must end with an EndOfFile token and outlive the stream
+    explicit TokenStream(const std::vector<Token> &tokens) : borrowed(tokens.data()), borrowed_size(tokens.size()) {
+        assert(!tokens.empty() && tokens.back().type == TokenType::EndOfFile);
+    }
+
+    const Token &at(int index) {
+        assert(index >= 0);
+
+        if (borrowed) {
+            // like the lexer, keep returning EndOfFile past the end
+            return borrowed[std::min(static_cast<size_t>(index), borrowed_size - 1)];
+        }
+
+        // tokens that have fallen out of the ring buffer can't be revisited
+        assert(index > lexed - capacity);
+
+        while (index >= lexed) {
+            ring[lexed % capacity] = lexer.next_token();
+            lexed++;
+        }
+
+        return ring[index % capacity];
+    }
+};
+
+}
@@ -0,0 +1,542 @@
+#include "types.h"
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "visitor.h"
+
+namespace mango {
+
+class TypeInferrer : public Visitor<TypeInferrer, DataType, void> {
+    struct Symbol {
+        DataType type = DataType::Undefined;
+        DeclarationStatement* declaration = nullptr;
+        // set when the variable is declared with a function, for calls
+        FunctionExpression* function = nullptr;
+    };
+
+    // the symbols in scope by name, declarations in inner scopes record
+    // what they shadowed in undo so leaving the scope can put it back
+    struct Shadowed {
+        std::string_view name;
+        bool existed;
+        Symbol symbol;
+    };
+
+    Program &program;
+    // the shapes made so far, by their fields
+    std::unordered_map<std::string, const Shape*> shapes;
+    // every shape each object variable has held, nullptr for an object
+    // whose shape isn't known
+    std::unordered_map<const DeclarationStatement*, std::vector<const Shape*>> held;
+
+    std::unordered_map<std::string_view, Symbol> symbols;
+    std::vector<Shadowed> undo;
+    std::vector<size_t> scopes;
+    // the functions whose bodies are being visited, innermost last
+    std::vector<FunctionExpression*> functions;
+
+    void push_scope() {
+        scopes.push_back(undo.size());
+    }
+
+    void pop_scope() {
+        while (undo.size() > scopes.back()) {
+            auto &shadowed = undo.back();
+            if (shadowed.existed) {
+                symbols[shadowed.name] = shadowed.symbol;
+            } else {
+                symbols.erase(shadowed.name);
+            }
+            undo.pop_back();
+        }
+        scopes.pop_back();
+    }
+
+    void declare(std::string_view name, const Symbol &symbol) {
+        auto it = symbols.find(name);
+        if (!scopes.empty()) {
+            undo.push_back({name, it != symbols.end(), it != symbols.end() ? it->second : Symbol{}});
+        }
+        symbols[name] = symbol;
+    }
+
+    Symbol* lookup(std::string_view name) {
+        auto it = symbols.find(name);
+        return it == symbols.end() ? nullptr : &it->second;
+    }
+
+    const Shape* intern(const std::vector<ObjectField> &fields) {
+        std::string key;
+        for (auto &f : fields) {
+            key += f.name;
+            key += ':';
+            key += std::to_string(static_cast<int>(f.type));
+            key += ':';
+            key += f.shape ? std::to_string(f.shape->id) : "?";
+            key += ':';
+            key += std::to_string(static_cast<int>(f.element_type));
+            key += ',';
+        }
+
+        auto &shape = shapes[key];
+        if (!shape) {
+            auto s = program.arena.make<Shape>();
+            s->id = static_cast<uint32_t>(program.shapes.size());
+            s->fields = program.arena.copy_array<ObjectField>(fields.begin(), fields.end());
+            program.shapes.push_back(s);
+            shape = s;
+        }
+        return shape;
+    }
+
+    // records that the variable declared by d is given value, an object
+    void hold(DeclarationStatement* d, Expression* value) {
+        auto shape = object_shape(value);
+        if (!d->shape) {
+            d->shape = shape;
+        }
+        auto &held_shapes = held[d];
+        if (std::find(held_shapes.begin(), held_shapes.end(), shape) == held_shapes.end()) {
+            held_shapes.push_back(shape);
+            // the types of a dynamic variable's fields depend on all of them
+            changed |= d->dynamic_shape;
+        }
+        if (!d->dynamic_shape && (!shape || shape != d->shape)) {
+            d->dynamic_shape = true;
+            changed = true;
+        }
+    }
+
+    static DataType element_type(const Expression* e) {
+        if (e->kind == NodeKind::ArrayExpression) {
+            return static_cast<const ArrayExpression*>(e)->element_type;
+        }
+        if (e->kind == NodeKind::IdentifierExpression) {
+            auto d = static_cast<const IdentifierExpression*>(e)->declaration;
+            return d ? d->element_type : DataType::Undefined;
+        }
+        return DataType::Undefined;
+    }
+
+    // like hold, for arrays, which can't change element type
+    void hold_elements(DeclarationStatement* d, Expression* value) {
+        auto type = element_type(value);
+        if (d->element_type == DataType::Undefined) {
+            d->element_type = type;
+        } else if (type != d->element_type && type != DataType::Undefined) {
+            mismatch("array element", d->element_type, type);
+        }
+    }
+
+    // the type of a field of a variable that holds objects of more than one
+    // shape, every shape it held that has the field has to agree on it
+    DataType dynamic_field_type(const DeclarationStatement* d, std::string_view name) {
+        auto type = DataType::Undefined;
+        bool found = false;
+        bool unknown = false;
+        for (auto shape : held[d]) {
+            auto field = shape ? shape->field(name) : -1;
+            unknown |= !shape;
+            if (field < 0) {
+                continue;
+            }
+            auto field_type = shape->fields[field].type;
+            if (found && field_type != type) {
+                mismatch(name, type, field_type);
+                return DataType::Undefined;
+            }
+            type = field_type;
+            found = true;
+        }
+        // an object whose shape isn't known may have it, the C backend checks
+        // its type when the program runs
+        if (!found && !unknown) {
+            std::cerr << d->identifier << " has no field " << name << "\n";
+            failed = true;
+            assert(false);
+        }
+        return type;
+    }
+
+    static bool is_array_length(const Expression* e) {
+        if (e->kind != NodeKind::MemberExpression) {
+            return false;
+        }
+        auto m = static_cast<const MemberExpression*>(e);
+        return m->declaration && m->declaration->data_type == DataType::Array &&
+               !m->computed &&
+               static_cast<const IdentifierExpression*>(m->property)->value == "length";
+    }
+
+    void mismatch(std::string_view what, DataType expected, DataType got) {
+        std::cerr << "type mismatch: " << what << " is " << expected << " but got " << got << "\n";
+        failed = true;
+        assert(false);
+    }
+
+    DataType binary_type(Operator op, DataType left, DataType right) {
+        // operands that aren't known yet are checked once they are
+        auto check = [this, op](DataType type, bool allowed) {
+            if (type != DataType::Undefined && !allowed) {
+                mismatch("operand of " + operator_to_string(op), DataType::Integer, type);
+            }
+        };
+        auto integer = [](DataType type) { return type == DataType::Integer; };
+
+        switch (op) {
+            case Operator::Plus:
+                if (left == DataType::String || right == DataType::String) {
+                    return DataType::String;
+                }
+                check(left, integer(left));
+                check(right, integer(right));
+                return DataType::Integer;
+            case Operator::Minus:
+            case Operator::Multiply:
+            case Operator::Divide:
+                check(left, integer(left));
+                check(right, integer(right));
+                return DataType::Integer;
+            case Operator::EqualTo:
+            case Operator::NotEqualTo: {
+                // integers, bools and strings, each compared with its own type
+                auto comparable = [](DataType type) {
+                    return type == DataType::Integer || type == DataType::Bool || type == DataType::String;
+                };
+                check(left, comparable(left));
+                check(right, comparable(right));
+                if (left != DataType::Undefined && right != DataType::Undefined && left != right) {
+                    mismatch("operand of " + operator_to_string(op), left, right);
+                }
+                return DataType::Bool;
+            }
+            case Operator::And:
+            case Operator::Or:
+                return DataType::Bool;
+            default:
+                check(left, integer(left));
+                check(right, integer(right));
+                return DataType::Bool;
+        }
+    }
+
+public:
+    // set when a pass marks a variable dynamic
+    bool changed = false;
+    // set when a type error was reported
+    bool failed = false;
+
+    explicit TypeInferrer(Program &program) : program(program) {}
+
+    using Visitor::visit;
+
+    DataType visit(UndefinedExpression* e) { return e->type = DataType::Undefined; }
+    DataType visit(IntegerLiteralExpression* e) { return e->type = DataType::Integer; }
+    DataType visit(StringLiteralExpression* e) { return e->type = DataType::String; }
+    DataType visit(BooleanLiteralExpression* e) { return e->type = DataType::Bool; }
+
+    DataType visit(IdentifierExpression* e) {
+        auto symbol = lookup(e->value);
+        e->declaration = symbol ? symbol->declaration : nullptr;
+        return e->type = symbol ? symbol->type : DataType::Undefined;
+    }
+
+    DataType visit(FunctionExpression* e) {
+        if (e->parameter_declarations.size() != e->parameters.size()) {
+            e->parameter_declarations = program.arena.make_array<DeclarationStatement*>(e->parameters.size());
+            for (size_t i = 0; i < e->parameters.size(); i++) {
+                auto d = program.arena.make<DeclarationStatement>();
+                d->identifier = e->parameters[i];
+                d->value = program.arena.make<UndefinedExpression>();
+                e->parameter_declarations[i] = d;
+            }
+        }
+
+        push_scope();
+        for (auto d : e->parameter_declarations) {
+            declare(d->identifier, Symbol{d->data_type, d});
+        }
+        // worked out again every pass, parameters may have gotten types
+        e->return_type = DataType::Undefined;
+        functions.push_back(e);
+        visit(e->body);
+        functions.pop_back();
+        pop_scope();
+        return e->type = DataType::Function;
+    }
+
+    DataType visit(ObjectExpression* e) {
+        std::vector<ObjectField> fields;
+        for (auto &p : e->properties) {
+            auto type = visit(p.value);
+            for (auto &f : fields) {
+                if (f.name == p.key) {
+                    std::cerr << "duplicate field " << p.key << "\n";
+                    failed = true;
+                    assert(false);
+                }
+            }
+            fields.push_back({p.key, type, type == DataType::Object ? object_shape(p.value) : nullptr,
+                              element_type(p.value)});
+        }
+
+        e->shape = intern(fields);
+        return e->type = DataType::Object;
+    }
+
+    DataType visit(ArrayExpression* e) {
+        e->element_type = DataType::Undefined;
+        for (auto element : e->elements) {
+            auto type = visit(element);
+            if (e->element_type == DataType::Undefined) {
+                e->element_type = type;
+            } else if (type != e->element_type && type != DataType::Undefined) {
+                mismatch("array element", e->element_type, type);
+            }
+        }
+        return e->type = DataType::Array;
+    }
+
+    DataType visit(MemberExpression* e) {
+        auto symbol = lookup(e->identifier);
+        e->declaration = symbol ? symbol->declaration : nullptr;
+        auto array = e->declaration && e->declaration->data_type == DataType::Array;
+
+        // a computed property, like the index in "a[i]"
+        if (e->computed) {
+            auto index = visit(e->property);
+            if (index != DataType::Integer && index != DataType::Undefined) {
+                mismatch("array index", DataType::Integer, index);
+            }
+            return e->type = array ? e->declaration->element_type : DataType::Undefined;
+        }
+
+        auto name = static_cast<IdentifierExpression*>(e->property)->value;
+        if (array && name == "length") {
+            return e->type = DataType::Integer;
+        }
+        if (e->declaration && e->declaration->dynamic_shape) {
+            return e->type = dynamic_field_type(e->declaration, name);
+        }
+        if (!e->declaration || !e->declaration->shape) {
+            return e->type = DataType::Undefined;
+        }
+
+        auto field = e->declaration->shape->field(name);
+        if (field < 0) {
+            std::cerr << e->identifier << " has no field " << name << "\n";
+            failed = true;
+            assert(false);
+            return e->type = DataType::Undefined;
+        }
+        return e->type = e->declaration->shape->fields[field].type;
+    }
+
+    DataType visit(FunctionCallExpression* e) {
+        for (auto arg : e->arguments) {
+            visit(arg);
+        }
+        auto symbol = lookup(e->value);
+        e->declaration = symbol ? symbol->declaration : nullptr;
+        if (!symbol || !symbol->function) {
+            return e->type = DataType::Undefined;
+        }
+
+        auto function = symbol->function;
+        if (e->arguments.size() != function->parameters.size()) {
+            std::cerr << e->value << " takes " << function->parameters.size() << " arguments but got "
+                      << e->arguments.size() << "\n";
+            failed = true;
+            assert(false);
+        }
+
+        // the first argument for a parameter decides its type, the function
+        // is visited again with it on the next pass
+        for (size_t i = 0; i < e->arguments.size(); i++) {
+            auto d = function->parameter_declarations[i];
+            auto arg = e->arguments[i];
+            if (d->data_type == DataType::Undefined && arg->type != DataType::Undefined) {
+                d->data_type = arg->type;
+                changed = true;
+            } else if (arg->type != DataType::Undefined && arg->type != d->data_type) {
+                mismatch(d->identifier, d->data_type, arg->type);
+            }
+            if (arg->type == DataType::Object) {
+                hold(d, arg);
+            } else if (arg->type == DataType::Array) {
+                hold_elements(d, arg);
+            }
+        }
+        return e->type = function->return_type;
+    }
+
+    DataType visit(UnaryExpression* e) {
+        visit(e->argument);
+        return e->type = DataType::Bool;
+    }
+
+    DataType visit(BinaryExpression* e) {
+        auto type = DataType::Undefined;
+        walk_left_chain(e, [&](Expression* left) { type = visit(left); },
+                        [&](BinaryExpression* b) {
+                            auto right = visit(b->right);
+                            type = b->type = binary_type(b->op, type, right);
+                        });
+        return type;
+    }
+
+    DataType visit(AssignmentExpression* e) {
+        auto type = visit(e->right);
+
+        if (e->left->kind == NodeKind::IdentifierExpression) {
+            auto id = static_cast<IdentifierExpression*>(e->left);
+            auto symbol = lookup(id->value);
+
+            if (symbol && symbol->type == DataType::Undefined && symbol->declaration) {
+                // declared without a value, the first assignment decides
+                symbol->type = type;
+                symbol->declaration->data_type = type;
+            } else if (symbol && symbol->type != type && type != DataType::Undefined) {
+                mismatch(id->value, symbol->type, type);
+            }
+            if (symbol && symbol->declaration && type == DataType::Object) {
+                hold(symbol->declaration, e->right);
+            }
+            if (symbol && symbol->declaration && type == DataType::Array) {
+                hold_elements(symbol->declaration, e->right);
+            }
+            id->declaration = symbol ? symbol->declaration : nullptr;
+            id->type = symbol ? symbol->type : DataType::Undefined;
+        } else {
+            auto field_type = visit(e->left);
+            if (is_array_length(e->left)) {
+                std::cerr << "can't assign an array's length\n";
+                failed = true;
+                assert(false);
+            }
+            if (field_type != DataType::Undefined && type != DataType::Undefined && field_type != type) {
+                mismatch("field", field_type, type);
+            }
+            if (field_type == DataType::Object && e->left->kind == NodeKind::MemberExpression) {
+                // a field that holds objects of one shape can't be given another
+                auto field_shape = object_shape(e->left);
+                if (field_shape && field_shape != object_shape(e->right)) {
+                    std::cerr << "can't change the shape of a field's object\n";
+                    failed = true;
+                    assert(false);
+                }
+            }
+        }
+
+        return e->type = type;
+    }
+
+    void visit(BlockStatement* s) {
+        push_scope();
+        for (auto st : s->statements) {
+            visit(st);
+        }
+        pop_scope();
+    }
+
+    void visit(DeclarationStatement* s) {
+        Symbol symbol;
+        symbol.declaration = s;
+        if (s->value->kind == NodeKind::FunctionExpression) {
+            symbol.type = DataType::Function;
+            symbol.function = static_cast<FunctionExpression*>(s->value);
+            // before the body, so the function can call itself
+            declare(s->identifier, symbol);
+        }
+        symbol.type = visit(s->value);
+
+        s->data_type = symbol.type;
+        s->shape = nullptr;
+        if (symbol.type == DataType::Object) {
+            hold(s, s->value);
+        }
+        s->element_type = DataType::Undefined;
+        if (symbol.type == DataType::Array) {
+            hold_elements(s, s->value);
+        }
+        declare(s->identifier, symbol);
+    }
+
+    void visit(ReturnStatement* s) {
+        auto type = visit(s->value);
+        if (functions.empty() || type == DataType::Undefined) {
+            return;
+        }
+
+        auto function = functions.back();
+        if (function->return_type == DataType::Undefined) {
+            function->return_type = type;
+        } else if (function->return_type != type) {
+            mismatch("return value", function->return_type, type);
+        }
+    }
+
+    void visit(IfStatement* s) {
+        visit(s->condition);
+        visit(s->if_block);
+        if (s->else_block) {
+            visit(s->else_block);
+        }
+    }
+
+    void visit(WhileStatement* s) {
+        visit(s->condition);
+        visit(s->body);
+    }
+
+    void visit(ExpressionStatement* s) {
+        visit(s->value);
+    }
+};
+
+bool is_print(const FunctionCallExpression* e) {
+    return !e->declaration && e->value == "print";
+}
+
+const Shape* object_shape(const Expression* e) {
+    switch (e->kind) {
+        case NodeKind::ObjectExpression:
+            return static_cast<const ObjectExpression*>(e)->shape;
+        case NodeKind::IdentifierExpression: {
+            auto d = static_cast<const IdentifierExpression*>(e)->declaration;
+            return d && !d->dynamic_shape ? d->shape : nullptr;
+        }
+        case NodeKind::MemberExpression: {
+            auto m = static_cast<const MemberExpression*>(e);
+            auto d = m->declaration;
+            if (!d || d->dynamic_shape || !d->shape || m->computed) {
+                return nullptr;
+            }
+            auto field = d->shape->field(static_cast<const IdentifierExpression*>(m->property)->value);
+            return field >= 0 ? d->shape->fields[field].shape : nullptr;
+        }
+        default:
+            return nullptr;
+    }
+}
+
+bool infer_types(Program &program) {
+    program.shapes.clear();
+    TypeInferrer inferrer(program);
+
+    // marking a variable dynamic makes what's copied from it dynamic too,
+    // even when the copy came first, so go again until nothing changes
+    do {
+        inferrer.changed = false;
+        for (auto s : program.statements) {
+            inferrer.visit(s);
+        }
+    } while (inferrer.changed && !inferrer.failed);
+
+    return !inferrer.failed;
+}
+
+}
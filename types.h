@@ -0,0 +1,33 @@
+#pragma once
+
+#include "ast.h"
+
+namespace mango {
+
+// Infers the DataType of every expression, declaration and function
+// return in the program. A variable's type is the type of the value it's
+// declared with, or of the first value assigned to it when it's declared
+// without one, assigning a value of another type later is an error.
+// A parameter's type is the type of the first argument passed for it.
+// Things whose type can't be known yet, like parameters of functions
+// that are never called and undeclared names, stay Undefined.
+//
+// Object literals get a Shape, and a member access on a variable whose
+// shape is known gets the type of the field. Variables that hold objects
+// of more than one shape are marked dynamic.
+//
+// Arrays hold elements of one type, indexing one gives that type and its
+// length is an Integer.
+//
+// Returns false if the program has a type error, after saying what it is
+// on stderr.
+bool infer_types(Program &program);
+
+// whether e calls the print builtin, which prints its arguments on a line
+bool is_print(const FunctionCallExpression* e);
+
+// the shape of the object e evaluates to, null when it isn't known before
+// the program runs. only meaningful after infer_types.
+const Shape* object_shape(const Expression* e);
+
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vector>
+
+#include "visitor.h"
+
+namespace mango {
+
+// collects the declarations, assignments, loops, array indexing, calls and
+// functions in a subtree, for passes that need to know where they are
+class Uses : public Visitor<Uses> {
+public:
+    std::vector<DeclarationStatement*> declarations;
+    std::vector<AssignmentExpression*> assignments;
+    std::vector<WhileStatement*> loops;
+    // computed member expressions, like "a[i]"
+    std::vector<MemberExpression*> indexes;
+    std::vector<FunctionCallExpression*> calls;
+    std::vector<FunctionExpression*> functions;
+
+    using Visitor::visit;
+
+    void visit(UndefinedExpression* e) {}
+    void visit(IdentifierExpression* e) {}
+    void visit(IntegerLiteralExpression* e) {}
+    void visit(StringLiteralExpression* e) {}
+    void visit(BooleanLiteralExpression* e) {}
+    void visit(FunctionExpression* e) {
+        functions.push_back(e);
+        visit(e->body);
+    }
+    void visit(UnaryExpression* e) { visit(e->argument); }
+
+    void visit(ObjectExpression* e) {
+        for (auto &p : e->properties) {
+            visit(p.value);
+        }
+    }
+
+    void visit(ArrayExpression* e) {
+        for (auto element : e->elements) {
+            visit(element);
+        }
+    }
+
+    void visit(MemberExpression* e) {
+        if (e->computed) {
+            indexes.push_back(e);
+            visit(e->property);
+        }
+    }
+
+    void visit(FunctionCallExpression* e) {
+        calls.push_back(e);
+        for (auto arg : e->arguments) {
+            visit(arg);
+        }
+    }
+
+    void visit(BinaryExpression* e) {
+        walk_left_chain(e, [this](Expression* left) { visit(left); },
+                        [this](BinaryExpression* b) { visit(b->right); });
+    }
+
+    void visit(AssignmentExpression* e) {
+        assignments.push_back(e);
+        visit(e->left);
+        visit(e->right);
+    }
+
+    void visit(BlockStatement* s) {
+        for (auto st : s->statements) {
+            visit(st);
+        }
+    }
+
+    void visit(DeclarationStatement* s) {
+        declarations.push_back(s);
+        visit(s->value);
+    }
+
+    void visit(ReturnStatement* s) { visit(s->value); }
+    void visit(ExpressionStatement* s) { visit(s->value); }
+
+    void visit(IfStatement* s) {
+        visit(s->condition);
+        visit(s->if_block);
+        if (s->else_block) {
+            visit(s->else_block);
+        }
+    }
+
+    void visit(WhileStatement* s) {
+        loops.push_back(s);
+        visit(s->condition);
+        visit(s->body);
+    }
+};
+
+}
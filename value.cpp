@@ -0,0 +1,180 @@
+#include "value.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+
+namespace mango {
+
+namespace {
+
+// The header of a string buffer, its characters follow it. Strings made by
+// joining others start at a buffer's first character, a string that ends
+// where the buffer's used part does can have more appended in place.
+struct StringBuffer {
+    uint32_t used;
+    uint32_t capacity;
+};
+
+char* buffer_chars(StringBuffer* buffer) {
+    return reinterpret_cast<char*>(buffer + 1);
+}
+
+StringBuffer* buffer_of(const char* chars) {
+    return reinterpret_cast<StringBuffer*>(const_cast<char*>(chars)) - 1;
+}
+
+// v as the text joining it to a string gives, false when it has none
+bool text(const Value &v, char (&buffer)[16], std::string_view &out) {
+    switch (v.type) {
+        case ValueType::String:
+            out = {v.chars, v.length};
+            return true;
+        case ValueType::Integer:
+            out = {buffer, static_cast<size_t>(snprintf(buffer, sizeof(buffer), "%d", v.integer))};
+            return true;
+        case ValueType::Bool:
+            out = v.boolean ? "true" : "false";
+            return true;
+        case ValueType::Undefined:
+            out = "undefined";
+            return true;
+        default:
+            return false;
+    }
+}
+
+}
+
+const char* type_name(ValueType type) {
+    switch (type) {
+        case ValueType::Undefined:
+            return "undefined";
+        case ValueType::Integer:
+            return "an integer";
+        case ValueType::Bool:
+            return "a bool";
+        case ValueType::String:
+            return "a string";
+        case ValueType::Object:
+            return "an object";
+        case ValueType::Array:
+            return "an array";
+        case ValueType::Function:
+            return "a function";
+        case ValueType::Cell:
+            break;
+    }
+    return "a cell";
+}
+
+bool equal(const Value &x, const Value &y) {
+    auto scalar = [](ValueType t) { return t == ValueType::Integer || t == ValueType::Bool; };
+    if (x.type == ValueType::String || y.type == ValueType::String) {
+        // like the C runtime, anything compared to a string is made one
+        char xb[16], yb[16];
+        std::string_view xs, ys;
+        return text(x, xb, xs) && text(y, yb, ys) && xs == ys;
+    }
+    if (scalar(x.type) && scalar(y.type)) {
+        auto xi = x.type == ValueType::Bool ? x.boolean : x.integer;
+        auto yi = y.type == ValueType::Bool ? y.boolean : y.integer;
+        return xi == yi;
+    }
+    if (x.type != y.type) {
+        return false;
+    }
+    switch (x.type) {
+        case ValueType::Undefined:
+            return true;
+        case ValueType::Object:
+            return x.object == y.object;
+        case ValueType::Array:
+            return x.array == y.array;
+        case ValueType::Function:
+            return x.closure == y.closure;
+        default:
+            return false;
+    }
+}
+
+Value concat(Arena &heap, const Value &left, const Value &right) {
+    char lb[16], rb[16];
+    std::string_view l, r;
+    Value v;
+    v.type = ValueType::Undefined;
+    if (!text(left, lb, l) || !text(right, rb, r)) {
+        std::cerr << "can't join " << type_name(left.type) << " and " << type_name(right.type) << "\n";
+        return v;
+    }
+
+    v.type = ValueType::String;
+    v.buffered = true;
+    v.length = static_cast<uint32_t>(l.size() + r.size());
+
+    if (left.type == ValueType::String && left.buffered) {
+        auto buffer = buffer_of(left.chars);
+        if (buffer->used == left.length && v.length <= buffer->capacity) {
+            memcpy(buffer_chars(buffer) + left.length, r.data(), r.size());
+            buffer->used = v.length;
+            v.chars = left.chars;
+            return v;
+        }
+    }
+
+    // room to double, so joining onto the end in a loop copies each
+    // character a constant number of times
+    auto capacity = std::max<uint32_t>(32, v.length * 2);
+    auto buffer = static_cast<StringBuffer*>(heap.allocate(sizeof(StringBuffer) + capacity, alignof(StringBuffer)));
+    buffer->used = v.length;
+    buffer->capacity = capacity;
+    memcpy(buffer_chars(buffer), l.data(), l.size());
+    memcpy(buffer_chars(buffer) + l.size(), r.data(), r.size());
+    v.chars = buffer_chars(buffer);
+    return v;
+}
+
+void print_value(FILE* out, const Value &v) {
+    switch (v.type) {
+        case ValueType::Undefined:
+            fputs("undefined", out);
+            break;
+        case ValueType::Integer:
+            fprintf(out, "%d", v.integer);
+            break;
+        case ValueType::Bool:
+            fputs(v.boolean ? "true" : "false", out);
+            break;
+        case ValueType::String:
+            fwrite(v.chars, 1, v.length, out);
+            break;
+        case ValueType::Object:
+            fputc('{', out);
+            for (size_t i = 0; i < v.object->shape->fields.size(); i++) {
+                auto name = v.object->shape->fields[i].name;
+                fprintf(out, "%s%.*s: ", i > 0 ? ", " : "", static_cast<int>(name.size()), name.data());
+                print_value(out, v.object->fields[i]);
+            }
+            fputc('}', out);
+            break;
+        case ValueType::Array:
+            fputc('[', out);
+            for (uint32_t i = 0; i < v.array->length; i++) {
+                if (i > 0) {
+                    fputs(", ", out);
+                }
+                print_value(out, v.array->items[i]);
+            }
+            fputc(']', out);
+            break;
+        case ValueType::Function:
+            fputs("function", out);
+            break;
+        case ValueType::Cell:
+            print_value(out, v.cell->value);
+            break;
+    }
+}
+
+}
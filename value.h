@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#include "arena.h"
+#include "ast.h"
+
+namespace mango {
+
+enum class ValueType : uint8_t {
+    Undefined,
+    Integer,
+    Bool,
+    String,
+    Object,
+    Array,
+    Function,
+    // a captured variable, only ever in registers, see Op::Box
+    Cell,
+};
+
+struct ObjectValue;
+struct ArrayValue;
+struct ClosureValue;
+struct Cell;
+
+// What a register holds. Strings are characters and a length, the
+// characters are either the program's own or in a buffer the VM made when
+// joining strings, which joining more onto the end of appends to.
+struct Value {
+    ValueType type;
+    // whether chars starts a string buffer
+    bool buffered;
+    uint32_t length;
+    union {
+        int32_t integer;
+        bool boolean;
+        const char* chars;
+        ObjectValue* object;
+        ArrayValue* array;
+        ClosureValue* closure;
+        Cell* cell;
+    };
+};
+
+struct ObjectValue {
+    const Shape* shape;
+    Value* fields;
+};
+
+struct ArrayValue {
+    uint32_t length;
+    Value* items;
+};
+
+struct Cell {
+    Value value;
+};
+
+struct ClosureValue {
+    uint32_t function;
+    Cell** cells;
+};
+
+const char* type_name(ValueType type);
+
+inline bool truthy(const Value &v) {
+    switch (v.type) {
+        case ValueType::Bool:
+            return v.boolean;
+        case ValueType::Integer:
+            return v.integer != 0;
+        case ValueType::String:
+            return v.length != 0;
+        case ValueType::Undefined:
+            return false;
+        default:
+            return true;
+    }
+}
+
+// what == means, anything compared to a string is made one first like the
+// C runtime does
+bool equal(const Value &x, const Value &y);
+
+// left and right joined into a string allocated from heap, undefined when
+// one of them can't be made a string, after saying so on stderr
+Value concat(Arena &heap, const Value &left, const Value &right);
+
+// prints v like the print builtin does
+void print_value(FILE* out, const Value &v);
+
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cassert>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "ast.h"
+
+namespace mango {
+
+// Visitor dispatches a node to the visit overload for its type by
+// switching on its kind, with the overload resolved at compile time in
+// the Derived pass so it can be inlined, no virtual calls or RTTI.
+//
+// A pass derives from Visitor<Pass, Result>, or Visitor<Pass,
+// ExpressionResult, StatementResult> when visiting expressions and
+// statements returns different things, pulls the dispatching
+// visit(Expression*) and visit(Statement*) in with `using Visitor::visit;`
+// and declares visit for the node types it handles. Types it doesn't
+// handle end up in visit_expression / visit_statement, which fail unless
+// the pass declares its own.
+template<typename Derived, typename Result = void, typename StatementResult = Result>
+class Visitor {
+    Derived &derived() { return static_cast<Derived &>(*this); }
+
+public:
+    Result visit(Expression* e) {
+        switch (e->kind) {
+            case NodeKind::UndefinedExpression:
+                return derived().visit(static_cast<UndefinedExpression*>(e));
+            case NodeKind::IdentifierExpression:
+                return derived().visit(static_cast<IdentifierExpression*>(e));
+            case NodeKind::IntegerLiteralExpression:
+                return derived().visit(static_cast<IntegerLiteralExpression*>(e));
+            case NodeKind::StringLiteralExpression:
+                return derived().visit(static_cast<StringLiteralExpression*>(e));
+            case NodeKind::BooleanLiteralExpression:
+                return derived().visit(static_cast<BooleanLiteralExpression*>(e));
+            case NodeKind::FunctionExpression:
+                return derived().visit(static_cast<FunctionExpression*>(e));
+            case NodeKind::ObjectExpression:
+                return derived().visit(static_cast<ObjectExpression*>(e));
+            case NodeKind::ArrayExpression:
+                return derived().visit(static_cast<ArrayExpression*>(e));
+            case NodeKind::MemberExpression:
+                return derived().visit(static_cast<MemberExpression*>(e));
+            case NodeKind::FunctionCallExpression:
+                return derived().visit(static_cast<FunctionCallExpression*>(e));
+            case NodeKind::BinaryExpression:
+                return derived().visit(static_cast<BinaryExpression*>(e));
+            case NodeKind::UnaryExpression:
+                return derived().visit(static_cast<UnaryExpression*>(e));
+            case NodeKind::AssignmentExpression:
+                return derived().visit(static_cast<AssignmentExpression*>(e));
+            default:
+                break;
+        }
+
+        std::cerr << "not an expression\n";
+        assert(false);
+        return Result();
+    }
+
+    StatementResult visit(Statement* s) {
+        switch (s->kind) {
+            case NodeKind::BlockStatement:
+                return derived().visit(static_cast<BlockStatement*>(s));
+            case NodeKind::DeclarationStatement:
+                return derived().visit(static_cast<DeclarationStatement*>(s));
+            case NodeKind::ReturnStatement:
+                return derived().visit(static_cast<ReturnStatement*>(s));
+            case NodeKind::IfStatement:
+                return derived().visit(static_cast<IfStatement*>(s));
+            case NodeKind::WhileStatement:
+                return derived().visit(static_cast<WhileStatement*>(s));
+            case NodeKind::ExpressionStatement:
+                return derived().visit(static_cast<ExpressionStatement*>(s));
+            default:
+                break;
+        }
+
+        std::cerr << "not a statement\n";
+        assert(false);
+        return StatementResult();
+    }
+
+    Result visit(UndefinedExpression* e) { return derived().visit_expression(e); }
+    Result visit(IdentifierExpression* e) { return derived().visit_expression(e); }
+    Result visit(IntegerLiteralExpression* e) { return derived().visit_expression(e); }
+    Result visit(StringLiteralExpression* e) { return derived().visit_expression(e); }
+    Result visit(BooleanLiteralExpression* e) { return derived().visit_expression(e); }
+    Result visit(FunctionExpression* e) { return derived().visit_expression(e); }
+    Result visit(ObjectExpression* e) { return derived().visit_expression(e); }
+    Result visit(ArrayExpression* e) { return derived().visit_expression(e); }
+    Result visit(MemberExpression* e) { return derived().visit_expression(e); }
+    Result visit(FunctionCallExpression* e) { return derived().visit_expression(e); }
+    Result visit(BinaryExpression* e) { return derived().visit_expression(e); }
+    Result visit(UnaryExpression* e) { return derived().visit_expression(e); }
+    Result visit(AssignmentExpression* e) { return derived().visit_expression(e); }
+    StatementResult visit(BlockStatement* s) { return derived().visit_statement(s); }
+    StatementResult visit(DeclarationStatement* s) { return derived().visit_statement(s); }
+    StatementResult visit(ReturnStatement* s) { return derived().visit_statement(s); }
+    StatementResult visit(IfStatement* s) { return derived().visit_statement(s); }
+    StatementResult visit(WhileStatement* s) { return derived().visit_statement(s); }
+    StatementResult visit(ExpressionStatement* s) { return derived().visit_statement(s); }
+
+    Result visit_expression(Expression* e) {
+        std::cerr << "unhandled expression\n";
+        assert(false);
+        return Result();
+    }
+
+    StatementResult visit_statement(Statement* s) {
+        std::cerr << "unhandled statement\n";
+        assert(false);
+        return StatementResult();
+    }
+};
+
+// Left leaning chains like "a - b - c - ..." can be very long, so passes
+// walk them with walk_left_chain instead of recursing down the left
+// operands. It calls innermost with the left operand at the bottom of the
+// chain e is the top of, then operation with every binary expression in
+// the chain from the bottom up, the order recursing would get to them in.
+template<typename Innermost, typename Operation>
+void walk_left_chain(BinaryExpression* e, Innermost innermost, Operation operation) {
+    // short chains, which are most of them, are kept on the stack
+    BinaryExpression* short_chain[16];
+    std::vector<BinaryExpression*> long_chain;
+    auto chain = short_chain;
+    size_t length = 0;
+    for (Expression* left = e; left->kind == NodeKind::BinaryExpression;) {
+        if (length == std::size(short_chain)) {
+            long_chain.assign(short_chain, short_chain + length);
+        }
+        if (length >= std::size(short_chain)) {
+            long_chain.push_back(static_cast<BinaryExpression*>(left));
+            chain = long_chain.data();
+        } else {
+            chain[length] = static_cast<BinaryExpression*>(left);
+        }
+        length++;
+        left = static_cast<BinaryExpression*>(left)->left;
+    }
+
+    innermost(chain[length - 1]->left);
+    for (auto i = length; i-- > 0;) {
+        operation(chain[i]);
+    }
+}
+
+}
@@ -0,0 +1,546 @@
+#include "vm.h"
+
+#include <iostream>
+
+namespace mango {
+
+namespace {
+
+inline int32_t wrap(uint32_t v) {
+    return static_cast<int32_t>(v);
+}
+
+}
+
+VM::VM(const Bytecode &bytecode, FILE* out, bool compile)
+        : bytecode(bytecode), out(out), stack(new Value[stack_size]), caches(bytecode.caches) {
+    if (compile && Jit::supported()) {
+        jit = std::make_unique<Jit>(bytecode, stack.get() + stack_size);
+    }
+}
+
+bool VM::run() {
+    auto functions = bytecode.functions.data();
+    const BytecodeFunction* function = &functions[0];
+    const Instruction* code = function->code.data();
+    const Instruction* ip = code;
+    Value* r = stack.get();
+    Value* stack_end = stack.get() + stack_size;
+    ClosureValue* closure = nullptr;
+    Value result;
+    frames.clear();
+
+    if (r + function->registers > stack_end) {
+        std::cerr << "stack overflow\n";
+        return false;
+    }
+
+    auto values = [&](size_t n) {
+        return static_cast<Value*>(heap.allocate(sizeof(Value) * n, alignof(Value)));
+    };
+
+#if defined(__GNUC__)
+    static const void* labels[] = {
+#define MANGO_OP(name) &&op_##name,
+            MANGO_OPS(MANGO_OP)
+#undef MANGO_OP
+    };
+#define DISPATCH() goto *labels[static_cast<uint8_t>(ip->op)]
+#define CASE(name) case Op::name: op_##name
+#else
+#define DISPATCH() goto dispatch
+#define CASE(name) case Op::name
+#endif
+#define NEXT()        \
+    do {              \
+        ip++;         \
+        DISPATCH();   \
+    } while (false)
+#define FAIL(message)                       \
+    do {                                    \
+        fflush(out);                        \
+        std::cerr << message << "\n";       \
+        return false;                       \
+    } while (false)
+#define SET_INTEGER(value)                  \
+    do {                                    \
+        auto v = (value);                   \
+        r[ip->a].type = ValueType::Integer; \
+        r[ip->a].integer = v;               \
+    } while (false)
+#define SET_BOOL(value)                     \
+    do {                                    \
+        auto v = (value);                   \
+        r[ip->a].type = ValueType::Bool;    \
+        r[ip->a].boolean = v;               \
+    } while (false)
+#define INTEGERS(what)                                                                                   \
+    auto &x = r[ip->b];                                                                                  \
+    auto &y = r[ip->c];                                                                                  \
+    if (x.type != ValueType::Integer || y.type != ValueType::Integer) {                                  \
+        FAIL("can't " what " " << type_name(x.type) << " and " << type_name(y.type));                    \
+    }
+
+#if !defined(__GNUC__)
+dispatch:
+#endif
+    switch (ip->op) {
+        CASE(Move): {
+            r[ip->a] = r[ip->b];
+            NEXT();
+        }
+        CASE(LoadInt): {
+            SET_INTEGER(static_cast<int32_t>(ip->b));
+            NEXT();
+        }
+        CASE(LoadString): {
+            auto s = bytecode.strings[ip->b];
+            auto &v = r[ip->a];
+            v.type = ValueType::String;
+            v.buffered = false;
+            v.length = static_cast<uint32_t>(s.size());
+            v.chars = s.data();
+            NEXT();
+        }
+        CASE(LoadBool): {
+            SET_BOOL(ip->b != 0);
+            NEXT();
+        }
+        CASE(LoadUndefined): {
+            r[ip->a].type = ValueType::Undefined;
+            NEXT();
+        }
+        CASE(Add): {
+            auto &x = r[ip->b];
+            auto &y = r[ip->c];
+            if (x.type == ValueType::Integer && y.type == ValueType::Integer) {
+                SET_INTEGER(wrap(static_cast<uint32_t>(x.integer) + static_cast<uint32_t>(y.integer)));
+            } else if (x.type == ValueType::String || y.type == ValueType::String) {
+                auto v = concat(heap, x, y);
+                if (v.type == ValueType::Undefined) {
+                    return false;
+                }
+                r[ip->a] = v;
+            } else {
+                FAIL("can't add " << type_name(x.type) << " and " << type_name(y.type));
+            }
+            NEXT();
+        }
+        CASE(Subtract): {
+            INTEGERS("subtract")
+            SET_INTEGER(wrap(static_cast<uint32_t>(x.integer) - static_cast<uint32_t>(y.integer)));
+            NEXT();
+        }
+        CASE(Multiply): {
+            INTEGERS("multiply")
+            SET_INTEGER(wrap(static_cast<uint32_t>(x.integer) * static_cast<uint32_t>(y.integer)));
+            NEXT();
+        }
+        CASE(Divide): {
+            INTEGERS("divide")
+            if (y.integer == 0) {
+                FAIL("division by zero");
+            }
+            // INT_MIN / -1 overflows, wrap it around like the rest
+            SET_INTEGER(y.integer == -1 ? wrap(0u - static_cast<uint32_t>(x.integer)) : x.integer / y.integer);
+            NEXT();
+        }
+        CASE(Less): {
+            INTEGERS("compare")
+            SET_BOOL(x.integer < y.integer);
+            NEXT();
+        }
+        CASE(LessEqual): {
+            INTEGERS("compare")
+            SET_BOOL(x.integer <= y.integer);
+            NEXT();
+        }
+        CASE(Greater): {
+            INTEGERS("compare")
+            SET_BOOL(x.integer > y.integer);
+            NEXT();
+        }
+        CASE(GreaterEqual): {
+            INTEGERS("compare")
+            SET_BOOL(x.integer >= y.integer);
+            NEXT();
+        }
+        CASE(Equal): {
+            SET_BOOL(equal(r[ip->b], r[ip->c]));
+            NEXT();
+        }
+        CASE(NotEqual): {
+            SET_BOOL(!equal(r[ip->b], r[ip->c]));
+            NEXT();
+        }
+        CASE(AddInt): {
+            SET_INTEGER(wrap(static_cast<uint32_t>(r[ip->b].integer) + static_cast<uint32_t>(r[ip->c].integer)));
+            NEXT();
+        }
+        CASE(SubtractInt): {
+            SET_INTEGER(wrap(static_cast<uint32_t>(r[ip->b].integer) - static_cast<uint32_t>(r[ip->c].integer)));
+            NEXT();
+        }
+        CASE(MultiplyInt): {
+            SET_INTEGER(wrap(static_cast<uint32_t>(r[ip->b].integer) * static_cast<uint32_t>(r[ip->c].integer)));
+            NEXT();
+        }
+        CASE(LessInt): {
+            SET_BOOL(r[ip->b].integer < r[ip->c].integer);
+            NEXT();
+        }
+        CASE(LessEqualInt): {
+            SET_BOOL(r[ip->b].integer <= r[ip->c].integer);
+            NEXT();
+        }
+        CASE(GreaterInt): {
+            SET_BOOL(r[ip->b].integer > r[ip->c].integer);
+            NEXT();
+        }
+        CASE(GreaterEqualInt): {
+            SET_BOOL(r[ip->b].integer >= r[ip->c].integer);
+            NEXT();
+        }
+        CASE(EqualInt): {
+            SET_BOOL(r[ip->b].integer == r[ip->c].integer);
+            NEXT();
+        }
+        CASE(NotEqualInt): {
+            SET_BOOL(r[ip->b].integer != r[ip->c].integer);
+            NEXT();
+        }
+        CASE(Not): {
+            SET_BOOL(!truthy(r[ip->b]));
+            NEXT();
+        }
+        CASE(Jump): {
+            ip = code + ip->b;
+            DISPATCH();
+        }
+        CASE(JumpIfFalse): {
+            if (!truthy(r[ip->a])) {
+                ip = code + ip->b;
+                DISPATCH();
+            }
+            NEXT();
+        }
+        CASE(JumpIfTrue): {
+            if (truthy(r[ip->a])) {
+                ip = code + ip->b;
+                DISPATCH();
+            }
+            NEXT();
+        }
+        CASE(Loop): {
+            if (truthy(r[ip->a])) {
+                if (jit) {
+                    auto index = static_cast<uint32_t>(function - functions);
+                    auto end = static_cast<uint32_t>(ip - code);
+                    if (auto native = jit->loop(index, end)) {
+                        // compiled loops only ever stop, they return by
+                        // leaving it to the VM
+                        native(r, &jit->state);
+                        jit->stopped_loop(index, end);
+                        goto resume;
+                    }
+                }
+                ip = code + ip->b;
+                DISPATCH();
+            }
+            NEXT();
+        }
+        CASE(NewObject): {
+            auto shape = bytecode.shapes[ip->b];
+            auto object = heap.make<ObjectValue>();
+            object->shape = shape;
+            object->fields = values(shape->fields.size());
+            std::copy(r + ip->c, r + ip->c + shape->fields.size(), object->fields);
+            auto &v = r[ip->a];
+            v.type = ValueType::Object;
+            v.object = object;
+            NEXT();
+        }
+        CASE(GetField): {
+            auto &x = r[ip->b];
+            if (x.type != ValueType::Object) {
+                FAIL("can't get a field of " << type_name(x.type));
+            }
+            r[ip->a] = x.object->fields[ip->c];
+            NEXT();
+        }
+        CASE(SetField): {
+            auto &x = r[ip->a];
+            if (x.type != ValueType::Object) {
+                FAIL("can't set a field of " << type_name(x.type));
+            }
+            x.object->fields[ip->b] = r[ip->c];
+            NEXT();
+        }
+        CASE(GetNamed): {
+            auto &x = r[ip->b];
+            auto &cache = caches[ip->c];
+            if (x.type == ValueType::Object) {
+                auto object = x.object;
+                if (object->shape != cache.shape) {
+                    cache.shape = object->shape;
+                    cache.index = object->shape->field(cache.name);
+                }
+                if (cache.index < 0) {
+                    FAIL("object has no field " << cache.name);
+                }
+                r[ip->a] = object->fields[cache.index];
+            } else if (x.type == ValueType::Array && cache.name == "length") {
+                SET_INTEGER(static_cast<int32_t>(x.array->length));
+            } else {
+                FAIL("can't get " << cache.name << " of " << type_name(x.type));
+            }
+            NEXT();
+        }
+        CASE(SetNamed): {
+            auto &x = r[ip->a];
+            auto &cache = caches[ip->b];
+            if (x.type != ValueType::Object) {
+                FAIL("can't set " << cache.name << " of " << type_name(x.type));
+            }
+            auto object = x.object;
+            if (object->shape != cache.shape) {
+                cache.shape = object->shape;
+                cache.index = object->shape->field(cache.name);
+            }
+            if (cache.index < 0) {
+                FAIL("object has no field " << cache.name);
+            }
+            object->fields[cache.index] = r[ip->c];
+            NEXT();
+        }
+        CASE(NewArray): {
+            auto array = heap.make<ArrayValue>();
+            array->length = ip->c;
+            array->items = values(ip->c);
+            std::copy(r + ip->b, r + ip->b + ip->c, array->items);
+            auto &v = r[ip->a];
+            v.type = ValueType::Array;
+            v.array = array;
+            NEXT();
+        }
+        CASE(GetIndex): {
+            auto &x = r[ip->b];
+            auto &i = r[ip->c];
+            if (x.type != ValueType::Array || i.type != ValueType::Integer) {
+                FAIL("can't index " << type_name(x.type) << " with " << type_name(i.type));
+            }
+            if (static_cast<uint32_t>(i.integer) >= x.array->length) {
+                FAIL("index " << i.integer << " is out of bounds of an array of length " << x.array->length);
+            }
+            r[ip->a] = x.array->items[i.integer];
+            NEXT();
+        }
+        CASE(GetIndexUnchecked): {
+            r[ip->a] = r[ip->b].array->items[r[ip->c].integer];
+            NEXT();
+        }
+        CASE(SetIndex): {
+            auto &x = r[ip->a];
+            auto &i = r[ip->b];
+            if (x.type != ValueType::Array || i.type != ValueType::Integer) {
+                FAIL("can't index " << type_name(x.type) << " with " << type_name(i.type));
+            }
+            if (static_cast<uint32_t>(i.integer) >= x.array->length) {
+                FAIL("index " << i.integer << " is out of bounds of an array of length " << x.array->length);
+            }
+            x.array->items[i.integer] = r[ip->c];
+            NEXT();
+        }
+        CASE(Length): {
+            auto &x = r[ip->b];
+            if (x.type != ValueType::Array) {
+                FAIL("can't get the length of " << type_name(x.type));
+            }
+            SET_INTEGER(static_cast<int32_t>(x.array->length));
+            NEXT();
+        }
+        CASE(Closure): {
+            auto &f = functions[ip->b];
+            auto made = heap.make<ClosureValue>();
+            made->function = ip->b;
+            made->cells = nullptr;
+            if (!f.captures.empty()) {
+                made->cells = static_cast<Cell**>(heap.allocate(sizeof(Cell*) * f.captures.size(), alignof(Cell*)));
+            }
+            for (size_t i = 0; i < f.captures.size(); i++) {
+                auto &capture = f.captures[i];
+                switch (capture.source) {
+                    case CaptureSource::Register:
+                        made->cells[i] = r[capture.index].cell;
+                        break;
+                    case CaptureSource::Capture:
+                        made->cells[i] = closure->cells[capture.index];
+                        break;
+                    case CaptureSource::Self: {
+                        auto cell = heap.make<Cell>();
+                        cell->value.type = ValueType::Function;
+                        cell->value.closure = closure;
+                        made->cells[i] = cell;
+                        break;
+                    }
+                }
+            }
+            auto &v = r[ip->a];
+            v.type = ValueType::Function;
+            v.closure = made;
+            NEXT();
+        }
+        CASE(Box): {
+            auto cell = heap.make<Cell>();
+            cell->value = r[ip->a];
+            r[ip->a].type = ValueType::Cell;
+            r[ip->a].cell = cell;
+            NEXT();
+        }
+        CASE(LoadCell): {
+            r[ip->a] = r[ip->b].cell->value;
+            NEXT();
+        }
+        CASE(StoreCell): {
+            r[ip->a].cell->value = r[ip->b];
+            NEXT();
+        }
+        CASE(LoadCapture): {
+            r[ip->a] = closure->cells[ip->b]->value;
+            NEXT();
+        }
+        CASE(StoreCapture): {
+            closure->cells[ip->a]->value = r[ip->b];
+            NEXT();
+        }
+        CASE(LoadSelf): {
+            r[ip->a].type = ValueType::Function;
+            r[ip->a].closure = closure;
+            NEXT();
+        }
+        CASE(Call): {
+            auto &callee = r[ip->b];
+            if (callee.type != ValueType::Function) {
+                FAIL("can't call " << type_name(callee.type));
+            }
+            auto called = callee.closure;
+            auto f = &functions[called->function];
+            if (ip->c != f->parameters) {
+                FAIL(f->name << " takes " << f->parameters << " arguments but got " << ip->c);
+            }
+            auto base = r + ip->b + 1;
+            if (base + f->registers > stack_end) {
+                FAIL("stack overflow");
+            }
+            if (jit) {
+                if (auto native = jit->call(called->function)) {
+                    if (native(base, &jit->state) == Jit::returned) {
+                        r[ip->a] = jit->state.result;
+                        NEXT();
+                    }
+                    jit->stopped_function(called->function);
+                    frames.push_back({function, ip + 1, r, closure, ip->a});
+                    closure = called;
+                    goto resume;
+                }
+            }
+            frames.push_back({function, ip + 1, r, closure, ip->a});
+            function = f;
+            code = ip = f->code.data();
+            r = base;
+            closure = called;
+            DISPATCH();
+        }
+        CASE(CallDirect): {
+            auto f = &functions[ip->c];
+            auto base = r + ip->b;
+            if (base + f->registers > stack_end) {
+                FAIL("stack overflow");
+            }
+            if (jit) {
+                if (auto native = jit->call(ip->c)) {
+                    if (native(base, &jit->state) == Jit::returned) {
+                        r[ip->a] = jit->state.result;
+                        NEXT();
+                    }
+                    jit->stopped_function(ip->c);
+                    frames.push_back({function, ip + 1, r, closure, ip->a});
+                    closure = nullptr;
+                    goto resume;
+                }
+            }
+            frames.push_back({function, ip + 1, r, closure, ip->a});
+            function = f;
+            code = ip = f->code.data();
+            r = base;
+            closure = nullptr;
+            DISPATCH();
+        }
+        CASE(Return): {
+            result = r[ip->a];
+            goto finish_call;
+        }
+        CASE(ReturnUndefined): {
+            result.type = ValueType::Undefined;
+            goto finish_call;
+        }
+        CASE(Print): {
+            for (uint32_t i = 0; i < ip->b; i++) {
+                if (i > 0) {
+                    fputc(' ', out);
+                }
+                print_value(out, r[ip->a + i]);
+            }
+            fputc('\n', out);
+            NEXT();
+        }
+    }
+    return false;
+
+finish_call:
+    if (frames.empty()) {
+        fflush(out);
+        return true;
+    }
+    {
+        auto &frame = frames.back();
+        function = frame.function;
+        code = function->code.data();
+        ip = frame.return_to;
+        r = frame.registers;
+        closure = frame.closure;
+        r[frame.result] = result;
+        frames.pop_back();
+    }
+    DISPATCH();
+
+resume:
+    // compiled code stopped, carry on from the frames it left, the
+    // outermost is the one it was entered with
+    {
+        auto stopped = jit->state.frames;
+        auto count = jit->state.frame_count;
+        jit->state.frame_count = 0;
+        for (auto i = count - 1; i > 0; i--) {
+            auto f = &functions[stopped[i].function];
+            auto call = &f->code[stopped[i].ip];
+            frames.push_back({f, call + 1, stopped[i].registers, closure, call->a});
+            closure = nullptr;
+        }
+        function = &functions[stopped[0].function];
+        code = function->code.data();
+        ip = code + stopped[0].ip;
+        r = stopped[0].registers;
+    }
+    DISPATCH();
+
+#undef DISPATCH
+#undef CASE
+#undef NEXT
+#undef FAIL
+#undef SET_INTEGER
+#undef SET_BOOL
+#undef INTEGERS
+}
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "arena.h"
+#include "bytecode.h"
+#include "jit.h"
+#include "value.h"
+
+namespace mango {
+
+// Runs compiled bytecode. Each call gets a window of one big register
+// stack, starting at the caller's registers for the arguments so they
+// don't need copying. Instructions are dispatched by jumping straight
+// from one handler to the next through a table of label addresses where
+// the compiler supports it, with a switch otherwise. Functions and loops
+// that run often are compiled to machine code, see jit.h.
+//
+// There's no garbage collector: every string, object, array and closure
+// the program makes comes from heap, an arena that's only freed when the
+// VM is destroyed, even once nothing refers to it any more. Memory grows
+// with everything a run ever allocated, a loop that builds a short string
+// each time around uses about 40 bytes per iteration, 80MB for 2 million.
+class VM {
+    struct Frame {
+        const BytecodeFunction* function;
+        const Instruction* return_to;
+        Value* registers;
+        ClosureValue* closure;
+        uint32_t result;
+    };
+
+    static constexpr size_t stack_size = 1 << 20;
+
+    const Bytecode &bytecode;
+    FILE* out;
+    Arena heap;
+    std::unique_ptr<Value[]> stack;
+    std::vector<Frame> frames;
+    std::vector<FieldCache> caches;
+    // nullptr when nothing is compiled
+    std::unique_ptr<Jit> jit;
+
+public:
+    // prints what the program prints to out, compiling what runs often if
+    // compile is true and the machine is supported
+    explicit VM(const Bytecode &bytecode, FILE* out = stdout, bool compile = true);
+
+    // runs the program, returns false if it fails, like indexing an array
+    // out of bounds, after saying why on stderr
+    bool run();
+};
+
+}